@@ -0,0 +1,160 @@
+// Compares the std::unordered_map vertex dedup CFXModel used to do against CFXVertexDedup.
+//
+// usage: vertex_dedup_bench [iterations] [model.obj ...]
+
+#include "cfx_obj_loader.hpp"
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include "cfx_model.hpp"
+#include "cfx_utils.hpp"
+#include "cfx_vertex_dedup.hpp"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <unordered_map>
+
+namespace
+{
+    using Vertex = cfx::CFXModel::Vertex;
+
+    struct MapHash
+    {
+        size_t operator()(const Vertex &vertex) const
+        {
+            size_t seed = 0;
+            cfx::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
+            return seed;
+        }
+    };
+
+    // the face-ordered vertex stream Builder::loadObj feeds into dedup
+    std::vector<Vertex> loadVertexStream(const std::string &filepath)
+    {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::string warn;
+        std::string error;
+        if (!cfx::loadObjParallel(&attrib, &shapes, &warn, &error, filepath))
+        {
+            throw std::runtime_error(warn + error);
+        }
+        std::vector<Vertex> stream;
+        for (const auto &shape : shapes)
+        {
+            for (const auto &index : shape.mesh.indices)
+            {
+                Vertex vertex{};
+                if (index.vertex_index >= 0)
+                {
+                    vertex.position = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1], attrib.vertices[3 * index.vertex_index + 2]};
+                    vertex.color = {attrib.colors[3 * index.vertex_index + 0], attrib.colors[3 * index.vertex_index + 1], attrib.colors[3 * index.vertex_index + 2]};
+                }
+                if (index.normal_index >= 0)
+                {
+                    vertex.normal = {attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1], attrib.normals[3 * index.normal_index + 2]};
+                }
+                if (index.texcoord_index >= 0)
+                {
+                    vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0], attrib.texcoords[2 * index.texcoord_index + 1]};
+                }
+                stream.push_back(vertex);
+            }
+        }
+        return stream;
+    }
+
+    void dedupWithMap(const std::vector<Vertex> &stream, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+    {
+        vertices.clear();
+        indices.clear();
+        std::unordered_map<Vertex, uint32_t, MapHash> uniqueVertices{};
+        for (const auto &vertex : stream)
+        {
+            if (uniqueVertices.count(vertex) == 0)
+            {
+                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+            }
+            indices.push_back(uniqueVertices[vertex]);
+        }
+    }
+
+    void dedupWithTable(const std::vector<Vertex> &stream, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+    {
+        vertices.clear();
+        indices.clear();
+        indices.reserve(stream.size());
+        cfx::CFXVertexDedup uniqueVertices{vertices, stream.size()};
+        for (const auto &vertex : stream)
+        {
+            indices.push_back(uniqueVertices.insert(vertex));
+        }
+    }
+
+    template <typename Fn>
+    double timeIterations(int iterations, Fn fn)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            fn();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::chrono::milliseconds::period>(end - start).count() / iterations;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+    std::vector<std::string> models;
+    for (int i = 2; i < argc; i++)
+    {
+        models.push_back(argv[i]);
+    }
+    if (models.empty())
+    {
+        models = {CFX_MODEL_DIR "/flat_vase.obj", CFX_MODEL_DIR "/smooth_vase.obj"};
+    }
+
+    try
+    {
+        for (const auto &model : models)
+        {
+            std::vector<Vertex> stream = loadVertexStream(model);
+            std::vector<Vertex> mapVertices, tableVertices;
+            std::vector<uint32_t> mapIndices, tableIndices;
+
+            double mapTime = timeIterations(iterations, [&]
+                                            { dedupWithMap(stream, mapVertices, mapIndices); });
+            double tableTime = timeIterations(iterations, [&]
+                                              { dedupWithTable(stream, tableVertices, tableIndices); });
+
+            bool identical = mapIndices == tableIndices && mapVertices.size() == tableVertices.size();
+            for (size_t i = 0; identical && i < mapVertices.size(); i++)
+            {
+                identical = mapVertices[i] == tableVertices[i];
+            }
+
+            std::cout << model << ": " << stream.size() << " indices, " << tableVertices.size() << " unique vertices\n"
+                      << "  unordered_map  " << mapTime << " ms\n"
+                      << "  CFXVertexDedup " << tableTime << " ms (" << mapTime / tableTime << "x)"
+                      << (identical ? "" : "  OUTPUT MISMATCH") << std::endl;
+            if (!identical)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
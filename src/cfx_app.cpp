@@ -26,8 +26,8 @@ namespace cfx
     for (int deviceIndex = 0; deviceIndex < cfxDevice.getDevicesinDeviceGroup(); deviceIndex++)
     {
       cfxDescriptorPools[deviceIndex] = CFXDescriptorPool::Builder(cfxDevice)
-                                            .setMaxSets(CFXSwapChain::MAX_FRAMES_IN_FLIGHT)
-                                            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, CFXSwapChain::MAX_FRAMES_IN_FLIGHT)
+                                            .setMaxSets(1)
+                                            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1)
                                             .build(deviceIndex);
     }
     loadGameObjects();
@@ -38,34 +38,20 @@ namespace cfx
   void App::run()
   {
 
-    std::vector<std::vector<std::unique_ptr<CFXBuffer>>> uboBuffers(cfxDevice.getDevicesinDeviceGroup());
-    std::vector<std::vector<VkDescriptorSet>> cfxGlobalDescriptorSets(cfxDevice.getDevicesinDeviceGroup());
+    std::vector<VkDescriptorSet> cfxGlobalDescriptorSets(cfxDevice.getDevicesinDeviceGroup());
     std::vector<std::unique_ptr<CFXDescriptorSetLayout>> cfxSetLayouts(cfxDevice.getDevicesinDeviceGroup());
     std::string framerateString = "Vulkan Window";
 
-    for (int deviceIndex = 0; deviceIndex < uboBuffers.size(); deviceIndex++)
+    for (int deviceIndex = 0; deviceIndex < cfxGlobalDescriptorSets.size(); deviceIndex++)
     {
-      // std::cout<< "RESIZING UBO FOR DEVICE " << deviceIndex << std::endl;
-      uboBuffers[deviceIndex].resize(CFXSwapChain::MAX_FRAMES_IN_FLIGHT);
-      cfxGlobalDescriptorSets[deviceIndex].resize(CFXSwapChain::MAX_FRAMES_IN_FLIGHT);
-      for (int i = 0; i < uboBuffers[deviceIndex].size(); i++)
-      {
-        // std::cout<< "MAPPING UBO FOR FRAME " << i << " ON DEVICE "  << deviceIndex << std::endl;
-        uboBuffers[deviceIndex][i] = std::make_unique<CFXBuffer>(cfxDevice, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, (int)deviceIndex);
-        uboBuffers[deviceIndex][i]->map();
-        // std::cout<< "MAPPED UBO FOR FRAME " << i << " ON DEVICE "  << deviceIndex << std::endl;
-      }
-      cfxSetLayouts[deviceIndex] = CFXDescriptorSetLayout::Builder(cfxDevice).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).build(deviceIndex);
+      // one set per device, each frame binds it at the dynamic offset of its GlobalUbo in the frame ring
+      cfxSetLayouts[deviceIndex] = CFXDescriptorSetLayout::Builder(cfxDevice).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT).build(deviceIndex);
 
-      for (int i = 0; i < cfxGlobalDescriptorSets[deviceIndex].size(); i++)
-      {
-
-        auto bufferInfo = uboBuffers[deviceIndex][i]->descriptorInfo();
-        CFXDescriptorWriter(*cfxSetLayouts[deviceIndex], *cfxDescriptorPools[deviceIndex]).writeBuffer(0, &bufferInfo).build(cfxGlobalDescriptorSets[deviceIndex][i], deviceIndex);
-      }
+      VkDescriptorBufferInfo bufferInfo{frameRing.getBuffer(deviceIndex), 0, sizeof(GlobalUbo)};
+      CFXDescriptorWriter(*cfxSetLayouts[deviceIndex], *cfxDescriptorPools[deviceIndex]).writeBuffer(0, &bufferInfo).build(cfxGlobalDescriptorSets[deviceIndex], deviceIndex);
     }
 
-    CFXRenderSystem cfxRenderSystem{cfxDevice, cfxRenderer.getSwapChainRenderPasses(), cfxSetLayouts};
+    CFXRenderSystem cfxRenderSystem{cfxDevice, geometryArena, cfxRenderer.getSwapChainRenderPasses(), cfxSetLayouts};
     CFXPointLightSystem cfxPointLightSystem{cfxDevice, cfxRenderer.getSwapChainRenderPasses(), cfxSetLayouts};
     CFXCamera camera{};
 
@@ -86,6 +72,8 @@ namespace cfx
     {
 
       glfwPollEvents();
+      modelStreamer.update();
+      residencyManager.update();
       auto newTime = std::chrono::high_resolution_clock::now();
 
       float frameTime = std::chrono::duration<float, std::chrono::milliseconds::period>(newTime - currentTime).count();
@@ -100,20 +88,21 @@ namespace cfx
 
       if (renderBuffer.commandBuffer != nullptr)
       {
-        auto frameTimeStart = std::chrono::high_resolution_clock::now();
         int frameIndex = cfxRenderer.getFrameIndex();
         deviceName = cfxDevice.getDeviceName(renderBuffer.deviceIndex);
 
-        FrameInfo frameInfo{frameIndex, frameTime, renderBuffer.commandBuffer, camera, renderBuffer.deviceIndex, cfxGlobalDescriptorSets[renderBuffer.deviceIndex][frameIndex], cfxGameObjects};
+        frameRing.beginFrame(renderBuffer.deviceIndex, frameIndex, cfxRenderer.getInFlightFence(renderBuffer.deviceIndex));
+
+        FrameInfo frameInfo{frameIndex, frameTime, renderBuffer.commandBuffer, camera, renderBuffer.deviceIndex, cfxGlobalDescriptorSets[renderBuffer.deviceIndex], 0, cfxGameObjects, static_cast<float>(cfxRenderer.getSwapChainHeight())};
         GlobalUbo globalUbo{};
         globalUbo.projection = camera.getProjection();
         globalUbo.view = camera.getView();
 
         cfxPointLightSystem.update(frameInfo, globalUbo);
 
-        uboBuffers[renderBuffer.deviceIndex][frameIndex]->writeToBuffer(&globalUbo);
+        frameInfo.globalUboOffset = frameRing.write(renderBuffer.deviceIndex, globalUbo).dynamicOffset();
 
-        uboBuffers[renderBuffer.deviceIndex][frameIndex]->flush();
+        cfxRenderSystem.cullGameObjects(frameInfo);
 
         cfxRenderer.beginSwapChainRenderPass(renderBuffer.commandBuffer, renderBuffer.deviceMask, renderBuffer.deviceIndex);
 
@@ -123,14 +112,16 @@ namespace cfx
 
         cfxRenderer.endSwapChainRenderPass(renderBuffer.commandBuffer, renderBuffer.deviceMask, renderBuffer.deviceIndex);
 
+        frameRing.flush(renderBuffer.deviceIndex);
         cfxRenderer.endFrame(renderBuffer.deviceIndex);
 
-        vkDeviceWaitIdle(cfxDevice.device(renderBuffer.deviceIndex));
-        auto frameTimeEnd = std::chrono::high_resolution_clock::now();
-        float renderFrameTime = std::chrono::duration<float, std::chrono::milliseconds::period>(frameTimeEnd - frameTimeStart).count();
+        // the CPU moves on to the next frame while this one runs, the in flight fences hold it back
+        float renderFrameTime = cfxRenderer.getGpuFrameTime(renderBuffer.deviceIndex);
 
-        framerateStrings[renderBuffer.deviceIndex] = "GPU " + cfxDevice.getDeviceName(renderBuffer.deviceIndex) + "  Frame time " + std::to_string(renderFrameTime) + " ms ";
-        totalFrameTime += renderFrameTime;
+        const CFXResidencyManager::Stats &residency = residencyManager.getStats(renderBuffer.deviceIndex);
+        framerateStrings[renderBuffer.deviceIndex] = "GPU " + cfxDevice.getDeviceName(renderBuffer.deviceIndex) + "  GPU time " + std::to_string(renderFrameTime) + " ms " +
+                                                     "VRAM " + std::to_string(residency.deviceLocal.usage >> 20) + "/" + std::to_string(residency.deviceLocal.budget >> 20) + " MB ";
+        totalFrameTime += frameTime;
         frameCounter++;
       }
 
@@ -157,25 +148,32 @@ namespace cfx
 
       window.setWindowName(framerateString);
     }
+
+    // the systems and descriptor sets below go out of scope with frames still in flight
+    for (int deviceIndex = 0; deviceIndex < cfxDevice.getDevicesinDeviceGroup(); deviceIndex++)
+    {
+      vkDeviceWaitIdle(cfxDevice.device(deviceIndex));
+    }
   }
 
   void App::loadGameObjects()
   {
 
-    std::shared_ptr<CFXModel> cfxModel = CFXModel::createModelFromFile(cfxDevice, "models/smooth_vase.obj");
+    // streamed, each object pops in once its upload has landed
+    std::shared_ptr<CFXModel> cfxModel = modelRegistry.acquire("models/smooth_vase.obj", CFXModel::VertexFormat::Packed);
     auto smoothVase = CFXGameObject::createGameObject();
     smoothVase.transformComponent.translation = {-.5f, .5f, 0.f};
     smoothVase.transformComponent.scale = glm::vec3{3.f, 1.5f, 3.f};
     smoothVase.model = cfxModel;
     cfxGameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
-    cfxModel = CFXModel::createModelFromFile(cfxDevice, "models/flat_vase.obj");
+    cfxModel = modelRegistry.acquire("models/flat_vase.obj", CFXModel::VertexFormat::Packed);
     auto flatVase = CFXGameObject::createGameObject();
     flatVase.transformComponent.translation = {.5f, .5f, 0.f};
     flatVase.transformComponent.scale = glm::vec3{3.f, 1.5f, 3.f};
     flatVase.model = cfxModel;
     cfxGameObjects.emplace(flatVase.getId(), std::move(flatVase));
 
-    cfxModel = CFXModel::createModelFromFile(cfxDevice, "models/quad.obj");
+    cfxModel = modelRegistry.acquire("models/quad.obj");
     auto floor = CFXGameObject::createGameObject();
     floor.transformComponent.translation = {0.f, .5f, 0.f};
     floor.transformComponent.scale = glm::vec3{10.f, 1.f, 10.f};
@@ -4,8 +4,11 @@
 #include "cfx_device.hpp"
 #include "cfx_renderer.hpp"
 #include "cfx_model.hpp"
+#include "cfx_model_registry.hpp"
 #include "cfx_game_object.hpp"
 #include "cfx_descriptors.hpp"
+#include "cfx_frame_ring.hpp"
+#include "cfx_residency_manager.hpp"
 #include <memory>
 #include <vector>
 #include <glm/glm.hpp>
@@ -30,6 +33,13 @@ namespace cfx
         // CFXSwapChain cfxSwapChain{cfxDevice,window.getExtent()};
         Renderer cfxRenderer{window, cfxDevice};
         std::vector<std::unique_ptr<CFXDescriptorPool>> cfxDescriptorPools;
+        CFXFrameRing frameRing{cfxDevice};
+        CFXUploadQueue uploadQueue{cfxDevice};
+        // declared before the game objects so it outlives every model allocated from it
+        CFXGeometryArena geometryArena{cfxDevice, uploadQueue};
+        CFXModelStreamer modelStreamer{cfxDevice, geometryArena, uploadQueue};
+        CFXModelRegistry modelRegistry{modelStreamer};
+        CFXResidencyManager residencyManager{cfxDevice, geometryArena, modelStreamer};
         CFXGameObject::Map cfxGameObjects;
     };
 }
\ No newline at end of file
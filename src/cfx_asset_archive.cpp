@@ -0,0 +1,319 @@
+#include "cfx_asset_archive.hpp"
+#include "cfx_lz4.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace cfx
+{
+    static std::shared_ptr<CFXAssetArchive> mountedArchive{};
+
+    static uint64_t alignUp(uint64_t offset, uint64_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    static uint32_t blockCountFor(uint64_t size, uint32_t blockSize)
+    {
+        return static_cast<uint32_t>((size + blockSize - 1) / blockSize);
+    }
+
+    std::string CFXAssetArchive::normalizeName(const std::string &name)
+    {
+        std::filesystem::path path = std::filesystem::path(name).lexically_normal();
+        if (path.is_absolute())
+        {
+            std::error_code error;
+            std::filesystem::path relative = path.lexically_relative(std::filesystem::current_path(error));
+            if (!error && !relative.empty() && *relative.begin() != "..")
+            {
+                path = relative;
+            }
+        }
+        return path.generic_string();
+    }
+
+    uint64_t CFXAssetArchive::hashName(const std::string &name)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (char c : name)
+        {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    std::shared_ptr<CFXAssetArchive> CFXAssetArchive::open(const std::string &filepath)
+    {
+        std::shared_ptr<CFXMappedFile> file = CFXMappedFile::map(filepath);
+        if (file == nullptr)
+        {
+            throw std::runtime_error("failed to open asset archive: " + filepath);
+        }
+        uint64_t fileSize = file->size();
+        const Header *header = reinterpret_cast<const Header *>(file->data());
+        if (fileSize < sizeof(Header) || header->magic != MAGIC || header->version != VERSION || header->blockSize == 0 ||
+            header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0 || header->entryCount > header->slotCount ||
+            sizeof(Header) + uint64_t(header->slotCount) * sizeof(uint32_t) > fileSize || header->entriesOffset % alignof(Entry) != 0 ||
+            header->entriesOffset > fileSize || uint64_t(header->entryCount) * sizeof(Entry) > fileSize - header->entriesOffset ||
+            header->namesOffset > fileSize || header->namesSize > fileSize - header->namesOffset)
+        {
+            throw std::runtime_error(filepath + ": not a valid asset archive");
+        }
+
+        std::shared_ptr<CFXAssetArchive> archive{new CFXAssetArchive()};
+        archive->path = filepath;
+        archive->file = file;
+        archive->header = header;
+        archive->slots = reinterpret_cast<const uint32_t *>(file->data() + sizeof(Header));
+        archive->entries = reinterpret_cast<const Entry *>(file->data() + header->entriesOffset);
+        archive->names = reinterpret_cast<const char *>(file->data() + header->namesOffset);
+        for (uint32_t i = 0; i < header->slotCount; i++)
+        {
+            if (archive->slots[i] != EMPTY_SLOT && archive->slots[i] >= header->entryCount)
+            {
+                throw std::runtime_error(filepath + ": slot " + std::to_string(i) + " out of range");
+            }
+        }
+        for (uint32_t i = 0; i < header->entryCount; i++)
+        {
+            const Entry &entry = archive->entries[i];
+            bool compressed = (entry.flags & ENTRY_COMPRESSED) != 0;
+            if (entry.nameOffset > header->namesSize || entry.nameLength > header->namesSize - entry.nameOffset ||
+                entry.dataOffset % DATA_ALIGNMENT != 0 || entry.dataOffset > fileSize || entry.storedSize > fileSize - entry.dataOffset ||
+                (!compressed && entry.storedSize != entry.size) ||
+                (compressed && (entry.blockCount != blockCountFor(entry.size, header->blockSize) ||
+                                entry.storedSize < uint64_t(entry.blockCount) * sizeof(uint32_t))))
+            {
+                throw std::runtime_error(filepath + ": entry " + std::to_string(i) + " out of range");
+            }
+        }
+        return archive;
+    }
+
+    bool CFXAssetArchive::write(const std::string &filepath, const std::vector<EntryData> &entryData)
+    {
+        Header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.entryCount = static_cast<uint32_t>(entryData.size());
+        header.slotCount = 1;
+        while (header.slotCount < header.entryCount * 2)
+        {
+            header.slotCount *= 2;
+        }
+        header.blockSize = BLOCK_SIZE;
+
+        std::vector<uint32_t> slots(header.slotCount, EMPTY_SLOT);
+        std::vector<Entry> entries(entryData.size());
+        std::string names{};
+        std::vector<std::vector<uint8_t>> payloads(entryData.size());
+        std::vector<uint8_t> block(CFXLz4::compressBound(BLOCK_SIZE));
+        for (size_t i = 0; i < entryData.size(); i++)
+        {
+            const EntryData &data = entryData[i];
+            std::string name = normalizeName(data.name);
+            Entry &entry = entries[i];
+            entry.nameHash = hashName(name);
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint32_t>(name.size());
+            entry.size = data.size;
+            entry.time = data.time;
+            names += name;
+            for (size_t slot = entry.nameHash & (header.slotCount - 1);; slot = (slot + 1) & (header.slotCount - 1))
+            {
+                if (slots[slot] == EMPTY_SLOT)
+                {
+                    slots[slot] = static_cast<uint32_t>(i);
+                    break;
+                }
+                const Entry &other = entries[slots[slot]];
+                if (other.nameHash == entry.nameHash && names.compare(other.nameOffset, other.nameLength, name) == 0)
+                {
+                    throw std::runtime_error("duplicate asset archive entry: " + name);
+                }
+            }
+
+            entry.blockCount = blockCountFor(data.size, BLOCK_SIZE);
+            std::vector<uint8_t> &payload = payloads[i];
+            payload.resize(size_t(entry.blockCount) * sizeof(uint32_t));
+            for (uint32_t b = 0; b < entry.blockCount; b++)
+            {
+                const uint8_t *source = data.data + size_t(b) * BLOCK_SIZE;
+                size_t sourceSize = std::min<size_t>(BLOCK_SIZE, data.size - size_t(b) * BLOCK_SIZE);
+                size_t compressedSize = CFXLz4::compress(source, sourceSize, block.data());
+                uint32_t blockHeader = static_cast<uint32_t>(compressedSize);
+                if (compressedSize >= sourceSize)
+                {
+                    blockHeader = static_cast<uint32_t>(sourceSize) | RAW_BLOCK;
+                    payload.insert(payload.end(), source, source + sourceSize);
+                }
+                else
+                {
+                    payload.insert(payload.end(), block.data(), block.data() + compressedSize);
+                }
+                memcpy(payload.data() + b * sizeof(uint32_t), &blockHeader, sizeof(blockHeader));
+            }
+            // barely compressible entries are cheaper to serve straight from the mapping
+            if (payload.size() < data.size - data.size / 8)
+            {
+                entry.flags = ENTRY_COMPRESSED;
+            }
+            else
+            {
+                payload.assign(data.data, data.data + data.size);
+                entry.flags = 0;
+            }
+            entry.storedSize = payload.size();
+        }
+
+        header.entriesOffset = alignUp(sizeof(Header) + slots.size() * sizeof(uint32_t), alignof(Entry));
+        header.namesOffset = header.entriesOffset + entries.size() * sizeof(Entry);
+        header.namesSize = names.size();
+        uint64_t offset = header.namesOffset + header.namesSize;
+        for (Entry &entry : entries)
+        {
+            entry.dataOffset = alignUp(offset, DATA_ALIGNMENT);
+            offset = entry.dataOffset + entry.storedSize;
+        }
+
+        // same as the mesh cache, a partially written archive never replaces a good one
+        std::string tempPath = filepath + ".tmp";
+        {
+            std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+            if (!file.is_open())
+            {
+                return false;
+            }
+            file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(uint32_t));
+            const char padding[DATA_ALIGNMENT] = {};
+            file.write(padding, header.entriesOffset - (sizeof(Header) + slots.size() * sizeof(uint32_t)));
+            file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+            file.write(names.data(), names.size());
+            uint64_t written = header.namesOffset + header.namesSize;
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                file.write(padding, entries[i].dataOffset - written);
+                file.write(reinterpret_cast<const char *>(payloads[i].data()), payloads[i].size());
+                written = entries[i].dataOffset + entries[i].storedSize;
+            }
+            if (!file.good())
+            {
+                file.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+        return std::rename(tempPath.c_str(), filepath.c_str()) == 0;
+    }
+
+    void CFXAssetArchive::mount(std::shared_ptr<CFXAssetArchive> archive)
+    {
+        mountedArchive = std::move(archive);
+    }
+
+    const std::shared_ptr<CFXAssetArchive> &CFXAssetArchive::mounted()
+    {
+        return mountedArchive;
+    }
+
+    const CFXAssetArchive::Entry *CFXAssetArchive::find(const std::string &name) const
+    {
+        std::string normalized = normalizeName(name);
+        uint64_t hash = hashName(normalized);
+        uint32_t mask = header->slotCount - 1;
+        // a valid archive always has empty slots, the bound only guards against a corrupt one
+        for (uint32_t probe = 0, slot = static_cast<uint32_t>(hash) & mask; probe < header->slotCount; probe++, slot = (slot + 1) & mask)
+        {
+            if (slots[slot] == EMPTY_SLOT)
+            {
+                return nullptr;
+            }
+            const Entry &entry = entries[slots[slot]];
+            if (entry.nameHash == hash && normalized.compare(0, std::string::npos, names + entry.nameOffset, entry.nameLength) == 0)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<CFXMappedFile> CFXAssetArchive::read(const Entry &entry) const
+    {
+        const uint8_t *payload = file->data() + entry.dataOffset;
+        if ((entry.flags & ENTRY_COMPRESSED) == 0)
+        {
+            return CFXMappedFile::view(file, payload, entry.size);
+        }
+        std::string name{names + entry.nameOffset, entry.nameLength};
+
+        std::vector<uint64_t> blockOffsets(size_t(entry.blockCount) + 1);
+        blockOffsets[0] = uint64_t(entry.blockCount) * sizeof(uint32_t);
+        for (uint32_t b = 0; b < entry.blockCount; b++)
+        {
+            uint32_t blockHeader;
+            memcpy(&blockHeader, payload + b * sizeof(uint32_t), sizeof(blockHeader));
+            blockOffsets[b + 1] = blockOffsets[b] + (blockHeader & ~RAW_BLOCK);
+            if (blockOffsets[b + 1] > entry.storedSize)
+            {
+                throw std::runtime_error(path + ": corrupt block table for " + name);
+            }
+        }
+
+        std::vector<uint8_t> bytes(entry.size);
+        std::atomic<uint32_t> nextBlock{0};
+        std::atomic<bool> failed{false};
+        auto decodeBlocks = [&]()
+        {
+            for (uint32_t b = nextBlock++; b < entry.blockCount; b = nextBlock++)
+            {
+                uint64_t begin = uint64_t(b) * header->blockSize;
+                size_t size = static_cast<size_t>(std::min<uint64_t>(header->blockSize, entry.size - begin));
+                const uint8_t *source = payload + blockOffsets[b];
+                size_t sourceSize = static_cast<size_t>(blockOffsets[b + 1] - blockOffsets[b]);
+                uint32_t blockHeader;
+                memcpy(&blockHeader, payload + b * sizeof(uint32_t), sizeof(blockHeader));
+                if ((blockHeader & RAW_BLOCK) == 0)
+                {
+                    if (!CFXLz4::decompress(source, sourceSize, bytes.data() + begin, size))
+                    {
+                        failed = true;
+                    }
+                }
+                else if (sourceSize == size)
+                {
+                    memcpy(bytes.data() + begin, source, size);
+                }
+                else
+                {
+                    failed = true;
+                }
+            }
+        };
+
+        // single block entries such as most shaders are not worth a thread
+        unsigned threadCount = std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()), entry.blockCount);
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threadCount; i++)
+        {
+            workers.emplace_back(decodeBlocks);
+        }
+        decodeBlocks();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        if (failed)
+        {
+            throw std::runtime_error(path + ": corrupt data for " + name);
+        }
+        return CFXMappedFile::fromBuffer(std::move(bytes));
+    }
+}
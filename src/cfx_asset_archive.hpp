@@ -0,0 +1,104 @@
+#pragma once
+
+#include "cfx_mapped_file.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Packed asset archive (.cfxa) holding models, SPIR-V and any other file the app opens.
+     *
+     * The file is a fixed header, an open-addressing table of name hashes, the entry table,
+     * the entry names and the entry payloads. All of it is memory-mapped on open, so a
+     * lookup hashes the name and probes the mapped table without parsing anything up front.
+     * Payloads are cut into BLOCK_SIZE blocks that are LZ4 compressed independently and
+     * decompressed on worker threads; entries that do not compress are stored as they are
+     * and handed out as views into the mapping. Build it with the asset_archive target.
+     */
+    class CFXAssetArchive
+    {
+    public:
+        static constexpr uint32_t MAGIC = 0x41584643; // "CFXA"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t BLOCK_SIZE = 256 * 1024;
+        static constexpr uint64_t DATA_ALIGNMENT = 16;
+        static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+        // Entry flag: the payload starts with one uint32_t size per block, followed by the blocks
+        static constexpr uint32_t ENTRY_COMPRESSED = 1;
+        // Block size bit: the block did not compress and is stored as it is
+        static constexpr uint32_t RAW_BLOCK = 0x80000000;
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t entryCount;
+            // power of two, each slot holds an entry index or EMPTY_SLOT
+            uint32_t slotCount;
+            uint32_t blockSize;
+            uint32_t reserved;
+            uint64_t entriesOffset;
+            uint64_t namesOffset;
+            uint64_t namesSize;
+        };
+
+        struct Entry
+        {
+            uint64_t nameHash;
+            uint32_t nameOffset;
+            uint32_t nameLength;
+            uint64_t size;
+            // modification time of the packed file in nanoseconds
+            int64_t time;
+            uint64_t dataOffset;
+            uint64_t storedSize;
+            uint32_t blockCount;
+            uint32_t flags;
+        };
+
+        // A file to be packed, the data is not owned
+        struct EntryData
+        {
+            std::string name;
+            const uint8_t *data;
+            size_t size;
+            int64_t time;
+        };
+
+        CFXAssetArchive(const CFXAssetArchive &) = delete;
+        CFXAssetArchive &operator=(const CFXAssetArchive &) = delete;
+
+        // Throws std::runtime_error if the archive is missing or malformed
+        static std::shared_ptr<CFXAssetArchive> open(const std::string &filepath);
+        // Packs entries into filepath, returns false if the file could not be written.
+        // Throws std::runtime_error if two entries have the same name.
+        static bool write(const std::string &filepath, const std::vector<EntryData> &entries);
+
+        // The archive CFXMappedFile consults before the disk. Mount it at startup, before anything is loaded.
+        static void mount(std::shared_ptr<CFXAssetArchive> archive);
+        static const std::shared_ptr<CFXAssetArchive> &mounted();
+
+        // Names are paths relative to the working directory, absolute paths below it match as well.
+        // Returns nullptr if the archive has no such file.
+        const Entry *find(const std::string &name) const;
+        // Throws std::runtime_error if the entry is corrupt
+        std::shared_ptr<CFXMappedFile> read(const Entry &entry) const;
+
+    private:
+        CFXAssetArchive() = default;
+        static std::string normalizeName(const std::string &name);
+        static uint64_t hashName(const std::string &name);
+
+        std::string path{};
+        std::shared_ptr<CFXMappedFile> file{};
+        const Header *header = nullptr;
+        const uint32_t *slots = nullptr;
+        const Entry *entries = nullptr;
+        const char *names = nullptr;
+    };
+}
@@ -0,0 +1,84 @@
+#include "cfx_bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CFX_BOUNDS_SSE 1
+#endif
+
+namespace cfx
+{
+    // vertexAt(i) returns the position of the i-th considered vertex
+    template <typename VertexAt>
+    static CFXBounds computeBounds(VertexAt vertexAt, size_t stride, size_t count)
+    {
+        CFXBounds bounds{};
+        if (count == 0)
+        {
+            return bounds;
+        }
+
+        glm::vec3 boundsMin{vertexAt(0)[0], vertexAt(0)[1], vertexAt(0)[2]};
+        glm::vec3 boundsMax{boundsMin};
+#ifdef CFX_BOUNDS_SSE
+        // a 4-wide load reads one float past the position, only safe when the vertex has one
+        if (stride >= 4 * sizeof(float))
+        {
+            __m128 vmin = _mm_loadu_ps(vertexAt(0));
+            __m128 vmax = vmin;
+            for (size_t i = 1; i < count; i++)
+            {
+                __m128 position = _mm_loadu_ps(vertexAt(i));
+                vmin = _mm_min_ps(vmin, position);
+                vmax = _mm_max_ps(vmax, position);
+            }
+            alignas(16) float lanes[2][4];
+            _mm_store_ps(lanes[0], vmin);
+            _mm_store_ps(lanes[1], vmax);
+            boundsMin = glm::vec3{lanes[0][0], lanes[0][1], lanes[0][2]};
+            boundsMax = glm::vec3{lanes[1][0], lanes[1][1], lanes[1][2]};
+        }
+        else
+#endif
+        {
+            for (size_t i = 1; i < count; i++)
+            {
+                const float *position = vertexAt(i);
+                glm::vec3 p{position[0], position[1], position[2]};
+                boundsMin = glm::min(boundsMin, p);
+                boundsMax = glm::max(boundsMax, p);
+            }
+        }
+        bounds.min = boundsMin;
+        bounds.max = boundsMax;
+        bounds.center = (boundsMin + boundsMax) * 0.5f;
+
+        float radiusSquared = 0.f;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float *position = vertexAt(i);
+            glm::vec3 offset = glm::vec3{position[0], position[1], position[2]} - bounds.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+
+    CFXBounds CFXBounds::fromPositions(const float *positions, size_t stride, size_t count)
+    {
+        const char *base = reinterpret_cast<const char *>(positions);
+        return computeBounds([base, stride](size_t i)
+                             { return reinterpret_cast<const float *>(base + i * stride); },
+                             stride, count);
+    }
+
+    CFXBounds CFXBounds::fromIndexedPositions(const float *positions, size_t stride, const uint32_t *indices, size_t indexCount)
+    {
+        const char *base = reinterpret_cast<const char *>(positions);
+        return computeBounds([base, stride, indices](size_t i)
+                             { return reinterpret_cast<const float *>(base + indices[i] * stride); },
+                             stride, indexCount);
+    }
+}
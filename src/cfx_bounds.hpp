@@ -0,0 +1,30 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cfx
+{
+    /*
+     * Local space bounding volumes of a mesh or of part of it: an AABB and a sphere
+     * centered on it. Plain data, so it can be written to the mesh cache as is.
+     */
+    struct CFXBounds
+    {
+        glm::vec3 min{0.f};
+        glm::vec3 max{0.f};
+        glm::vec3 center{0.f};
+        float radius = 0.f;
+
+        glm::vec3 extent() const { return max - min; }
+
+        // positions points at the first vertex position, stride is the vertex size in bytes
+        static CFXBounds fromPositions(const float *positions, size_t stride, size_t count);
+        // Only the vertices referenced by indices are considered
+        static CFXBounds fromIndexedPositions(const float *positions, size_t stride, const uint32_t *indices, size_t indexCount);
+    };
+}
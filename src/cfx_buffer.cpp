@@ -8,6 +8,7 @@
 #include "cfx_buffer.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -40,6 +41,20 @@ namespace cfx
       VkMemoryPropertyFlags memoryPropertyFlags,
       int deviceIndex,
       VkDeviceSize minOffsetAlignment)
+      : CFXBuffer{device, instanceSize, instanceCount, usageFlags, memoryPropertyFlags,
+                  CFXMemoryTypeTable::usageFor(memoryPropertyFlags, usageFlags), deviceIndex, minOffsetAlignment}
+  {
+  }
+
+  CFXBuffer::CFXBuffer(
+      CFXDevice &device,
+      VkDeviceSize instanceSize,
+      uint32_t instanceCount,
+      VkBufferUsageFlags usageFlags,
+      VkMemoryPropertyFlags memoryPropertyFlags,
+      CFXMemoryTypeTable::Usage memoryUsage,
+      int deviceIndex,
+      VkDeviceSize minOffsetAlignment)
       : cfxDevice{device},
         instanceSize{instanceSize},
         instanceCount{instanceCount},
@@ -48,29 +63,48 @@ namespace cfx
   {
     alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
     bufferSize = alignmentSize * instanceCount;
-    device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory, deviceIndex);
+    device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, memoryUsage, buffer, memory, deviceIndex);
   }
 
   CFXBuffer::~CFXBuffer()
   {
     unmap();
-    vkDestroyBuffer(cfxDevice.device(currentDeviceIndex), buffer, nullptr);
-    vkFreeMemory(cfxDevice.device(currentDeviceIndex), memory, nullptr);
+    // the frame being recorded and those in flight may still read it
+    VkDevice device = cfxDevice.device(currentDeviceIndex);
+    CFXMemoryAllocator *allocator = &cfxDevice.getMemoryAllocator(currentDeviceIndex);
+    cfxDevice.getDeletionQueue(currentDeviceIndex).defer([device, allocator, buffer = buffer, memory = memory]() mutable
+                                                         {
+                                                           vkDestroyBuffer(device, buffer, nullptr);
+                                                           allocator->free(memory); });
   }
 
   /**
    * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
    *
+   * @note The allocator maps the memory block the buffer lives in as a whole, size is only
+   * checked against the buffer
+   *
    * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
    * buffer range.
    * @param offset (Optional) Byte offset from beginning
    *
-   * @return VkResult of the buffer mapping call
+   * @return VkResult of the buffer mapping call, VK_ERROR_MEMORY_MAP_FAILED if the range does not
+   * fit the buffer
    */
   VkResult CFXBuffer::map(VkDeviceSize size, VkDeviceSize offset)
   {
-    assert(buffer && memory && "Called map on buffer before create");
-    return vkMapMemory(cfxDevice.device(currentDeviceIndex), memory, offset, size, 0, &mapped);
+    assert(buffer && memory.memory && "Called map on buffer before create");
+    if (offset > bufferSize || (size != VK_WHOLE_SIZE && size > bufferSize - offset))
+    {
+      return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    void *data = nullptr;
+    VkResult result = cfxDevice.getMemoryAllocator(currentDeviceIndex).map(memory, &data);
+    if (result == VK_SUCCESS)
+    {
+      mapped = static_cast<char *>(data) + offset;
+    }
+    return result;
   }
 
   /**
@@ -82,7 +116,7 @@ namespace cfx
   {
     if (mapped)
     {
-      vkUnmapMemory(cfxDevice.device(currentDeviceIndex), memory);
+      cfxDevice.getMemoryAllocator(currentDeviceIndex).unmap(memory);
       mapped = nullptr;
     }
   }
@@ -110,6 +144,63 @@ namespace cfx
       memOffset += offset;
       memcpy(memOffset, data, size);
     }
+    markDirty(size, offset);
+  }
+
+  /**
+   * Record a range of the mapped buffer as written, so the next flushDirty covers it
+   *
+   * @param size (Optional) Size of the written range. Pass VK_WHOLE_SIZE to mark the complete buffer
+   * range.
+   * @param offset (Optional) Byte offset from beginning
+   *
+   */
+  void CFXBuffer::markDirty(VkDeviceSize size, VkDeviceSize offset)
+  {
+    if (size == VK_WHOLE_SIZE)
+    {
+      offset = 0;
+      size = bufferSize;
+    }
+    VkDeviceSize begin = offset;
+    VkDeviceSize end = offset + size;
+
+    // swallow every range that overlaps or touches the new one
+    auto range = std::lower_bound(dirtyRanges.begin(), dirtyRanges.end(), begin,
+                                  [](const CFXMemoryAllocator::Range &entry, VkDeviceSize value)
+                                  { return entry.offset + entry.size < value; });
+    while (range != dirtyRanges.end() && range->offset <= end)
+    {
+      begin = std::min(begin, range->offset);
+      end = std::max(end, range->offset + range->size);
+      range = dirtyRanges.erase(range);
+    }
+    dirtyRanges.insert(range, CFXMemoryAllocator::Range{begin, end - begin});
+
+    if (dirtyRanges.size() > MAX_DIRTY_RANGES)
+    {
+      VkDeviceSize first = dirtyRanges.front().offset;
+      VkDeviceSize last = dirtyRanges.back().offset + dirtyRanges.back().size;
+      dirtyRanges.assign(1, CFXMemoryAllocator::Range{first, last - first});
+    }
+  }
+
+  /**
+   * Flush every range written since the last flush to make it visible to the device
+   *
+   * @note Ranges are widened to nonCoherentAtomSize and merged, coherent memory skips the call
+   *
+   * @return VkResult of the flush call
+   */
+  VkResult CFXBuffer::flushDirty()
+  {
+    if (dirtyRanges.empty())
+    {
+      return VK_SUCCESS;
+    }
+    VkResult result = cfxDevice.getMemoryAllocator(currentDeviceIndex).flush(memory, dirtyRanges.data(), static_cast<uint32_t>(dirtyRanges.size()));
+    dirtyRanges.clear();
+    return result;
   }
 
   /**
@@ -125,12 +216,11 @@ namespace cfx
    */
   VkResult CFXBuffer::flush(VkDeviceSize size, VkDeviceSize offset)
   {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkFlushMappedMemoryRanges(cfxDevice.device(currentDeviceIndex), 1, &mappedRange);
+    if (size == VK_WHOLE_SIZE && offset == 0)
+    {
+      dirtyRanges.clear();
+    }
+    return cfxDevice.getMemoryAllocator(currentDeviceIndex).flush(memory, offset, size);
   }
 
   /**
@@ -146,12 +236,7 @@ namespace cfx
    */
   VkResult CFXBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
   {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkInvalidateMappedMemoryRanges(cfxDevice.device(currentDeviceIndex), 1, &mappedRange);
+    return cfxDevice.getMemoryAllocator(currentDeviceIndex).invalidate(memory, offset, size);
   }
 
   /**
@@ -16,6 +16,15 @@ namespace cfx
         VkMemoryPropertyFlags memoryPropertyFlags,
         int deviceIndex,
         VkDeviceSize minOffsetAlignment = 1);
+    CFXBuffer(
+        CFXDevice &device,
+        VkDeviceSize instanceSize,
+        uint32_t instanceCount,
+        VkBufferUsageFlags usageFlags,
+        VkMemoryPropertyFlags memoryPropertyFlags,
+        CFXMemoryTypeTable::Usage memoryUsage,
+        int deviceIndex,
+        VkDeviceSize minOffsetAlignment = 1);
     ~CFXBuffer();
 
     CFXBuffer(const CFXBuffer &) = delete;
@@ -25,6 +34,10 @@ namespace cfx
     void unmap();
 
     void writeToBuffer(void *data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+    // Records a range written through getMappedMemory(), writeToBuffer() records its own
+    void markDirty(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+    // Flushes every range written since the last flush with one call
+    VkResult flushDirty();
     VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
     VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
     VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
@@ -44,12 +57,17 @@ namespace cfx
     VkDeviceSize getBufferSize() const { return bufferSize; }
 
   private:
+    // Beyond this many disjoint ranges the dirty ranges collapse into one
+    static constexpr size_t MAX_DIRTY_RANGES = 16;
+
     static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
 
     CFXDevice &cfxDevice;
     void *mapped = nullptr;
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    CFXMemoryAllocator::Allocation memory{};
+    // sorted, disjoint and not touching
+    std::vector<CFXMemoryAllocator::Range> dirtyRanges;
     int currentDeviceIndex;
 
     VkDeviceSize bufferSize;
@@ -49,6 +49,7 @@ namespace cfx
     viewMatrix[3][0] = -glm::dot(u, position);
     viewMatrix[3][1] = -glm::dot(v, position);
     viewMatrix[3][2] = -glm::dot(w, position);
+    this->position = position;
   }
 
   void CFXCamera::setViewTarget(glm::vec3 position, glm::vec3 target, glm::vec3 up)
@@ -80,5 +81,6 @@ namespace cfx
     viewMatrix[3][0] = -glm::dot(u, position);
     viewMatrix[3][1] = -glm::dot(v, position);
     viewMatrix[3][2] = -glm::dot(w, position);
+    this->position = position;
   }
 } // namespace cfx
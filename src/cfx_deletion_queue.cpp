@@ -0,0 +1,125 @@
+#include "cfx_deletion_queue.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace cfx
+{
+    CFXDeletionQueue::CFXDeletionQueue(VkDevice device) : device{device}
+    {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create deletion queue timeline semaphore!");
+        }
+    }
+
+    CFXDeletionQueue::~CFXDeletionQueue()
+    {
+        flush();
+        vkDestroySemaphore(device, timeline, nullptr);
+    }
+
+    uint64_t CFXDeletionQueue::advance()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return ++submitted;
+    }
+
+    uint64_t CFXDeletionQueue::getPendingValue() const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return submitted + 1;
+    }
+
+    uint64_t CFXDeletionQueue::queryCompleted()
+    {
+        uint64_t value = 0;
+        if (vkGetSemaphoreCounterValue(device, timeline, &value) == VK_SUCCESS)
+        {
+            completed = std::max(completed, value);
+        }
+        return completed;
+    }
+
+    bool CFXDeletionQueue::isComplete(uint64_t value)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return value <= completed || value <= queryCompleted();
+    }
+
+    void CFXDeletionQueue::defer(std::function<void()> destroy)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        entries.push_back(Entry{submitted + 1, std::move(destroy)});
+    }
+
+    void CFXDeletionQueue::collect()
+    {
+        std::vector<std::function<void()>> due;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (entries.empty())
+            {
+                return;
+            }
+            uint64_t value = queryCompleted();
+            while (!entries.empty() && entries.front().value <= value)
+            {
+                due.push_back(std::move(entries.front().destroy));
+                entries.pop_front();
+            }
+        }
+        // outside the lock, a callback may release something that defers again
+        for (auto &destroy : due)
+        {
+            destroy();
+        }
+    }
+
+    void CFXDeletionQueue::flush()
+    {
+        uint64_t value;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            value = submitted;
+        }
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+
+        while (true)
+        {
+            std::deque<Entry> due;
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                completed = std::max(completed, value);
+                if (entries.empty())
+                {
+                    return;
+                }
+                due.swap(entries);
+            }
+            for (auto &entry : due)
+            {
+                entry.destroy();
+            }
+        }
+    }
+
+    size_t CFXDeletionQueue::pendingCount() const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return entries.size();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Destroys Vulkan objects once the GPU is done with them, one per device.
+     *
+     * Every frame submit on the device's graphics queue signals the queue's timeline
+     * semaphore with the next value from advance(). defer() tags a destroy callback with
+     * the value of the submit that follows, the one the frame currently being recorded will
+     * make, since that frame may still reference the object. collect() runs the callbacks
+     * whose value the timeline has reached, so releasing a buffer, pipeline or swapchain
+     * never needs the device to go idle.
+     *
+     * Submits on other queues do not signal the timeline, whoever makes them keeps what
+     * they use alive until their own fences say otherwise.
+     */
+    class CFXDeletionQueue
+    {
+    public:
+        CFXDeletionQueue(VkDevice device);
+        // Waits for the last submit and runs everything still queued
+        ~CFXDeletionQueue();
+        CFXDeletionQueue(const CFXDeletionQueue &) = delete;
+        CFXDeletionQueue &operator=(const CFXDeletionQueue &) = delete;
+
+        VkSemaphore getTimeline() const { return timeline; }
+        // The value to signal on the timeline with the submit about to be made
+        uint64_t advance();
+        // The value the next submit will signal, anything used by the frame being recorded is safe after it
+        uint64_t getPendingValue() const;
+        bool isComplete(uint64_t value);
+
+        void defer(std::function<void()> destroy);
+        // Runs the callbacks that are due without blocking, call it once per frame
+        void collect();
+        // Waits for the last submit, then runs every callback
+        void flush();
+        size_t pendingCount() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t value;
+            std::function<void()> destroy;
+        };
+
+        // Reads the timeline, caller holds the lock
+        uint64_t queryCompleted();
+
+        VkDevice device;
+        VkSemaphore timeline = VK_NULL_HANDLE;
+
+        mutable std::mutex mutex;
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        // tagged in submit order, so due entries are always at the front
+        std::deque<Entry> entries;
+    };
+}
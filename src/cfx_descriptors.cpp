@@ -119,7 +119,10 @@ namespace cfx
 
   CFXDescriptorPool::~CFXDescriptorPool()
   {
-    vkDestroyDescriptorPool(cfxDevice.device(poolDeviceIndex), descriptorPool, nullptr);
+    // sets allocated from it may still be bound by frames in flight
+    VkDevice device = cfxDevice.device(poolDeviceIndex);
+    cfxDevice.getDeletionQueue(poolDeviceIndex).defer([device, pool = descriptorPool]
+                                                      { vkDestroyDescriptorPool(device, pool, nullptr); });
   }
 
   bool CFXDescriptorPool::allocateDescriptorSet(
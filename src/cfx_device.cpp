@@ -67,9 +67,17 @@ namespace cfx
   CFXDevice::~CFXDevice()
   {
 
+    // runs the destroys still waiting on frames before any device goes, a swapchain released
+    // on every device is only destroyed by the last queue to let go of it
+    for (auto &deletionQueue : deletionQueues)
+    {
+      deletionQueue.reset();
+    }
     for (int deviceIndex = 0; deviceIndex < devices_.size(); deviceIndex++)
     {
       vkDestroyCommandPool(devices_[deviceIndex], commandPools[deviceIndex], nullptr);
+      vkDestroyCommandPool(devices_[deviceIndex], transferCommandPools[deviceIndex], nullptr);
+      memoryAllocators[deviceIndex].reset();
       vkDestroyDevice(devices_[deviceIndex], nullptr);
     }
 
@@ -163,6 +171,9 @@ namespace cfx
           presentQueues.resize(deviceCount);
           properties.resize(deviceCount);
           commandPools.resize(deviceCount);
+          transferQueues.resize(deviceCount);
+          transferCommandPools.resize(deviceCount);
+          enabledFeatures.resize(deviceCount);
           tempDevice = device;
           deviceNames[0] = tempProperties.deviceName;
 
@@ -186,6 +197,9 @@ namespace cfx
       presentQueues.resize(deviceCount);
       properties.resize(deviceCount);
       commandPools.resize(deviceCount);
+      transferQueues.resize(deviceCount);
+      transferCommandPools.resize(deviceCount);
+      enabledFeatures.resize(deviceCount);
       vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
       std::vector<VkPhysicalDeviceFeatures> physicalFeatures(deviceCount);
       std::vector<VkPhysicalDeviceFeatures2> physicalFeatures2(deviceCount);
@@ -212,15 +226,20 @@ namespace cfx
   void CFXDevice::createLogicalDevice()
   {
     // std::cout<< "CREATING LOGICAL DEVICES " << std::endl;
+    memoryAllocators.resize(deviceCount);
+    deletionQueues.resize(deviceCount);
+    deviceQueueFamilies.resize(deviceCount);
     for (int i = 0; i < deviceCount; i++)
     {
 
       // std::cout<< "CREATING LOGICAL DEVICES " << i << std::endl;
 
-      QueueFamilyIndices indices = findQueueFamilies(physicalDevices, i);
+      // the surface support queries behind this are not cheap, every later lookup reads the cache
+      deviceQueueFamilies[i] = findQueueFamilies(physicalDevices, i);
+      QueueFamilyIndices indices = deviceQueueFamilies[i];
 
       std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-      std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+      std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, indices.transferFamily};
 
       float queuePriority = 1.0f;
       for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -234,8 +253,23 @@ namespace cfx
         queueCreateInfos.push_back(queueCreateInfo);
       }
 
+      VkPhysicalDeviceTimelineSemaphoreFeatures supportedTimeline = {};
+      supportedTimeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+      VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+      supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      supportedFeatures2.pNext = &supportedTimeline;
+      vkGetPhysicalDeviceFeatures2(physicalDevices[i], &supportedFeatures2);
+      const VkPhysicalDeviceFeatures &supportedFeatures = supportedFeatures2.features;
+      // frame submits signal a timeline that deferred destruction waits on, there is no fallback
+      if (!supportedTimeline.timelineSemaphore)
+      {
+        throw std::runtime_error("timeline semaphores required, not supported by " + deviceNames[i] + "!");
+      }
       VkPhysicalDeviceFeatures deviceFeatures = {};
       deviceFeatures.samplerAnisotropy = VK_TRUE;
+      // one indirect draw call per model for the culled meshlets, else one per meshlet
+      deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+      enabledFeatures[i] = deviceFeatures;
 
       VkDeviceCreateInfo createInfo = {};
       createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -244,8 +278,19 @@ namespace cfx
       createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
       createInfo.pEnabledFeatures = &deviceFeatures;
-      createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-      createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+      timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+      timelineFeatures.timelineSemaphore = VK_TRUE;
+      createInfo.pNext = &timelineFeatures;
+      // budgets let the allocator fall back to other heaps before the driver starts paging
+      std::vector<const char *> extensions = deviceExtensions;
+      bool memoryBudgetSupported = hasDeviceExtension(physicalDevices[i], VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      if (memoryBudgetSupported)
+      {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      }
+      createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+      createInfo.ppEnabledExtensionNames = extensions.data();
 
       // might not really be necessary anymore because device specific validation layers
       // have been deprecated
@@ -266,7 +311,10 @@ namespace cfx
 
       vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueues[i]);
       vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueues[i]);
+      vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueues[i]);
       devices_[i] = device_;
+      memoryAllocators[i] = std::make_unique<CFXMemoryAllocator>(physicalDevices[i], device_, memoryBudgetSupported);
+      deletionQueues[i] = std::make_unique<CFXDeletionQueue>(device_);
       createCommandPool(i);
       // std::cout<< "LOGICAL DEVICE CREATED " << i << std::endl;
     }
@@ -286,6 +334,12 @@ namespace cfx
     {
       throw std::runtime_error("failed to create command pool!");
     }
+
+    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+    if (vkCreateCommandPool(devices_[deviceIndex], &poolInfo, nullptr, &transferCommandPools[deviceIndex]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("failed to create transfer command pool!");
+    }
   }
 
   void CFXDevice::createSurface()
@@ -421,6 +475,24 @@ namespace cfx
     return requiredExtensions.empty();
   }
 
+  bool CFXDevice::hasDeviceExtension(VkPhysicalDevice device, const char *extensionName)
+  {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto &extension : availableExtensions)
+    {
+      if (strcmp(extension.extensionName, extensionName) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
   QueueFamilyIndices CFXDevice::findQueueFamilies(std::vector<VkPhysicalDevice> devices, int deviceIndex)
   {
 
@@ -437,6 +509,7 @@ namespace cfx
       if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
       {
         indices.graphicsFamily = j;
+        indices.graphicsTimestampValidBits = queueFamily.timestampValidBits;
         indices.graphicsFamilyHasValue = true;
       }
       VkBool32 presentSupport = false;
@@ -454,6 +527,31 @@ namespace cfx
       j++;
     }
 
+    // prefer a transfer-only family (the copy engines), then any other non-graphics family
+    for (uint32_t k = 0; k < queueFamilyCount && !indices.transferFamilyHasValue; k++)
+    {
+      VkQueueFlags flags = queueFamilies[k].queueFlags;
+      if (queueFamilies[k].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+      {
+        indices.transferFamily = k;
+        indices.transferFamilyHasValue = true;
+      }
+    }
+    for (uint32_t k = 0; k < queueFamilyCount && !indices.transferFamilyHasValue; k++)
+    {
+      VkQueueFlags flags = queueFamilies[k].queueFlags;
+      if (queueFamilies[k].queueCount > 0 && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+      {
+        indices.transferFamily = k;
+        indices.transferFamilyHasValue = true;
+      }
+    }
+    if (!indices.transferFamilyHasValue && indices.graphicsFamilyHasValue)
+    {
+      indices.transferFamily = indices.graphicsFamily;
+      indices.transferFamilyHasValue = true;
+    }
+
     return indices;
   }
 
@@ -510,31 +608,32 @@ namespace cfx
 
   uint32_t CFXDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, int deviceIndex)
   {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevices[deviceIndex], &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    const CFXMemoryTypeTable &memoryTypes = memoryAllocators[deviceIndex]->getMemoryTypes();
+    uint32_t memoryType = memoryTypes.find(typeFilter, CFXMemoryTypeTable::usageFor(properties), properties);
+    if (memoryType == UINT32_MAX)
     {
-      if ((typeFilter & (1 << i)) &&
-          (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-      {
-        VkPeerMemoryFeatureFlags memoryFlags{};
-        vkGetDeviceGroupPeerMemoryFeatures(devices_[deviceIndex], i, deviceIndex != 0 ? deviceIndices[deviceIndex - 1] : deviceIndices[deviceIndex], deviceIndex == 0 ? deviceIndices[deviceIndex + 1] : deviceIndices[deviceIndex], &memoryFlags);
-        memProperties.memoryHeaps[i].flags = memoryFlags;
-
-        return i;
-      }
+      throw std::runtime_error("failed to find suitable memory type!");
     }
+    return memoryType;
+  }
 
-    throw std::runtime_error("failed to find suitable memory type!");
+  void CFXDevice::createBuffer(
+      VkDeviceSize size,
+      VkBufferUsageFlags usage,
+      VkMemoryPropertyFlags properties,
+      VkBuffer &buffer,
+      CFXMemoryAllocator::Allocation &bufferMemory, int deviceIndex)
+  {
+    createBuffer(size, usage, properties, CFXMemoryTypeTable::usageFor(properties, usage), buffer, bufferMemory, deviceIndex);
   }
 
   void CFXDevice::createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
+      CFXMemoryTypeTable::Usage memoryUsage,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory, int deviceIndex)
+      CFXMemoryAllocator::Allocation &bufferMemory, int deviceIndex)
   {
 
     std::vector<VkBindBufferMemoryInfo> bufferMemoryInfos{};
@@ -549,24 +648,33 @@ namespace cfx
       throw std::runtime_error("failed to create vertex buffer!");
     }
 
-    VkMemoryRequirements memRequirements{};
-    vkGetBufferMemoryRequirements(devices_[deviceIndex], buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties, deviceIndex);
-
-    if (vkAllocateMemory(devices_[deviceIndex], &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-    {
-      throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 memRequirements{};
+    memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memRequirements.pNext = &dedicatedRequirements;
+    VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = buffer;
+    vkGetBufferMemoryRequirements2(devices_[deviceIndex], &requirementsInfo, &memRequirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+
+    bufferMemory = memoryAllocators[deviceIndex]->allocate(
+        memRequirements.memoryRequirements,
+        memoryUsage,
+        properties,
+        CFXMemoryAllocator::ResourceKind::Linear,
+        &dedicatedInfo,
+        dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation);
 
     VkBindBufferMemoryInfo memoryInfo{};
     memoryInfo.sType = VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO;
     memoryInfo.buffer = buffer;
-    memoryInfo.memory = bufferMemory;
-    memoryInfo.memoryOffset = 0;
+    memoryInfo.memory = bufferMemory.memory;
+    memoryInfo.memoryOffset = bufferMemory.offset;
 
     bufferMemoryInfos.push_back(memoryInfo);
     if (vkBindBufferMemory2(devices_[deviceIndex], 1, bufferMemoryInfos.data()) != VK_SUCCESS)
@@ -615,25 +723,82 @@ namespace cfx
     vkFreeCommandBuffers(devices_[deviceIndex], commandPools[deviceIndex], 1, &commandBuffer);
   }
 
-  void CFXDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, int deviceIndex)
+  VkCommandBuffer CFXDevice::beginTransferCommands(int deviceIndex)
+  {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = transferCommandPools[deviceIndex];
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(devices_[deviceIndex], &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    return commandBuffer;
+  }
+
+  void CFXDevice::endTransferCommands(VkCommandBuffer commandBuffer, int deviceIndex)
   {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(deviceIndex);
-    //  for(VkCommandBuffer commandBuffer: commandBuffers){
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkQueueSubmit(transferQueues[deviceIndex], 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(transferQueues[deviceIndex]);
 
-    //  }
+    vkFreeCommandBuffers(devices_[deviceIndex], transferCommandPools[deviceIndex], 1, &commandBuffer);
+  }
+
+  void CFXDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, int deviceIndex, VkDeviceSize dstOffset)
+  {
+    QueueFamilyIndices indices = findPhysicalQueueFamilies(deviceIndex);
+    VkCommandBuffer commandBuffer = beginTransferCommands(deviceIndex);
     VkBufferCopy copyRegion{};
     copyRegion.srcOffset = 0; // Optional
-    copyRegion.dstOffset = 0; // Optional
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
+    if (!indices.hasDedicatedTransfer())
+    {
+      endTransferCommands(commandBuffer, deviceIndex);
+      return;
+    }
+
+    // hand the range over to the graphics family: release on the transfer queue, acquire on graphics
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = indices.transferFamily;
+    barrier.dstQueueFamilyIndex = indices.graphicsFamily;
+    barrier.buffer = dstBuffer;
+    barrier.offset = dstOffset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+    endTransferCommands(commandBuffer, deviceIndex);
+
+    commandBuffer = beginSingleTimeCommands(deviceIndex);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
     endSingleTimeCommands(commandBuffer, deviceIndex);
   }
 
   void CFXDevice::copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount, int deviceIndex)
   {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(deviceIndex);
+    QueueFamilyIndices indices = findPhysicalQueueFamilies(deviceIndex);
+    VkCommandBuffer commandBuffer = beginTransferCommands(deviceIndex);
 
     VkBufferImageCopy region{};
     region.bufferOffset = 0;
@@ -655,6 +820,36 @@ namespace cfx
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
         &region);
+
+    if (!indices.hasDedicatedTransfer())
+    {
+      endTransferCommands(commandBuffer, deviceIndex);
+      return;
+    }
+
+    // the layout stays TRANSFER_DST_OPTIMAL, the caller transitions it on the graphics queue
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = indices.transferFamily;
+    barrier.dstQueueFamilyIndex = indices.graphicsFamily;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = layerCount;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+    endTransferCommands(commandBuffer, deviceIndex);
+
+    commandBuffer = beginSingleTimeCommands(deviceIndex);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
     endSingleTimeCommands(commandBuffer, deviceIndex);
   }
 
@@ -662,30 +857,36 @@ namespace cfx
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory, int deviceIndex)
+      CFXMemoryAllocator::Allocation &imageMemory, int deviceIndex)
   {
     if (vkCreateImage(devices_[deviceIndex], &imageInfo, nullptr, &image) != VK_SUCCESS)
     {
       throw std::runtime_error("failed to create image!");
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(devices_[deviceIndex], image, &memRequirements);
-    VkMemoryAllocateFlagsInfo allocFlagsInfo{};
-    allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-    allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_MASK_BIT;
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties, deviceIndex);
-
-    if (vkAllocateMemory(devices_[deviceIndex], &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-    {
-      throw std::runtime_error("failed to allocate image memory!");
-    }
-
-    if (vkBindImageMemory(devices_[deviceIndex], image, imageMemory, 0) != VK_SUCCESS)
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 memRequirements{};
+    memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memRequirements.pNext = &dedicatedRequirements;
+    VkImageMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = image;
+    vkGetImageMemoryRequirements2(devices_[deviceIndex], &requirementsInfo, &memRequirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = image;
+
+    imageMemory = memoryAllocators[deviceIndex]->allocate(
+        memRequirements.memoryRequirements,
+        CFXMemoryTypeTable::usageFor(properties),
+        properties,
+        imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? CFXMemoryAllocator::ResourceKind::Optimal : CFXMemoryAllocator::ResourceKind::Linear,
+        &dedicatedInfo,
+        dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation);
+
+    if (vkBindImageMemory(devices_[deviceIndex], image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS)
     {
       throw std::runtime_error("failed to bind image memory!");
     }
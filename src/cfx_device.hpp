@@ -1,8 +1,11 @@
 #pragma once
 
+#include "cfx_deletion_queue.hpp"
+#include "cfx_memory_allocator.hpp"
 #include "cfx_window.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,10 +24,14 @@ namespace cfx
     uint32_t graphicsFamily;
     uint32_t presentFamily;
     uint32_t transferFamily;
+    // valid bits of the graphics queue's timestamps, 0 when it cannot write any
+    uint32_t graphicsTimestampValidBits = 0;
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
     bool transferFamilyHasValue = false;
     bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue && transferFamilyHasValue; }
+    // transferFamily falls back to graphicsFamily on hardware without a separate copy queue
+    bool hasDedicatedTransfer() { return transferFamily != graphicsFamily; }
   };
 
   class CFXDevice
@@ -46,13 +53,17 @@ namespace cfx
     CFXDevice &operator=(CFXDevice &&) = delete;
 
     VkCommandPool getCommandPool(int deviceIndex) { return commandPools[deviceIndex]; }
+    VkCommandPool getTransferCommandPool(int deviceIndex) { return transferCommandPools[deviceIndex]; }
     VkDevice device(int deviceIndex) { return devices_[deviceIndex]; }
     std::vector<VkPhysicalDevice> getPhysicalDevices() { return physicalDevices; }
     std::vector<VkRect2D> getDeviceRects() { return deviceRects; }
     VkSurfaceKHR surface() { return surface_; }
     VkQueue getGraphicsQueues(int deviceIndex) { return graphicsQueues[deviceIndex]; }
     VkQueue getPresentQueues(int deviceIndex) { return presentQueues[deviceIndex]; }
+    VkQueue getTransferQueues(int deviceIndex) { return transferQueues[deviceIndex]; }
     int getDevicesinDeviceGroup() { return deviceCount; }
+    // Optional features are only enabled where the physical device supports them
+    const VkPhysicalDeviceFeatures &getEnabledFeatures(int deviceIndex) const { return enabledFeatures[deviceIndex]; }
     VkInstance getInstance() { return instance; }
     std::string getDeviceName(int deviceIndex)
     {
@@ -73,20 +84,32 @@ namespace cfx
 
     SwapChainSupportDetails getSwapChainSupport(int deviceIndex) { return querySwapChainSupport(physicalDevices[deviceIndex]); }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, int deviceIndex);
-    QueueFamilyIndices findPhysicalQueueFamilies(int deviceIndex) { return findQueueFamilies(physicalDevices, deviceIndex); }
+    // Looked up once when the logical device is created
+    QueueFamilyIndices findPhysicalQueueFamilies(int deviceIndex) { return deviceQueueFamilies[deviceIndex]; }
     VkFormat findSupportedFormat(
         const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     // Buffer Helper Functions
+    // Memory comes from the device's allocator, release it with getMemoryAllocator(deviceIndex).free()
     void createBuffer(
         VkDeviceSize size,
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer &buffer,
-        VkDeviceMemory &bufferMemory, int deviceIndex);
+        CFXMemoryAllocator::Allocation &bufferMemory, int deviceIndex);
+    // Picks the memory type for memoryUsage instead of guessing it from properties and usage
+    void createBuffer(
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        CFXMemoryTypeTable::Usage memoryUsage,
+        VkBuffer &buffer,
+        CFXMemoryAllocator::Allocation &bufferMemory, int deviceIndex);
     VkCommandBuffer beginSingleTimeCommands(int deviceIndex);
     void endSingleTimeCommands(VkCommandBuffer commandBuffer, int deviceIndex);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, int deviceIndex);
+    VkCommandBuffer beginTransferCommands(int deviceIndex);
+    void endTransferCommands(VkCommandBuffer commandBuffer, int deviceIndex);
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, int deviceIndex, VkDeviceSize dstOffset = 0);
     void copyBufferToImage(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount, int deviceIndex);
 
@@ -94,7 +117,10 @@ namespace cfx
         const VkImageCreateInfo &imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage &image,
-        VkDeviceMemory &imageMemory, int deviceIndex);
+        CFXMemoryAllocator::Allocation &imageMemory, int deviceIndex);
+    CFXMemoryAllocator &getMemoryAllocator(int deviceIndex) { return *memoryAllocators[deviceIndex]; }
+    // Release objects a frame may still use through this instead of destroying them on the spot
+    CFXDeletionQueue &getDeletionQueue(int deviceIndex) { return *deletionQueues[deviceIndex]; }
 
     std::vector<VkPhysicalDeviceProperties> properties;
 
@@ -112,6 +138,7 @@ namespace cfx
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
     void hasGflwRequiredInstanceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool hasDeviceExtension(VkPhysicalDevice device, const char *extensionName);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     VkInstance instance;
@@ -119,6 +146,7 @@ namespace cfx
     std::vector<VkPhysicalDevice> physicalDevices;
     CFXWindow &window;
     std::vector<VkCommandPool> commandPools;
+    std::vector<VkCommandPool> transferCommandPools;
     uint32_t deviceGroupCount = 0;
     std::vector<VkPhysicalDeviceGroupProperties> physicalDeviceGroupProperties;
 
@@ -129,6 +157,10 @@ namespace cfx
     std::vector<VkQueue> graphicsQueues;
     std::vector<VkQueue> presentQueues;
     std::vector<VkQueue> transferQueues;
+    std::vector<QueueFamilyIndices> deviceQueueFamilies;
+    std::vector<VkPhysicalDeviceFeatures> enabledFeatures;
+    std::vector<std::unique_ptr<CFXMemoryAllocator>> memoryAllocators;
+    std::vector<std::unique_ptr<CFXDeletionQueue>> deletionQueues;
     // VkQueue graphicsQueue;
     // VkQueue presentQueue;
     // VkQueue transferQueue;
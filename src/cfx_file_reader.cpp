@@ -0,0 +1,509 @@
+#include "cfx_file_reader.hpp"
+#include "cfx_asset_archive.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define CFX_HAS_IO_URING 1
+#endif
+#endif
+
+namespace cfx
+{
+    // user_data of the no-op that wakes the completion thread for shutdown
+    static constexpr uint64_t WAKE_USER_DATA = UINT64_MAX;
+
+    /*
+     * Page-aligned read buffers in power of two size classes. Released buffers are kept for
+     * the next read of a similar size, a few per class; very large ones go straight back.
+     */
+    struct CFXFileReader::BufferPool
+    {
+        static constexpr uint32_t MIN_SIZE_CLASS = 16;
+        static constexpr uint32_t MAX_POOLED_SIZE_CLASS = 28;
+        static constexpr size_t MAX_FREE_PER_CLASS = 4;
+
+        std::mutex mutex;
+        std::vector<std::vector<uint8_t *>> freeLists{MAX_POOLED_SIZE_CLASS + 1};
+
+        ~BufferPool()
+        {
+            for (auto &freeList : freeLists)
+            {
+                for (uint8_t *buffer : freeList)
+                {
+                    free(buffer);
+                }
+            }
+        }
+
+        static uint32_t sizeClassFor(size_t size)
+        {
+            uint32_t sizeClass = MIN_SIZE_CLASS;
+            while (sizeClass < 63 && (size_t(1) << sizeClass) < size)
+            {
+                sizeClass++;
+            }
+            return sizeClass;
+        }
+
+        uint8_t *acquire(uint32_t sizeClass, size_t size)
+        {
+            if (sizeClass <= MAX_POOLED_SIZE_CLASS)
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                if (!freeLists[sizeClass].empty())
+                {
+                    uint8_t *buffer = freeLists[sizeClass].back();
+                    freeLists[sizeClass].pop_back();
+                    return buffer;
+                }
+            }
+            size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t capacity = sizeClass <= MAX_POOLED_SIZE_CLASS ? size_t(1) << sizeClass : (size + pageSize - 1) & ~(pageSize - 1);
+            void *buffer = nullptr;
+            if (posix_memalign(&buffer, pageSize, capacity) != 0)
+            {
+                return nullptr;
+            }
+            return static_cast<uint8_t *>(buffer);
+        }
+
+        void release(uint8_t *buffer, uint32_t sizeClass)
+        {
+            if (sizeClass <= MAX_POOLED_SIZE_CLASS)
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                if (freeLists[sizeClass].size() < MAX_FREE_PER_CLASS)
+                {
+                    freeLists[sizeClass].push_back(buffer);
+                    return;
+                }
+            }
+            free(buffer);
+        }
+    };
+
+    CFXFileReader::CFXFileReader(bool useIoUring) : bufferPool{std::make_shared<BufferPool>()}
+    {
+        if (useIoUring && setupRing())
+        {
+            completionThread = std::thread(&CFXFileReader::completionLoop, this);
+            return;
+        }
+        for (uint32_t i = 0; i < FALLBACK_THREAD_COUNT; i++)
+        {
+            fallbackThreads.emplace_back(&CFXFileReader::fallbackLoop, this);
+        }
+    }
+
+    CFXFileReader::~CFXFileReader()
+    {
+        // both paths drain what was already queued before they stop
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+#ifdef CFX_HAS_IO_URING
+            if (ringFd >= 0)
+            {
+                uint32_t tail = *ring.sqTail;
+                uint32_t index = tail & ring.sqMask;
+                io_uring_sqe *sqe = static_cast<io_uring_sqe *>(ring.sqes) + index;
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = WAKE_USER_DATA;
+                ring.sqArray[index] = index;
+                __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+                while (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR)
+                {
+                }
+            }
+#endif
+        }
+        chunkAvailable.notify_all();
+        if (completionThread.joinable())
+        {
+            completionThread.join();
+        }
+        for (auto &thread : fallbackThreads)
+        {
+            thread.join();
+        }
+        destroyRing();
+    }
+
+    CFXFileReader &CFXFileReader::shared()
+    {
+        static CFXFileReader reader{};
+        return reader;
+    }
+
+    bool CFXFileReader::setupRing()
+    {
+#ifdef CFX_HAS_IO_URING
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        if (fd < 0)
+        {
+            return false;
+        }
+        // IORING_OP_READ arrived in the same kernel as this feature bit
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+        {
+            close(fd);
+            return false;
+        }
+        ring.sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        ring.cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping)
+        {
+            ring.sqMappingSize = ring.cqMappingSize = std::max(ring.sqMappingSize, ring.cqMappingSize);
+        }
+        void *sqMapping = mmap(nullptr, ring.sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        void *cqMapping = singleMapping ? sqMapping
+                                        : mmap(nullptr, ring.cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        ring.sqMapping = sqMapping == MAP_FAILED ? nullptr : sqMapping;
+        ring.cqMapping = cqMapping == MAP_FAILED ? nullptr : cqMapping;
+        ring.sqes = sqes == MAP_FAILED ? nullptr : sqes;
+        ringFd = fd;
+        if (ring.sqMapping == nullptr || ring.cqMapping == nullptr || ring.sqes == nullptr)
+        {
+            destroyRing();
+            return false;
+        }
+
+        uint8_t *sq = static_cast<uint8_t *>(ring.sqMapping);
+        uint8_t *cq = static_cast<uint8_t *>(ring.cqMapping);
+        ring.sqHead = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+        ring.sqTail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        ring.sqMask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        ring.sqArray = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+        ring.cqHead = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        ring.cqTail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+        ring.cqMask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+        ring.cqes = cq + params.cq_off.cqes;
+
+        // one read per SQ entry at most, so completions never overflow the CQ ring
+        inFlight.resize(params.sq_entries);
+        for (uint32_t slot = params.sq_entries; slot > 0; slot--)
+        {
+            freeSlots.push_back(slot - 1);
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void CFXFileReader::destroyRing()
+    {
+        if (ringFd < 0)
+        {
+            return;
+        }
+        if (ring.sqes != nullptr)
+        {
+            munmap(ring.sqes, ring.sqesSize);
+        }
+        if (ring.cqMapping != nullptr && ring.cqMapping != ring.sqMapping)
+        {
+            munmap(ring.cqMapping, ring.cqMappingSize);
+        }
+        if (ring.sqMapping != nullptr)
+        {
+            munmap(ring.sqMapping, ring.sqMappingSize);
+        }
+        ring = Ring{};
+        close(ringFd);
+        ringFd = -1;
+    }
+
+    void CFXFileReader::enqueue(const std::string &filepath, Callback callback, std::vector<std::shared_ptr<Request>> &completed)
+    {
+        auto request = std::make_shared<Request>();
+        request->filepath = filepath;
+        request->callback = std::move(callback);
+
+        if (const std::shared_ptr<CFXAssetArchive> &archive = CFXAssetArchive::mounted())
+        {
+            if (const CFXAssetArchive::Entry *entry = archive->find(filepath))
+            {
+                try
+                {
+                    request->file = archive->read(*entry);
+                }
+                catch (const std::exception &e)
+                {
+                    request->error = e.what();
+                }
+                completed.push_back(request);
+                return;
+            }
+        }
+
+        request->fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat fileStat{};
+        if (request->fd < 0 || fstat(request->fd, &fileStat) != 0)
+        {
+            request->error = strerror(errno);
+            completed.push_back(request);
+            return;
+        }
+        size_t size = static_cast<size_t>(fileStat.st_size);
+        if (size == 0)
+        {
+            request->file = CFXMappedFile::fromBuffer({});
+            completed.push_back(request);
+            return;
+        }
+
+        uint32_t sizeClass = BufferPool::sizeClassFor(size);
+        request->data = bufferPool->acquire(sizeClass, size);
+        if (request->data == nullptr)
+        {
+            request->error = "out of memory";
+            completed.push_back(request);
+            return;
+        }
+        std::shared_ptr<BufferPool> pool = bufferPool;
+        std::shared_ptr<uint8_t> buffer{request->data, [pool, sizeClass](uint8_t *data)
+                                        { pool->release(data, sizeClass); }};
+        request->file = CFXMappedFile::view(buffer, request->data, size);
+
+        request->chunksLeft = static_cast<uint32_t>((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        std::lock_guard<std::mutex> lock{mutex};
+        for (uint64_t offset = 0; offset < size; offset += CHUNK_SIZE)
+        {
+            pending.push_back(Chunk{request, offset, static_cast<uint32_t>(std::min<uint64_t>(CHUNK_SIZE, size - offset))});
+        }
+    }
+
+    void CFXFileReader::submitPending()
+    {
+#ifdef CFX_HAS_IO_URING
+        uint32_t tail = *ring.sqTail;
+        uint32_t submitted = 0;
+        while (!pending.empty() && !freeSlots.empty())
+        {
+            uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            inFlight[slot] = std::move(pending.front());
+            pending.pop_front();
+            const Chunk &chunk = inFlight[slot];
+
+            uint32_t index = tail & ring.sqMask;
+            io_uring_sqe *sqe = static_cast<io_uring_sqe *>(ring.sqes) + index;
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = chunk.request->fd;
+            sqe->addr = reinterpret_cast<uint64_t>(chunk.request->data + chunk.offset);
+            sqe->len = chunk.length;
+            sqe->off = chunk.offset;
+            sqe->user_data = slot;
+            ring.sqArray[index] = index;
+            tail++;
+            submitted++;
+        }
+        if (submitted == 0)
+        {
+            return;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, ringFd, submitted, 0, 0, nullptr, 0) < 0 && errno == EINTR)
+        {
+        }
+#endif
+    }
+
+    void CFXFileReader::completionLoop()
+    {
+#ifdef CFX_HAS_IO_URING
+        io_uring_cqe *cqes = static_cast<io_uring_cqe *>(ring.cqes);
+        while (true)
+        {
+            if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            {
+                return;
+            }
+            std::vector<std::shared_ptr<Request>> completed;
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                uint32_t head = *ring.cqHead;
+                uint32_t tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++)
+                {
+                    const io_uring_cqe &cqe = cqes[head & ring.cqMask];
+                    if (cqe.user_data == WAKE_USER_DATA)
+                    {
+                        continue;
+                    }
+                    uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+                    Chunk chunk = std::move(inFlight[slot]);
+                    freeSlots.push_back(slot);
+                    finishChunk(chunk, cqe.res, completed);
+                }
+                __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+                submitPending();
+                done = stopping && pending.empty() && freeSlots.size() == inFlight.size();
+            }
+            for (auto &request : completed)
+            {
+                complete(request);
+            }
+            if (done)
+            {
+                return;
+            }
+        }
+#endif
+    }
+
+    void CFXFileReader::fallbackLoop()
+    {
+        while (true)
+        {
+            Chunk chunk;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                chunkAvailable.wait(lock, [this]
+                                    { return stopping || !pending.empty(); });
+                if (pending.empty())
+                {
+                    return;
+                }
+                chunk = std::move(pending.front());
+                pending.pop_front();
+            }
+
+            ssize_t bytesRead = pread(chunk.request->fd, chunk.request->data + chunk.offset, chunk.length, static_cast<off_t>(chunk.offset));
+            std::vector<std::shared_ptr<Request>> completed;
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                finishChunk(chunk, bytesRead < 0 ? -errno : bytesRead, completed);
+            }
+            // a short read queued its remainder
+            chunkAvailable.notify_one();
+            for (auto &request : completed)
+            {
+                complete(request);
+            }
+        }
+    }
+
+    void CFXFileReader::finishChunk(Chunk &chunk, int64_t result, std::vector<std::shared_ptr<Request>> &completed)
+    {
+        Request &request = *chunk.request;
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            pending.push_front(std::move(chunk));
+            return;
+        }
+        if (result < 0)
+        {
+            request.error = strerror(static_cast<int>(-result));
+        }
+        else if (result == 0)
+        {
+            request.error = "file shrank while it was read";
+        }
+        else if (static_cast<uint64_t>(result) < chunk.length)
+        {
+            pending.push_front(Chunk{chunk.request, chunk.offset + result, chunk.length - static_cast<uint32_t>(result)});
+            return;
+        }
+        if (--request.chunksLeft == 0)
+        {
+            completed.push_back(chunk.request);
+        }
+    }
+
+    void CFXFileReader::complete(const std::shared_ptr<Request> &request)
+    {
+        if (request->fd >= 0)
+        {
+            close(request->fd);
+            request->fd = -1;
+        }
+        if (!request->error.empty())
+        {
+            request->callback(nullptr, request->filepath + ": " + request->error);
+        }
+        else
+        {
+            request->callback(std::move(request->file), std::string{});
+        }
+        request->file.reset();
+    }
+
+    void CFXFileReader::submitBatch(const std::vector<std::string> &filepaths, const std::vector<Callback> &callbacks)
+    {
+        std::vector<std::shared_ptr<Request>> completed;
+        for (size_t i = 0; i < filepaths.size(); i++)
+        {
+            enqueue(filepaths[i], callbacks[i], completed);
+        }
+        if (ringFd >= 0)
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            submitPending();
+        }
+        else
+        {
+            chunkAvailable.notify_all();
+        }
+        for (auto &request : completed)
+        {
+            complete(request);
+        }
+    }
+
+    void CFXFileReader::read(const std::string &filepath, Callback callback)
+    {
+        submitBatch({filepath}, {std::move(callback)});
+    }
+
+    std::future<std::shared_ptr<CFXMappedFile>> CFXFileReader::read(const std::string &filepath)
+    {
+        return std::move(read(std::vector<std::string>{filepath}).front());
+    }
+
+    std::vector<std::future<std::shared_ptr<CFXMappedFile>>> CFXFileReader::read(const std::vector<std::string> &filepaths)
+    {
+        std::vector<std::future<std::shared_ptr<CFXMappedFile>>> futures;
+        std::vector<Callback> callbacks;
+        for (size_t i = 0; i < filepaths.size(); i++)
+        {
+            auto promise = std::make_shared<std::promise<std::shared_ptr<CFXMappedFile>>>();
+            futures.push_back(promise->get_future());
+            callbacks.push_back([promise](std::shared_ptr<CFXMappedFile> file, const std::string &error)
+                                {
+                                    if (file)
+                                    {
+                                        promise->set_value(std::move(file));
+                                    }
+                                    else
+                                    {
+                                        promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+                                    }
+                                });
+        }
+        submitBatch(filepaths, callbacks);
+        return futures;
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "cfx_mapped_file.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Asynchronous whole-file reads.
+     *
+     * Files are split into CHUNK_SIZE reads that are submitted in batches through an
+     * io_uring and reaped by one completion thread. Where io_uring is unavailable (old
+     * kernels, seccomp filters, io_uring_disabled) a small pool of threads runs the chunks
+     * with pread instead. Either way the data lands in page-aligned buffers that are
+     * recycled through a size-class pool once the last CFXMappedFile referencing them goes.
+     *
+     * Files packed into the mounted CFXAssetArchive are served from the archive and
+     * complete before read() returns. Opening a file is synchronous, only reading is not.
+     */
+    class CFXFileReader
+    {
+    public:
+        static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+        static constexpr uint32_t QUEUE_DEPTH = 64;
+        static constexpr uint32_t FALLBACK_THREAD_COUNT = 4;
+
+        // file is null and error says why when the read failed. Runs on the completion or pread thread,
+        // or on the calling thread for reads that complete right away.
+        using Callback = std::function<void(std::shared_ptr<CFXMappedFile> file, const std::string &error)>;
+
+        // useIoUring = false goes straight to the pread threads
+        explicit CFXFileReader(bool useIoUring = true);
+        ~CFXFileReader();
+        CFXFileReader(const CFXFileReader &) = delete;
+        CFXFileReader &operator=(const CFXFileReader &) = delete;
+
+        // Reader shared by the loaders and pipeline creation, created on first use
+        static CFXFileReader &shared();
+
+        void read(const std::string &filepath, Callback callback);
+        // The future throws std::runtime_error if the read failed
+        std::future<std::shared_ptr<CFXMappedFile>> read(const std::string &filepath);
+        // Submits all reads in one batch
+        std::vector<std::future<std::shared_ptr<CFXMappedFile>>> read(const std::vector<std::string> &filepaths);
+
+        bool usesIoUring() const { return ringFd >= 0; }
+
+    private:
+        struct BufferPool;
+
+        struct Request
+        {
+            std::string filepath;
+            int fd = -1;
+            std::shared_ptr<CFXMappedFile> file{};
+            uint8_t *data = nullptr;
+            // chunks still in flight or queued, the request completes when it drops to 0
+            uint32_t chunksLeft = 0;
+            std::string error{};
+            Callback callback{};
+        };
+
+        struct Chunk
+        {
+            std::shared_ptr<Request> request{};
+            uint64_t offset = 0;
+            uint32_t length = 0;
+        };
+
+        struct Ring
+        {
+            uint32_t *sqHead = nullptr;
+            uint32_t *sqTail = nullptr;
+            uint32_t sqMask = 0;
+            uint32_t *sqArray = nullptr;
+            void *sqes = nullptr;
+            uint32_t *cqHead = nullptr;
+            uint32_t *cqTail = nullptr;
+            uint32_t cqMask = 0;
+            void *cqes = nullptr;
+            void *sqMapping = nullptr;
+            size_t sqMappingSize = 0;
+            void *cqMapping = nullptr;
+            size_t cqMappingSize = 0;
+            size_t sqesSize = 0;
+        };
+
+        bool setupRing();
+        void destroyRing();
+        // Opens the file and queues its chunks, completes the request right away when there is nothing to read
+        void enqueue(const std::string &filepath, Callback callback, std::vector<std::shared_ptr<Request>> &completed);
+        void submitPending();
+        void completionLoop();
+        void fallbackLoop();
+        void finishChunk(Chunk &chunk, int64_t result, std::vector<std::shared_ptr<Request>> &completed);
+        void complete(const std::shared_ptr<Request> &request);
+        void submitBatch(const std::vector<std::string> &filepaths, const std::vector<Callback> &callbacks);
+
+        std::shared_ptr<BufferPool> bufferPool;
+
+        std::mutex mutex;
+        std::condition_variable chunkAvailable;
+        std::deque<Chunk> pending;
+        bool stopping = false;
+
+        // io_uring state, ringFd < 0 when the pread threads are used instead
+        int ringFd = -1;
+        Ring ring{};
+        // user_data of every submitted read is its slot here
+        std::vector<Chunk> inFlight;
+        std::vector<uint32_t> freeSlots;
+        std::thread completionThread;
+
+        std::vector<std::thread> fallbackThreads;
+    };
+}
@@ -22,7 +22,10 @@ namespace cfx
         CFXCamera &camera;
         uint32_t deviceIndex;
         VkDescriptorSet globalDescriptorSet;
+        // dynamic offset of this frame's GlobalUbo in the frame ring
+        uint32_t globalUboOffset;
         CFXGameObject::Map &gameObjects;
+        float viewportHeight;
     };
 
     struct GlobalUbo
@@ -0,0 +1,83 @@
+#include "cfx_frame_ring.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace cfx
+{
+    CFXFrameRing::CFXFrameRing(CFXDevice &device, VkDeviceSize frameSize, VkBufferUsageFlags usage) : cfxDevice{device}
+    {
+        deviceStates.resize(cfxDevice.getDevicesinDeviceGroup());
+        VkDeviceSize partitionAlignment = 1;
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            const VkPhysicalDeviceLimits &limits = cfxDevice.properties[i].limits;
+            deviceStates[i].defaultAlignment = std::max<VkDeviceSize>({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, 16});
+            partitionAlignment = std::max(partitionAlignment, deviceStates[i].defaultAlignment);
+        }
+        // every partition starts aligned, so do all slices of the default alignment
+        this->frameSize = (frameSize + partitionAlignment - 1) / partitionAlignment * partitionAlignment;
+
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            DeviceState &state = deviceStates[i];
+            state.buffer = std::make_unique<CFXBuffer>(cfxDevice, this->frameSize, CFXSwapChain::MAX_FRAMES_IN_FLIGHT, usage,
+                                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, i);
+            if (state.buffer->map() != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to map frame ring!");
+            }
+            state.data = static_cast<uint8_t *>(state.buffer->getMappedMemory());
+        }
+    }
+
+    void CFXFrameRing::beginFrame(int deviceIndex, int frameIndex, VkFence inFlightFence)
+    {
+        assert(frameIndex >= 0 && frameIndex < CFXSwapChain::MAX_FRAMES_IN_FLIGHT && "Frame index out of range");
+        // the swapchain has normally waited on it already before acquiring the image
+        vkWaitForFences(cfxDevice.device(deviceIndex), 1, &inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+        DeviceState &state = deviceStates[deviceIndex];
+        state.frameStart = frameSize * frameIndex;
+        state.head = state.frameStart;
+    }
+
+    CFXFrameRing::Slice CFXFrameRing::allocate(int deviceIndex, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        if (alignment == 0)
+        {
+            alignment = state.defaultAlignment;
+        }
+        VkDeviceSize offset = (state.head + alignment - 1) / alignment * alignment;
+        if (offset + size > state.frameStart + frameSize)
+        {
+            throw std::runtime_error("frame ring partition is full!");
+        }
+        state.head = offset + size;
+        state.buffer->markDirty(size, offset);
+        state.highWaterMark = std::max(state.highWaterMark, state.head - state.frameStart);
+
+        Slice slice{};
+        slice.buffer = state.buffer->getBuffer();
+        slice.offset = offset;
+        slice.size = size;
+        slice.data = state.data + offset;
+        return slice;
+    }
+
+    CFXFrameRing::Slice CFXFrameRing::write(int deviceIndex, const void *data, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        Slice slice = allocate(deviceIndex, size, alignment);
+        memcpy(slice.data, data, size);
+        return slice;
+    }
+
+    void CFXFrameRing::flush(int deviceIndex)
+    {
+        deviceStates[deviceIndex].buffer->flushDirty();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cfx_buffer.hpp"
+#include "cfx_device.hpp"
+#include "cfx_swapchain.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Transient per-frame GPU data: UBOs, instance data, dynamic vertices.
+     *
+     * Each device has one persistently mapped host visible buffer cut into one partition per
+     * frame in flight. Allocations bump a cursor through the current frame's partition and
+     * return an aligned slice that can be bound with its descriptor info or as a dynamic
+     * offset into the whole buffer. beginFrame() waits for the frame's in flight fence and
+     * rewinds the partition, so nothing is ever freed one by one and nothing is allocated
+     * per frame.
+     */
+    class CFXFrameRing
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 1024 * 1024;
+        static constexpr VkBufferUsageFlags DEFAULT_USAGE = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+
+        struct Slice
+        {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            void *data = nullptr;
+
+            VkDescriptorBufferInfo descriptorInfo() const { return VkDescriptorBufferInfo{buffer, offset, size}; }
+            // for descriptors written with getBuffer() at offset 0
+            uint32_t dynamicOffset() const { return static_cast<uint32_t>(offset); }
+        };
+
+        CFXFrameRing(CFXDevice &device, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE, VkBufferUsageFlags usage = DEFAULT_USAGE);
+        CFXFrameRing(const CFXFrameRing &) = delete;
+        CFXFrameRing &operator=(const CFXFrameRing &) = delete;
+
+        // Waits for inFlightFence, the fence the frame's previous submit signals, then rewinds the frame's partition
+        void beginFrame(int deviceIndex, int frameIndex, VkFence inFlightFence);
+        // alignment 0 uses the device's uniform and storage buffer offset alignment.
+        // Throws std::runtime_error when the frame's partition is full.
+        Slice allocate(int deviceIndex, VkDeviceSize size, VkDeviceSize alignment = 0);
+        Slice write(int deviceIndex, const void *data, VkDeviceSize size, VkDeviceSize alignment = 0);
+        template <typename T>
+        Slice write(int deviceIndex, const T &value, VkDeviceSize alignment = 0)
+        {
+            return write(deviceIndex, &value, sizeof(T), alignment);
+        }
+        // Makes the slices allocated since the last flush visible to the device, call it before submitting the frame
+        void flush(int deviceIndex);
+
+        VkBuffer getBuffer(int deviceIndex) const { return deviceStates[deviceIndex].buffer->getBuffer(); }
+        VkDeviceSize getFrameSize() const { return frameSize; }
+        // Largest number of bytes a frame on the device has used so far
+        VkDeviceSize getHighWaterMark(int deviceIndex) const { return deviceStates[deviceIndex].highWaterMark; }
+
+    private:
+        struct DeviceState
+        {
+            std::unique_ptr<CFXBuffer> buffer;
+            uint8_t *data = nullptr;
+            VkDeviceSize defaultAlignment = 1;
+            VkDeviceSize frameStart = 0;
+            VkDeviceSize head = 0;
+            VkDeviceSize highWaterMark = 0;
+        };
+
+        CFXDevice &cfxDevice;
+        VkDeviceSize frameSize;
+        std::vector<DeviceState> deviceStates;
+    };
+}
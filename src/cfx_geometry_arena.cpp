@@ -0,0 +1,263 @@
+#include "cfx_geometry_arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace cfx
+{
+    CFXGeometryArena::CFXGeometryArena(CFXDevice &device, CFXUploadQueue &uploadQueue, VkDeviceSize vertexBlockSize, VkDeviceSize indexBlockSize,
+                                       VkDeviceSize meshletBlockSize)
+        : cfxDevice{device}, uploadQueue{uploadQueue}
+    {
+        PoolState &vertexPool = poolState(Pool::Vertex);
+        vertexPool.blockSize = vertexBlockSize;
+        vertexPool.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        PoolState &indexPool = poolState(Pool::Index);
+        indexPool.blockSize = indexBlockSize;
+        indexPool.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        PoolState &meshletPool = poolState(Pool::Meshlet);
+        meshletPool.blockSize = meshletBlockSize;
+        meshletPool.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
+
+    CFXGeometryArena::~CFXGeometryArena()
+    {
+    }
+
+    void CFXGeometryArena::createBlock(PoolState &state, VkDeviceSize size, Placement placement)
+    {
+        Block block{};
+        block.size = size;
+        block.placement = placement;
+        block.freeRanges[0] = size;
+        createBuffers(state, block);
+        state.blocks.push_back(std::move(block));
+    }
+
+    void CFXGeometryArena::createBuffers(const PoolState &state, Block &block)
+    {
+        block.buffers.resize(cfxDevice.getDevicesinDeviceGroup());
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            if (block.placement == Placement::DeviceLocal)
+            {
+                block.buffers[i] = std::make_unique<CFXBuffer>(cfxDevice, block.size, 1, state.usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, i);
+                continue;
+            }
+            block.buffers[i] = std::make_unique<CFXBuffer>(cfxDevice, block.size, 1, state.usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                           CFXMemoryTypeTable::Usage::HostResident, i);
+            if (block.buffers[i]->map() != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to map host visible geometry arena block!");
+            }
+        }
+    }
+
+    bool CFXGeometryArena::allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset)
+    {
+        for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range)
+        {
+            VkDeviceSize rangeStart = range->first;
+            VkDeviceSize rangeEnd = range->first + range->second;
+            VkDeviceSize start = (rangeStart + alignment - 1) / alignment * alignment;
+            if (start + size > rangeEnd)
+            {
+                continue;
+            }
+            // keep whatever the alignment and the allocation leave on either side
+            block.freeRanges.erase(range);
+            if (start > rangeStart)
+            {
+                block.freeRanges[rangeStart] = start - rangeStart;
+            }
+            if (start + size < rangeEnd)
+            {
+                block.freeRanges[start + size] = rangeEnd - (start + size);
+            }
+            offset = start;
+            return true;
+        }
+        return false;
+    }
+
+    CFXGeometryArena::Allocation CFXGeometryArena::allocate(Pool pool, VkDeviceSize size, VkDeviceSize alignment, Placement placement)
+    {
+        assert(size > 0 && alignment > 0 && "Geometry arena allocations need a size and an alignment");
+        collectFrees();
+        PoolState &state = poolState(pool);
+        Allocation allocation{};
+        allocation.size = size;
+        for (uint32_t i = 0; i < state.blocks.size(); i++)
+        {
+            Block &block = state.blocks[i];
+            if (block.placement == placement && !block.released() && allocateFromBlock(block, size, alignment, allocation.offset))
+            {
+                allocation.block = i;
+                return allocation;
+            }
+        }
+        // bring a released slot back before growing the pool, block indices stay stable
+        for (uint32_t i = 0; i < state.blocks.size(); i++)
+        {
+            Block &block = state.blocks[i];
+            if (block.released() && block.size >= size)
+            {
+                block.placement = placement;
+                createBuffers(state, block);
+                allocateFromBlock(block, size, alignment, allocation.offset);
+                allocation.block = i;
+                return allocation;
+            }
+        }
+        createBlock(state, std::max(state.blockSize, size), placement);
+        if (!allocateFromBlock(state.blocks.back(), size, alignment, allocation.offset))
+        {
+            throw std::runtime_error("failed to allocate from a new geometry arena block");
+        }
+        allocation.block = static_cast<uint32_t>(state.blocks.size() - 1);
+        return allocation;
+    }
+
+    void CFXGeometryArena::free(Pool pool, const Allocation &allocation)
+    {
+        if (!allocation.valid())
+        {
+            return;
+        }
+        PendingFree pending{pool, allocation, {}};
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            pending.values.push_back(cfxDevice.getDeletionQueue(i).getPendingValue());
+        }
+        pendingFrees.push_back(std::move(pending));
+    }
+
+    void CFXGeometryArena::collectFrees()
+    {
+        auto done = std::partition(pendingFrees.begin(), pendingFrees.end(), [this](const PendingFree &pending)
+                                   {
+                                       for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+                                       {
+                                           if (!cfxDevice.getDeletionQueue(i).isComplete(pending.values[i]))
+                                           {
+                                               return true;
+                                           }
+                                       }
+                                       return false; });
+        for (auto pending = done; pending != pendingFrees.end(); ++pending)
+        {
+            freeRange(pending->pool, pending->allocation);
+        }
+        pendingFrees.erase(done, pendingFrees.end());
+    }
+
+    void CFXGeometryArena::freeRange(Pool pool, const Allocation &allocation)
+    {
+        Block &block = poolState(pool).blocks[allocation.block];
+        VkDeviceSize start = allocation.offset;
+        VkDeviceSize end = allocation.offset + allocation.size;
+
+        auto next = block.freeRanges.lower_bound(start);
+        if (next != block.freeRanges.end() && next->first == end)
+        {
+            end += next->second;
+            next = block.freeRanges.erase(next);
+        }
+        if (next != block.freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == start)
+            {
+                start = previous->first;
+                block.freeRanges.erase(previous);
+            }
+        }
+        block.freeRanges[start] = end - start;
+    }
+
+    void CFXGeometryArena::upload(Pool pool, const Allocation &allocation, const void *data)
+    {
+        upload(pool, allocation, [data, size = allocation.size](void *destination)
+               { memcpy(destination, data, size); });
+    }
+
+    void CFXGeometryArena::upload(Pool pool, const Allocation &allocation, const std::function<void(void *)> &write)
+    {
+        Block &block = poolState(pool).blocks[allocation.block];
+        if (block.placement == Placement::HostVisible)
+        {
+            for (auto &buffer : block.buffers)
+            {
+                write(static_cast<uint8_t *>(buffer->getMappedMemory()) + allocation.offset);
+                buffer->markDirty(allocation.size, allocation.offset);
+                buffer->flushDirty();
+            }
+            return;
+        }
+        for (int deviceIndex = 0; deviceIndex < cfxDevice.getDevicesinDeviceGroup(); deviceIndex++)
+        {
+            write(uploadQueue.stage(deviceIndex, getBuffer(pool, allocation.block, deviceIndex), allocation.offset, allocation.size));
+        }
+    }
+
+    VkDeviceSize CFXGeometryArena::releaseEmptyBlocks()
+    {
+        collectFrees();
+        VkDeviceSize released = 0;
+        for (Pool pool : {Pool::Vertex, Pool::Index})
+        {
+            for (Block &block : poolState(pool).blocks)
+            {
+                if (!block.released() && block.empty())
+                {
+                    block.buffers.clear();
+                    released += block.size;
+                }
+            }
+        }
+        return released;
+    }
+
+    VkDeviceSize CFXGeometryArena::getReservedBytes(Placement placement) const
+    {
+        VkDeviceSize reserved = 0;
+        for (const PoolState &state : pools)
+        {
+            for (const Block &block : state.blocks)
+            {
+                if (block.placement == placement && !block.released())
+                {
+                    reserved += block.size;
+                }
+            }
+        }
+        return reserved;
+    }
+
+    VkBuffer CFXGeometryArena::getBuffer(Pool pool, uint32_t block, int deviceIndex) const
+    {
+        return poolState(pool).blocks[block].buffers[deviceIndex]->getBuffer();
+    }
+
+    void CFXGeometryArena::bind(VkCommandBuffer commandBuffer, int deviceIndex, BindState &state, const Allocation &vertices,
+                                const Allocation &indices, VkIndexType indexType) const
+    {
+        if (vertices.block != state.vertexBlock)
+        {
+            VkBuffer buffers[] = {getBuffer(Pool::Vertex, vertices.block, deviceIndex)};
+            VkDeviceSize offsets[] = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+            state.vertexBlock = vertices.block;
+        }
+        // the index type is part of the binding, so mixed 16/32-bit models rebind the same block
+        if (indices.valid() && (indices.block != state.indexBlock || indexType != state.indexType))
+        {
+            vkCmdBindIndexBuffer(commandBuffer, getBuffer(Pool::Index, indices.block, deviceIndex), 0, indexType);
+            state.indexBlock = indices.block;
+            state.indexType = indexType;
+        }
+    }
+}
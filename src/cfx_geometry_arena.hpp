@@ -0,0 +1,138 @@
+#pragma once
+
+#include "cfx_buffer.hpp"
+#include "cfx_device.hpp"
+#include "cfx_upload_queue.hpp"
+
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Shared device-local storage for model vertices and indices.
+     *
+     * Each pool (vertices, indices, meshlets) is a short list of large blocks with one CFXBuffer per
+     * device, all devices sharing the same layout. Models sub-allocate ranges out of a block
+     * and draw with firstIndex/vertexOffset, so a frame binds each block once instead of
+     * every model binding its own buffers. Freed ranges go back to a per-block free list and
+     * are coalesced with their neighbours once every frame submitted before the free has
+     * completed on every device. Uploads are batched through a CFXUploadQueue and
+     * only reach the device once the queue is submitted.
+     * Blocks are either device local or host visible. Host visible blocks hold geometry the
+     * residency manager demoted out of VRAM, they are persistently mapped and written in place.
+     */
+    class CFXGeometryArena
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_VERTEX_BLOCK_SIZE = 32 * 1024 * 1024;
+        static constexpr VkDeviceSize DEFAULT_INDEX_BLOCK_SIZE = 8 * 1024 * 1024;
+        static constexpr VkDeviceSize DEFAULT_MESHLET_BLOCK_SIZE = 2 * 1024 * 1024;
+
+        enum class Pool
+        {
+            Vertex,
+            Index,
+            // CFXMeshlet arrays, read by the culling compute shader as storage buffers
+            Meshlet
+        };
+
+        enum class Placement
+        {
+            DeviceLocal,
+            HostVisible
+        };
+
+        struct Allocation
+        {
+            uint32_t block = UINT32_MAX;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            bool valid() const { return block != UINT32_MAX; }
+        };
+
+        // What is currently bound in one command buffer, so unchanged blocks are not rebound
+        struct BindState
+        {
+            uint32_t vertexBlock = UINT32_MAX;
+            uint32_t indexBlock = UINT32_MAX;
+            VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+        };
+
+        CFXGeometryArena(CFXDevice &device, CFXUploadQueue &uploadQueue, VkDeviceSize vertexBlockSize = DEFAULT_VERTEX_BLOCK_SIZE,
+                         VkDeviceSize indexBlockSize = DEFAULT_INDEX_BLOCK_SIZE,
+                         VkDeviceSize meshletBlockSize = DEFAULT_MESHLET_BLOCK_SIZE);
+        ~CFXGeometryArena();
+        CFXGeometryArena(const CFXGeometryArena &) = delete;
+        CFXGeometryArena &operator=(const CFXGeometryArena &) = delete;
+
+        // The offset is a multiple of alignment, a new block is created when none of the placement has room
+        Allocation allocate(Pool pool, VkDeviceSize size, VkDeviceSize alignment, Placement placement = Placement::DeviceLocal);
+        // The range is reused once the frames that may still draw from it are done
+        void free(Pool pool, const Allocation &allocation);
+        // Queues a copy of allocation.size bytes from data into the allocation on every device,
+        // host visible blocks are written and flushed right away
+        void upload(Pool pool, const Allocation &allocation, const void *data);
+        // Same, but write produces the allocation.size bytes in place: once per device, into its
+        // staging memory or straight into a host visible block
+        void upload(Pool pool, const Allocation &allocation, const std::function<void(void *)> &write);
+        // Gives the memory of empty vertex and index blocks back to the allocator, their slots are
+        // refilled by later allocations. Meshlet blocks stay, descriptor sets point at them.
+        // Returns the bytes released on each device.
+        VkDeviceSize releaseEmptyBlocks();
+
+        VkBuffer getBuffer(Pool pool, uint32_t block, int deviceIndex) const;
+        VkDeviceSize getBlockSize(Pool pool, uint32_t block) const { return poolState(pool).blocks[block].size; }
+        Placement getPlacement(Pool pool, uint32_t block) const { return poolState(pool).blocks[block].placement; }
+        // Bytes of live blocks of the placement across all pools, the same on every device
+        VkDeviceSize getReservedBytes(Placement placement) const;
+
+        void bind(VkCommandBuffer commandBuffer, int deviceIndex, BindState &state, const Allocation &vertices,
+                  const Allocation &indices, VkIndexType indexType) const;
+
+    private:
+        struct Block
+        {
+            VkDeviceSize size;
+            Placement placement;
+            // offset -> size of every free range
+            std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+            // empty once releaseEmptyBlocks() gave the memory back
+            std::vector<std::unique_ptr<CFXBuffer>> buffers;
+            bool released() const { return buffers.empty(); }
+            bool empty() const { return freeRanges.size() == 1 && freeRanges.begin()->second == size; }
+        };
+
+        struct PendingFree
+        {
+            Pool pool;
+            Allocation allocation;
+            // CFXDeletionQueue value per device after which no frame uses the range
+            std::vector<uint64_t> values;
+        };
+
+        struct PoolState
+        {
+            VkDeviceSize blockSize;
+            VkBufferUsageFlags usage;
+            std::vector<Block> blocks;
+        };
+
+        PoolState &poolState(Pool pool) { return pools[static_cast<size_t>(pool)]; }
+        const PoolState &poolState(Pool pool) const { return pools[static_cast<size_t>(pool)]; }
+        void createBlock(PoolState &state, VkDeviceSize size, Placement placement);
+        void createBuffers(const PoolState &state, Block &block);
+        static bool allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+        // Returns the pending frees the GPU is done with to their blocks
+        void collectFrees();
+        void freeRange(Pool pool, const Allocation &allocation);
+
+        CFXDevice &cfxDevice;
+        CFXUploadQueue &uploadQueue;
+        std::array<PoolState, 3> pools;
+        std::vector<PendingFree> pendingFrees;
+    };
+}
@@ -0,0 +1,542 @@
+#include "cfx_glb_file.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace cfx
+{
+    // Just enough JSON for the glTF scene description
+    struct JsonValue
+    {
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string{};
+        std::vector<JsonValue> items{};
+        std::vector<std::pair<std::string, JsonValue>> members{};
+
+        const JsonValue *find(const char *key) const
+        {
+            for (const auto &member : members)
+            {
+                if (member.first == key)
+                {
+                    return &member.second;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+        JsonParser(const char *text, size_t size) : cursor{text}, end{text + size} {}
+
+        JsonValue parseDocument()
+        {
+            JsonValue value = parseValue(0);
+            skipWhitespace();
+            // the chunk is padded with spaces, anything else after the document is an error
+            if (cursor != end && *cursor != '\0')
+            {
+                fail("trailing characters");
+            }
+            return value;
+        }
+
+    private:
+        static constexpr int MAX_DEPTH = 64;
+
+        [[noreturn]] void fail(const char *what) const
+        {
+            throw std::runtime_error(std::string("invalid glTF JSON: ") + what);
+        }
+
+        void skipWhitespace()
+        {
+            while (cursor != end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            {
+                cursor++;
+            }
+        }
+
+        void expect(const char *literal)
+        {
+            size_t length = strlen(literal);
+            if (static_cast<size_t>(end - cursor) < length || memcmp(cursor, literal, length) != 0)
+            {
+                fail("unexpected token");
+            }
+            cursor += length;
+        }
+
+        JsonValue parseValue(int depth)
+        {
+            if (depth > MAX_DEPTH)
+            {
+                fail("nested too deeply");
+            }
+            skipWhitespace();
+            if (cursor == end)
+            {
+                fail("unexpected end");
+            }
+            JsonValue value{};
+            switch (*cursor)
+            {
+            case '{':
+                value.type = JsonValue::Type::Object;
+                cursor++;
+                skipWhitespace();
+                if (cursor != end && *cursor == '}')
+                {
+                    cursor++;
+                    return value;
+                }
+                while (true)
+                {
+                    skipWhitespace();
+                    std::string key = parseString();
+                    skipWhitespace();
+                    expect(":");
+                    value.members.emplace_back(std::move(key), parseValue(depth + 1));
+                    skipWhitespace();
+                    if (cursor != end && *cursor == ',')
+                    {
+                        cursor++;
+                        continue;
+                    }
+                    expect("}");
+                    return value;
+                }
+            case '[':
+                value.type = JsonValue::Type::Array;
+                cursor++;
+                skipWhitespace();
+                if (cursor != end && *cursor == ']')
+                {
+                    cursor++;
+                    return value;
+                }
+                while (true)
+                {
+                    value.items.push_back(parseValue(depth + 1));
+                    skipWhitespace();
+                    if (cursor != end && *cursor == ',')
+                    {
+                        cursor++;
+                        continue;
+                    }
+                    expect("]");
+                    return value;
+                }
+            case '"':
+                value.type = JsonValue::Type::String;
+                value.string = parseString();
+                return value;
+            case 't':
+                expect("true");
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return value;
+            case 'f':
+                expect("false");
+                value.type = JsonValue::Type::Bool;
+                return value;
+            case 'n':
+                expect("null");
+                return value;
+            default:
+                value.type = JsonValue::Type::Number;
+                value.number = parseNumber();
+                return value;
+            }
+        }
+
+        double parseNumber()
+        {
+            // strtod needs a terminated string, numbers are short
+            char buffer[64];
+            size_t length = 0;
+            while (cursor + length != end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", cursor[length]) != nullptr)
+            {
+                length++;
+            }
+            if (length == 0)
+            {
+                fail("unexpected character");
+            }
+            memcpy(buffer, cursor, length);
+            buffer[length] = '\0';
+            char *parsedEnd = nullptr;
+            double number = strtod(buffer, &parsedEnd);
+            if (parsedEnd != buffer + length)
+            {
+                fail("malformed number");
+            }
+            cursor += length;
+            return number;
+        }
+
+        void appendUtf8(std::string &out, uint32_t codePoint)
+        {
+            if (codePoint < 0x80)
+            {
+                out += static_cast<char>(codePoint);
+            }
+            else if (codePoint < 0x800)
+            {
+                out += static_cast<char>(0xc0 | (codePoint >> 6));
+                out += static_cast<char>(0x80 | (codePoint & 0x3f));
+            }
+            else
+            {
+                out += static_cast<char>(0xe0 | (codePoint >> 12));
+                out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (codePoint & 0x3f));
+            }
+        }
+
+        std::string parseString()
+        {
+            expect("\"");
+            std::string out{};
+            while (true)
+            {
+                if (cursor == end)
+                {
+                    fail("unterminated string");
+                }
+                char c = *cursor++;
+                if (c == '"')
+                {
+                    return out;
+                }
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (cursor == end)
+                {
+                    fail("unterminated string");
+                }
+                char escaped = *cursor++;
+                switch (escaped)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    out += escaped;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u':
+                {
+                    if (end - cursor < 4)
+                    {
+                        fail("truncated escape");
+                    }
+                    char hex[5] = {cursor[0], cursor[1], cursor[2], cursor[3], '\0'};
+                    char *hexEnd = nullptr;
+                    uint32_t codePoint = static_cast<uint32_t>(strtoul(hex, &hexEnd, 16));
+                    if (hexEnd != hex + 4)
+                    {
+                        fail("malformed escape");
+                    }
+                    // surrogate pairs are kept as two code units, names in glTF files rarely need them
+                    appendUtf8(out, codePoint);
+                    cursor += 4;
+                    break;
+                }
+                default:
+                    fail("unknown escape");
+                }
+            }
+        }
+
+        const char *cursor;
+        const char *end;
+    };
+
+    static const JsonValue &requireMember(const JsonValue &object, const char *key)
+    {
+        const JsonValue *member = object.find(key);
+        if (member == nullptr)
+        {
+            throw std::runtime_error(std::string("glTF object is missing \"") + key + "\"");
+        }
+        return *member;
+    }
+
+    static uint64_t toUnsigned(const JsonValue &value, const char *what)
+    {
+        if (value.type != JsonValue::Type::Number || value.number < 0.0 || value.number != std::floor(value.number) || value.number > 9007199254740992.0)
+        {
+            throw std::runtime_error(std::string("glTF ") + what + " is not a non-negative integer");
+        }
+        return static_cast<uint64_t>(value.number);
+    }
+
+    static uint64_t optionalUnsigned(const JsonValue &object, const char *key, uint64_t fallback)
+    {
+        const JsonValue *member = object.find(key);
+        return member != nullptr ? toUnsigned(*member, key) : fallback;
+    }
+
+    static const JsonValue &arrayElement(const JsonValue &root, const char *arrayName, uint64_t index)
+    {
+        const JsonValue *array = root.find(arrayName);
+        if (array == nullptr || array->type != JsonValue::Type::Array || index >= array->items.size())
+        {
+            throw std::runtime_error(std::string("glTF ") + arrayName + " index out of range");
+        }
+        return array->items[index];
+    }
+
+    static uint32_t componentSize(uint64_t componentType)
+    {
+        switch (componentType)
+        {
+        case 5120: // BYTE
+        case CFXGlbFile::UNSIGNED_BYTE:
+            return 1;
+        case 5122: // SHORT
+        case CFXGlbFile::UNSIGNED_SHORT:
+            return 2;
+        case CFXGlbFile::UNSIGNED_INT:
+        case CFXGlbFile::FLOAT:
+            return 4;
+        default:
+            throw std::runtime_error("glTF accessor has an unknown componentType");
+        }
+    }
+
+    static uint32_t componentCount(const std::string &type)
+    {
+        if (type == "SCALAR")
+            return 1;
+        if (type == "VEC2")
+            return 2;
+        if (type == "VEC3")
+            return 3;
+        if (type == "VEC4")
+            return 4;
+        throw std::runtime_error("glTF accessor type " + type + " is not supported");
+    }
+
+    static CFXGlbFile::Accessor resolveAccessor(const JsonValue &root, uint64_t index, const uint8_t *bin, uint64_t binSize)
+    {
+        const JsonValue &accessor = arrayElement(root, "accessors", index);
+        if (accessor.find("sparse") != nullptr)
+        {
+            throw std::runtime_error("sparse glTF accessors are not supported");
+        }
+        if (accessor.find("bufferView") == nullptr)
+        {
+            throw std::runtime_error("glTF accessors without a bufferView are not supported");
+        }
+        uint64_t viewIndex = toUnsigned(requireMember(accessor, "bufferView"), "bufferView");
+        uint64_t componentType = toUnsigned(requireMember(accessor, "componentType"), "componentType");
+        uint64_t count = toUnsigned(requireMember(accessor, "count"), "count");
+        const JsonValue &type = requireMember(accessor, "type");
+        if (type.type != JsonValue::Type::String)
+        {
+            throw std::runtime_error("glTF accessor type is not a string");
+        }
+        uint64_t accessorOffset = optionalUnsigned(accessor, "byteOffset", 0);
+        const JsonValue *normalized = accessor.find("normalized");
+
+        const JsonValue &view = arrayElement(root, "bufferViews", viewIndex);
+        uint64_t bufferIndex = toUnsigned(requireMember(view, "buffer"), "buffer");
+        if (bufferIndex != 0 || arrayElement(root, "buffers", 0).find("uri") != nullptr)
+        {
+            throw std::runtime_error("glTF buffers outside the GLB BIN chunk are not supported");
+        }
+        uint64_t viewOffset = optionalUnsigned(view, "byteOffset", 0);
+        uint64_t viewLength = toUnsigned(requireMember(view, "byteLength"), "byteLength");
+
+        uint32_t size = componentSize(componentType);
+        uint32_t components = componentCount(type.string);
+        uint64_t elementSize = static_cast<uint64_t>(size) * components;
+        uint64_t stride = optionalUnsigned(view, "byteStride", elementSize);
+        if (stride < elementSize || stride > 252 || stride % size != 0 || (viewOffset + accessorOffset) % size != 0)
+        {
+            throw std::runtime_error("glTF accessor has a misaligned layout");
+        }
+        if (viewOffset + viewLength > binSize || count == 0 || count > UINT32_MAX ||
+            accessorOffset + stride * (count - 1) + elementSize > viewLength)
+        {
+            throw std::runtime_error("glTF accessor reaches past its bufferView or the BIN chunk");
+        }
+
+        CFXGlbFile::Accessor resolved{};
+        resolved.data = bin + viewOffset + accessorOffset;
+        resolved.count = static_cast<uint32_t>(count);
+        resolved.stride = static_cast<uint32_t>(stride);
+        resolved.componentType = static_cast<uint32_t>(componentType);
+        resolved.components = components;
+        resolved.normalized = normalized != nullptr && normalized->type == JsonValue::Type::Bool && normalized->boolean;
+        resolved.bufferView = static_cast<uint32_t>(viewIndex);
+        resolved.viewEnd = bin + viewOffset + viewLength;
+        return resolved;
+    }
+
+    static void checkAttribute(const CFXGlbFile::Accessor &accessor, const char *name, uint32_t minComponents, uint32_t maxComponents,
+                               bool allowNormalized, uint32_t vertexCount)
+    {
+        if (!accessor.valid())
+        {
+            return;
+        }
+        bool floats = accessor.componentType == CFXGlbFile::FLOAT;
+        bool normalizedUnsigned = allowNormalized && accessor.normalized &&
+                                  (accessor.componentType == CFXGlbFile::UNSIGNED_BYTE || accessor.componentType == CFXGlbFile::UNSIGNED_SHORT);
+        if ((!floats && !normalizedUnsigned) || accessor.components < minComponents || accessor.components > maxComponents)
+        {
+            throw std::runtime_error(std::string("glTF attribute ") + name + " has an unsupported format");
+        }
+        if (accessor.count != vertexCount)
+        {
+            throw std::runtime_error(std::string("glTF attribute ") + name + " count does not match POSITION");
+        }
+    }
+
+    std::shared_ptr<CFXGlbFile> CFXGlbFile::open(const std::string &filepath, std::shared_ptr<CFXMappedFile> file)
+    {
+        if (file == nullptr)
+        {
+            file = CFXMappedFile::open(filepath);
+        }
+        if (file == nullptr)
+        {
+            throw std::runtime_error("failed to open " + filepath);
+        }
+        const uint8_t *data = file->data();
+        size_t size = file->size();
+        auto readWord = [data](size_t offset)
+        {
+            uint32_t word;
+            memcpy(&word, data + offset, sizeof(word));
+            return word;
+        };
+        if (size < 20 || readWord(0) != MAGIC || readWord(4) != VERSION || readWord(8) > size)
+        {
+            throw std::runtime_error(filepath + " is not a binary glTF 2.0 file");
+        }
+        size = readWord(8);
+
+        // chunks: JSON first, then an optional BIN, each 4-byte aligned
+        const char *json = nullptr;
+        size_t jsonSize = 0;
+        const uint8_t *bin = nullptr;
+        uint64_t binSize = 0;
+        size_t offset = 12;
+        while (offset + 8 <= size)
+        {
+            uint32_t chunkLength = readWord(offset);
+            uint32_t chunkType = readWord(offset + 4);
+            if (chunkLength > size - offset - 8)
+            {
+                throw std::runtime_error(filepath + " has a truncated chunk");
+            }
+            if (chunkType == CHUNK_JSON && json == nullptr)
+            {
+                json = reinterpret_cast<const char *>(data + offset + 8);
+                jsonSize = chunkLength;
+            }
+            else if (chunkType == CHUNK_BIN && bin == nullptr)
+            {
+                bin = data + offset + 8;
+                binSize = chunkLength;
+            }
+            offset += 8 + ((static_cast<size_t>(chunkLength) + 3) & ~size_t{3});
+        }
+        if (json == nullptr)
+        {
+            throw std::runtime_error(filepath + " has no JSON chunk");
+        }
+
+        JsonValue root = JsonParser{json, jsonSize}.parseDocument();
+        std::shared_ptr<CFXGlbFile> glb{new CFXGlbFile()};
+        glb->file = std::move(file);
+
+        const JsonValue *meshes = root.find("meshes");
+        if (meshes == nullptr || meshes->type != JsonValue::Type::Array)
+        {
+            return glb;
+        }
+        for (const JsonValue &mesh : meshes->items)
+        {
+            const JsonValue &primitives = requireMember(mesh, "primitives");
+            for (const JsonValue &primitive : primitives.items)
+            {
+                // 4 is TRIANGLES, strips and fans would need unrolling
+                if (optionalUnsigned(primitive, "mode", 4) != 4)
+                {
+                    throw std::runtime_error(filepath + ": only triangle list primitives are supported");
+                }
+                const JsonValue &attributes = requireMember(primitive, "attributes");
+                auto attribute = [&](const char *name)
+                {
+                    const JsonValue *index = attributes.find(name);
+                    return index != nullptr ? resolveAccessor(root, toUnsigned(*index, name), bin, binSize) : Accessor{};
+                };
+
+                Primitive resolved{};
+                resolved.position = attribute("POSITION");
+                if (!resolved.position.valid() || resolved.position.componentType != FLOAT || resolved.position.components != 3)
+                {
+                    throw std::runtime_error(filepath + ": POSITION must be a float VEC3 accessor");
+                }
+                resolved.normal = attribute("NORMAL");
+                resolved.texcoord = attribute("TEXCOORD_0");
+                resolved.color = attribute("COLOR_0");
+                checkAttribute(resolved.normal, "NORMAL", 3, 3, false, resolved.position.count);
+                checkAttribute(resolved.texcoord, "TEXCOORD_0", 2, 2, false, resolved.position.count);
+                checkAttribute(resolved.color, "COLOR_0", 3, 4, true, resolved.position.count);
+
+                const JsonValue *indices = primitive.find("indices");
+                if (indices != nullptr)
+                {
+                    resolved.indices = resolveAccessor(root, toUnsigned(*indices, "indices"), bin, binSize);
+                    const Accessor &accessor = resolved.indices;
+                    if (accessor.components != 1 || (accessor.componentType != UNSIGNED_BYTE && accessor.componentType != UNSIGNED_SHORT &&
+                                                      accessor.componentType != UNSIGNED_INT))
+                    {
+                        throw std::runtime_error(filepath + ": indices must be an unsigned SCALAR accessor");
+                    }
+                }
+                glb->primitives.push_back(resolved);
+            }
+        }
+        return glb;
+    }
+}
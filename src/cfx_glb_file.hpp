@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cfx_mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Memory-mapped binary glTF 2.0 (.glb) file.
+     *
+     * The JSON chunk is parsed just far enough to collect the triangle primitives of every
+     * mesh. Their accessors are validated against the BIN chunk and handed out as pointers
+     * into the mapping, so attribute data is read where it lies. Node
+     * transforms, materials, external buffers and sparse accessors are not supported.
+     */
+    class CFXGlbFile
+    {
+    public:
+        static constexpr uint32_t MAGIC = 0x46546c67;      // "glTF"
+        static constexpr uint32_t VERSION = 2;
+        static constexpr uint32_t CHUNK_JSON = 0x4e4f534a; // "JSON"
+        static constexpr uint32_t CHUNK_BIN = 0x004e4942;  // "BIN\0"
+
+        enum ComponentType : uint32_t
+        {
+            UNSIGNED_BYTE = 5121,
+            UNSIGNED_SHORT = 5123,
+            UNSIGNED_INT = 5125,
+            FLOAT = 5126
+        };
+
+        // Every element lies inside the BIN chunk and its components are naturally aligned
+        struct Accessor
+        {
+            const uint8_t *data = nullptr;
+            uint32_t count = 0;
+            // bytes from one element to the next
+            uint32_t stride = 0;
+            uint32_t componentType = 0;
+            uint32_t components = 0;
+            // for glTF normalized integer attributes
+            bool normalized = false;
+            uint32_t bufferView = UINT32_MAX;
+            // one past the last byte of the bufferView
+            const uint8_t *viewEnd = nullptr;
+            bool valid() const { return data != nullptr; }
+        };
+
+        // position is always present, indices is invalid for non-indexed primitives
+        struct Primitive
+        {
+            Accessor position;
+            Accessor normal;
+            Accessor texcoord;
+            Accessor color;
+            Accessor indices;
+        };
+
+        CFXGlbFile(const CFXGlbFile &) = delete;
+        CFXGlbFile &operator=(const CFXGlbFile &) = delete;
+
+        // Throws std::runtime_error if the file is missing, malformed or uses unsupported features.
+        // file holds its bytes if they were already read, it is opened otherwise.
+        static std::shared_ptr<CFXGlbFile> open(const std::string &filepath, std::shared_ptr<CFXMappedFile> file = nullptr);
+
+        const std::vector<Primitive> &getPrimitives() const { return primitives; }
+
+    private:
+        CFXGlbFile() = default;
+
+        std::shared_ptr<CFXMappedFile> file{};
+        std::vector<Primitive> primitives{};
+    };
+}
@@ -0,0 +1,80 @@
+#include "cfx_gpu_timer.hpp"
+
+#include <stdexcept>
+
+namespace cfx
+{
+    CFXGpuTimer::CFXGpuTimer(CFXDevice &device) : cfxDevice{device}
+    {
+        deviceStates.resize(cfxDevice.getDevicesinDeviceGroup());
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            uint32_t validBits = cfxDevice.findPhysicalQueueFamilies(i).graphicsTimestampValidBits;
+            if (validBits == 0)
+            {
+                continue;
+            }
+
+            DeviceState &state = deviceStates[i];
+            state.timestampPeriod = cfxDevice.properties[i].limits.timestampPeriod;
+            state.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = 2 * CFXSwapChain::MAX_FRAMES_IN_FLIGHT;
+            if (vkCreateQueryPool(cfxDevice.device(i), &poolInfo, nullptr, &state.queryPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+        }
+    }
+
+    CFXGpuTimer::~CFXGpuTimer()
+    {
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            if (deviceStates[i].queryPool == VK_NULL_HANDLE)
+            {
+                continue;
+            }
+            // frames in flight still write their timestamps into it
+            VkDevice device = cfxDevice.device(i);
+            cfxDevice.getDeletionQueue(i).defer([device, queryPool = deviceStates[i].queryPool]
+                                                { vkDestroyQueryPool(device, queryPool, nullptr); });
+        }
+    }
+
+    void CFXGpuTimer::beginFrame(VkCommandBuffer commandBuffer, int deviceIndex, int frameIndex)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        if (state.queryPool == VK_NULL_HANDLE)
+        {
+            return;
+        }
+        uint32_t firstQuery = 2 * frameIndex;
+        if (state.written[frameIndex])
+        {
+            uint64_t timestamps[2];
+            if (vkGetQueryPoolResults(cfxDevice.device(deviceIndex), state.queryPool, firstQuery, 2, sizeof(timestamps), timestamps,
+                                      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+            {
+                uint64_t ticks = ((timestamps[1] & state.timestampMask) - (timestamps[0] & state.timestampMask)) & state.timestampMask;
+                state.frameTime = static_cast<float>(ticks * static_cast<double>(state.timestampPeriod) / 1e6);
+            }
+        }
+        vkCmdResetQueryPool(commandBuffer, state.queryPool, firstQuery, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, state.queryPool, firstQuery);
+    }
+
+    void CFXGpuTimer::endFrame(VkCommandBuffer commandBuffer, int deviceIndex, int frameIndex)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        if (state.queryPool == VK_NULL_HANDLE)
+        {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, state.queryPool, 2 * frameIndex + 1);
+        state.written[frameIndex] = true;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "cfx_device.hpp"
+#include "cfx_swapchain.hpp"
+
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Measures how long each device's GPU spends on a frame with timestamp queries.
+     *
+     * Every frame in flight owns a pair of queries in a per-device pool, written at the top
+     * and the bottom of its command buffer. A slot is only recorded again once its in flight
+     * fence has signaled, so beginFrame() reads the slot's previous pair without stalling
+     * before resetting it. The times lag the CPU by the frames in flight.
+     */
+    class CFXGpuTimer
+    {
+    public:
+        CFXGpuTimer(CFXDevice &device);
+        ~CFXGpuTimer();
+        CFXGpuTimer(const CFXGpuTimer &) = delete;
+        CFXGpuTimer &operator=(const CFXGpuTimer &) = delete;
+
+        // Call right after vkBeginCommandBuffer, once the frame's in flight fence was waited on
+        void beginFrame(VkCommandBuffer commandBuffer, int deviceIndex, int frameIndex);
+        // Call right before vkEndCommandBuffer
+        void endFrame(VkCommandBuffer commandBuffer, int deviceIndex, int frameIndex);
+
+        // False when the device's graphics queue has no timestamps, its frame time then stays 0
+        bool isSupported(int deviceIndex) const { return deviceStates[deviceIndex].queryPool != VK_NULL_HANDLE; }
+        // Milliseconds the device's latest finished frame took on the GPU
+        float getFrameTime(int deviceIndex) const { return deviceStates[deviceIndex].frameTime; }
+
+    private:
+        struct DeviceState
+        {
+            VkQueryPool queryPool = VK_NULL_HANDLE;
+            // nanoseconds per tick
+            float timestampPeriod = 0.f;
+            uint64_t timestampMask = 0;
+            bool written[CFXSwapChain::MAX_FRAMES_IN_FLIGHT] = {};
+            float frameTime = 0.f;
+        };
+
+        CFXDevice &cfxDevice;
+        std::vector<DeviceState> deviceStates;
+    };
+}
@@ -0,0 +1,176 @@
+#include "cfx_lz4.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace cfx
+{
+    static constexpr size_t MIN_MATCH = 4;
+    // the format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+    static constexpr size_t LAST_LITERALS = 5;
+    static constexpr size_t MATCH_START_LIMIT = 12;
+    static constexpr size_t MAX_OFFSET = 65535;
+    static constexpr int HASH_BITS = 14;
+
+    static uint32_t read32(const uint8_t *p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hashSequence(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static uint8_t *writeLength(uint8_t *op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *op++ = 255;
+        }
+        *op++ = static_cast<uint8_t>(length);
+        return op;
+    }
+
+    static uint8_t *writeSequence(uint8_t *op, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+        uint8_t *token = op++;
+        *token = static_cast<uint8_t>((literalLength >= 15 ? 15 : literalLength) << 4);
+        if (literalLength >= 15)
+        {
+            op = writeLength(op, literalLength - 15);
+        }
+        memcpy(op, literals, literalLength);
+        op += literalLength;
+        if (matchLength == 0)
+        {
+            return op;
+        }
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        size_t length = matchLength - MIN_MATCH;
+        *token |= static_cast<uint8_t>(length >= 15 ? 15 : length);
+        if (length >= 15)
+        {
+            op = writeLength(op, length - 15);
+        }
+        return op;
+    }
+
+    size_t CFXLz4::compress(const uint8_t *src, size_t srcSize, uint8_t *dst)
+    {
+        uint8_t *op = dst;
+        size_t anchor = 0;
+        if (srcSize > MATCH_START_LIMIT)
+        {
+            // positions are only hints, every candidate is verified before it is used
+            std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+            size_t matchStartLimit = srcSize - MATCH_START_LIMIT;
+            size_t matchEndLimit = srcSize - LAST_LITERALS;
+            size_t ip = 0;
+            while (ip < matchStartLimit)
+            {
+                uint32_t sequence = read32(src + ip);
+                uint32_t &slot = table[hashSequence(sequence)];
+                size_t candidate = slot;
+                slot = static_cast<uint32_t>(ip);
+                if (candidate >= ip || ip - candidate > MAX_OFFSET || read32(src + candidate) != sequence)
+                {
+                    ip++;
+                    continue;
+                }
+                size_t length = MIN_MATCH;
+                while (ip + length < matchEndLimit && src[candidate + length] == src[ip + length])
+                {
+                    length++;
+                }
+                while (ip > anchor && candidate > 0 && src[ip - 1] == src[candidate - 1])
+                {
+                    ip--;
+                    candidate--;
+                    length++;
+                }
+                op = writeSequence(op, src + anchor, ip - anchor, ip - candidate, length);
+                ip += length;
+                anchor = ip;
+            }
+        }
+        op = writeSequence(op, src + anchor, srcSize - anchor, 0, 0);
+        return static_cast<size_t>(op - dst);
+    }
+
+    static bool readLength(const uint8_t *src, size_t srcSize, size_t &ip, size_t &length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip >= srcSize)
+            {
+                return false;
+            }
+            byte = src[ip++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool CFXLz4::decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize)
+    {
+        size_t ip = 0;
+        size_t op = 0;
+        while (ip < srcSize)
+        {
+            uint8_t token = src[ip++];
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(src, srcSize, ip, literalLength))
+            {
+                return false;
+            }
+            if (literalLength > srcSize - ip || literalLength > dstSize - op)
+            {
+                return false;
+            }
+            memcpy(dst + op, src + ip, literalLength);
+            ip += literalLength;
+            op += literalLength;
+            if (ip == srcSize)
+            {
+                // the last sequence has no match
+                return op == dstSize;
+            }
+
+            if (srcSize - ip < 2)
+            {
+                return false;
+            }
+            size_t offset = src[ip] | size_t(src[ip + 1]) << 8;
+            ip += 2;
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !readLength(src, srcSize, ip, matchLength))
+            {
+                return false;
+            }
+            matchLength += MIN_MATCH;
+            if (offset == 0 || offset > op || matchLength > dstSize - op)
+            {
+                return false;
+            }
+            if (offset >= matchLength)
+            {
+                memcpy(dst + op, dst + op - offset, matchLength);
+                op += matchLength;
+            }
+            else
+            {
+                // overlapping copy repeats the last offset bytes
+                for (size_t i = 0; i < matchLength; i++, op++)
+                {
+                    dst[op] = dst[op - offset];
+                }
+            }
+        }
+        return false;
+    }
+}
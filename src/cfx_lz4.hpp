@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cfx
+{
+    /*
+     * LZ4 block format codec.
+     *
+     * compress() is a greedy single-probe matcher in the spirit of LZ4's fast mode, good
+     * enough for packing assets at build time. decompress() checks every length and offset
+     * against both buffers, so a corrupt block fails instead of reading or writing out of
+     * bounds. Blocks are compatible with the reference implementation's
+     * LZ4_compress_default / LZ4_decompress_safe.
+     */
+    class CFXLz4
+    {
+    public:
+        // Largest output compress() can produce for srcSize input bytes
+        static size_t compressBound(size_t srcSize) { return srcSize + srcSize / 255 + 16; }
+
+        // dst must hold compressBound(srcSize) bytes, returns the compressed size
+        static size_t compress(const uint8_t *src, size_t srcSize, uint8_t *dst);
+
+        // True if src decodes to exactly dstSize bytes
+        static bool decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+    };
+}
@@ -0,0 +1,100 @@
+#include "cfx_mapped_file.hpp"
+#include "cfx_asset_archive.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cfx
+{
+    CFXMappedFile::~CFXMappedFile()
+    {
+        if (mapped)
+        {
+            munmap(const_cast<uint8_t *>(bytes), byteSize);
+        }
+    }
+
+    std::shared_ptr<CFXMappedFile> CFXMappedFile::open(const std::string &filepath)
+    {
+        if (const std::shared_ptr<CFXAssetArchive> &archive = CFXAssetArchive::mounted())
+        {
+            if (const CFXAssetArchive::Entry *entry = archive->find(filepath))
+            {
+                return archive->read(*entry);
+            }
+        }
+        return map(filepath);
+    }
+
+    std::shared_ptr<CFXMappedFile> CFXMappedFile::map(const std::string &filepath)
+    {
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        std::shared_ptr<CFXMappedFile> file{new CFXMappedFile()};
+        file->byteSize = static_cast<size_t>(fileStat.st_size);
+        if (file->byteSize > 0)
+        {
+            void *mapping = mmap(nullptr, file->byteSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                return nullptr;
+            }
+            file->bytes = static_cast<const uint8_t *>(mapping);
+            file->mapped = true;
+        }
+        close(fd);
+        return file;
+    }
+
+    bool CFXMappedFile::query(const std::string &filepath, uint64_t &size, int64_t &time)
+    {
+        if (const std::shared_ptr<CFXAssetArchive> &archive = CFXAssetArchive::mounted())
+        {
+            if (const CFXAssetArchive::Entry *entry = archive->find(filepath))
+            {
+                size = entry->size;
+                time = entry->time;
+                return true;
+            }
+        }
+        struct stat fileStat{};
+        if (stat(filepath.c_str(), &fileStat) != 0)
+        {
+            return false;
+        }
+        size = static_cast<uint64_t>(fileStat.st_size);
+        time = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+        return true;
+    }
+
+    std::shared_ptr<CFXMappedFile> CFXMappedFile::fromBuffer(std::vector<uint8_t> &&buffer)
+    {
+        std::shared_ptr<CFXMappedFile> file{new CFXMappedFile()};
+        file->buffer = std::move(buffer);
+        file->bytes = file->buffer.data();
+        file->byteSize = file->buffer.size();
+        return file;
+    }
+
+    std::shared_ptr<CFXMappedFile> CFXMappedFile::view(std::shared_ptr<const void> owner, const uint8_t *data, size_t size)
+    {
+        std::shared_ptr<CFXMappedFile> file{new CFXMappedFile()};
+        file->owner = std::move(owner);
+        file->bytes = data;
+        file->byteSize = size;
+        return file;
+    }
+}
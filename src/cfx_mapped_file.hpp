@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Read-only bytes of a whole file. Usually a memory mapping, unmapped on destruction;
+     * files served from the mounted CFXAssetArchive are either a view into the archive's
+     * mapping or a decompressed copy, and CFXFileReader hands out views of its read buffers.
+     */
+    class CFXMappedFile
+    {
+    public:
+        ~CFXMappedFile();
+        CFXMappedFile(const CFXMappedFile &) = delete;
+        CFXMappedFile &operator=(const CFXMappedFile &) = delete;
+
+        // Looks in the mounted asset archive first, then on disk. Returns nullptr if neither has the file
+        static std::shared_ptr<CFXMappedFile> open(const std::string &filepath);
+        // Disk only, returns nullptr if the file cannot be opened or mapped
+        static std::shared_ptr<CFXMappedFile> map(const std::string &filepath);
+        // Size and modification time in nanoseconds of the file open() would return
+        static bool query(const std::string &filepath, uint64_t &size, int64_t &time);
+
+        // Takes over bytes decoded in memory
+        static std::shared_ptr<CFXMappedFile> fromBuffer(std::vector<uint8_t> &&buffer);
+        // Bytes owned by something else, such as another mapping or a pooled read buffer, kept alive by the view
+        static std::shared_ptr<CFXMappedFile> view(std::shared_ptr<const void> owner, const uint8_t *data, size_t size);
+
+        const uint8_t *data() const { return bytes; }
+        size_t size() const { return byteSize; }
+
+    private:
+        CFXMappedFile() = default;
+
+        const uint8_t *bytes = nullptr;
+        size_t byteSize = 0;
+        bool mapped = false;
+        std::vector<uint8_t> buffer{};
+        std::shared_ptr<const void> owner{};
+    };
+}
@@ -0,0 +1,646 @@
+#include "cfx_memory_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace cfx
+{
+    static constexpr uint32_t NIL_NODE = UINT32_MAX;
+
+    struct CFXMemoryAllocator::Block
+    {
+        struct Node
+        {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            // neighbours in address order
+            uint32_t prevPhysical;
+            uint32_t nextPhysical;
+            // neighbours in the free list of the node's size class, only while free
+            uint32_t prevFree;
+            uint32_t nextFree;
+            bool free;
+        };
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryType = 0;
+        bool dedicated = false;
+        void *mapped = nullptr;
+        uint32_t mapCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize allocatedBytes = 0;
+
+        // TLSF state, unused by dedicated blocks
+        uint64_t flBitmap = 0;
+        uint32_t slBitmaps[FL_COUNT]{};
+        uint32_t freeHeads[FL_COUNT * SL_COUNT];
+        std::vector<Node> nodes;
+        std::vector<uint32_t> spareNodes;
+
+        void init();
+        uint32_t allocate(VkDeviceSize allocationSize, VkDeviceSize alignment);
+        void release(uint32_t node);
+        VkDeviceSize largestFreeRange() const;
+        uint32_t newNode();
+        void insertFree(uint32_t node);
+        void removeFree(uint32_t node);
+        uint32_t findFree(VkDeviceSize searchSize) const;
+    };
+
+    static uint32_t log2Floor(uint64_t value)
+    {
+        return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+    }
+
+    static void sizeClass(VkDeviceSize size, uint32_t &fl, uint32_t &sl)
+    {
+        constexpr uint32_t slBits = CFXMemoryAllocator::SL_BITS;
+        constexpr uint32_t slCount = CFXMemoryAllocator::SL_COUNT;
+        if (size < slCount)
+        {
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+        uint32_t log2 = log2Floor(size);
+        fl = log2 - slBits + 1;
+        sl = static_cast<uint32_t>(size >> (log2 - slBits)) - slCount;
+    }
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void CFXMemoryAllocator::Block::init()
+    {
+        std::fill(std::begin(freeHeads), std::end(freeHeads), NIL_NODE);
+        nodes.push_back(Node{0, size, NIL_NODE, NIL_NODE, NIL_NODE, NIL_NODE, false});
+        insertFree(0);
+    }
+
+    uint32_t CFXMemoryAllocator::Block::newNode()
+    {
+        if (!spareNodes.empty())
+        {
+            uint32_t node = spareNodes.back();
+            spareNodes.pop_back();
+            return node;
+        }
+        nodes.push_back(Node{});
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    void CFXMemoryAllocator::Block::insertFree(uint32_t node)
+    {
+        uint32_t fl, sl;
+        sizeClass(nodes[node].size, fl, sl);
+        uint32_t &head = freeHeads[fl * SL_COUNT + sl];
+        nodes[node].free = true;
+        nodes[node].prevFree = NIL_NODE;
+        nodes[node].nextFree = head;
+        if (head != NIL_NODE)
+        {
+            nodes[head].prevFree = node;
+        }
+        head = node;
+        flBitmap |= 1ull << fl;
+        slBitmaps[fl] |= 1u << sl;
+    }
+
+    void CFXMemoryAllocator::Block::removeFree(uint32_t node)
+    {
+        Node &entry = nodes[node];
+        if (entry.prevFree != NIL_NODE)
+        {
+            nodes[entry.prevFree].nextFree = entry.nextFree;
+        }
+        else
+        {
+            uint32_t fl, sl;
+            sizeClass(entry.size, fl, sl);
+            freeHeads[fl * SL_COUNT + sl] = entry.nextFree;
+            if (entry.nextFree == NIL_NODE)
+            {
+                slBitmaps[fl] &= ~(1u << sl);
+                if (slBitmaps[fl] == 0)
+                {
+                    flBitmap &= ~(1ull << fl);
+                }
+            }
+        }
+        if (entry.nextFree != NIL_NODE)
+        {
+            nodes[entry.nextFree].prevFree = entry.prevFree;
+        }
+        entry.free = false;
+    }
+
+    uint32_t CFXMemoryAllocator::Block::findFree(VkDeviceSize searchSize) const
+    {
+        // round up to the next class boundary so every node in the class found is large enough
+        if (searchSize >= SL_COUNT)
+        {
+            searchSize += (VkDeviceSize{1} << (log2Floor(searchSize) - SL_BITS)) - 1;
+        }
+        uint32_t fl, sl;
+        sizeClass(searchSize, fl, sl);
+        if (fl >= FL_COUNT)
+        {
+            return NIL_NODE;
+        }
+        uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+        if (slMap == 0)
+        {
+            uint64_t flMap = flBitmap & (~0ull << (fl + 1));
+            if (flMap == 0)
+            {
+                return NIL_NODE;
+            }
+            fl = static_cast<uint32_t>(__builtin_ctzll(flMap));
+            slMap = slBitmaps[fl];
+        }
+        sl = static_cast<uint32_t>(__builtin_ctz(slMap));
+        return freeHeads[fl * SL_COUNT + sl];
+    }
+
+    uint32_t CFXMemoryAllocator::Block::allocate(VkDeviceSize allocationSize, VkDeviceSize alignment)
+    {
+        uint32_t node = findFree(allocationSize + alignment - 1);
+        if (node == NIL_NODE)
+        {
+            // the rounded search skips the nodes of the request's own class, one of them may still fit
+            uint32_t fl, sl;
+            sizeClass(allocationSize, fl, sl);
+            for (uint32_t candidate = freeHeads[fl * SL_COUNT + sl]; candidate != NIL_NODE; candidate = nodes[candidate].nextFree)
+            {
+                const Node &entry = nodes[candidate];
+                if (alignUp(entry.offset, alignment) + allocationSize <= entry.offset + entry.size)
+                {
+                    node = candidate;
+                    break;
+                }
+            }
+            if (node == NIL_NODE)
+            {
+                return NIL_NODE;
+            }
+        }
+        removeFree(node);
+
+        // the physical neighbours of a free node are in use, so the padding and the tail are free nodes of their own
+        VkDeviceSize padding = alignUp(nodes[node].offset, alignment) - nodes[node].offset;
+        if (padding > 0)
+        {
+            uint32_t front = newNode();
+            Node &entry = nodes[node];
+            nodes[front] = Node{entry.offset, padding, entry.prevPhysical, node, NIL_NODE, NIL_NODE, false};
+            if (entry.prevPhysical != NIL_NODE)
+            {
+                nodes[entry.prevPhysical].nextPhysical = front;
+            }
+            entry.prevPhysical = front;
+            entry.offset += padding;
+            entry.size -= padding;
+            insertFree(front);
+        }
+        if (nodes[node].size > allocationSize)
+        {
+            uint32_t tail = newNode();
+            Node &entry = nodes[node];
+            nodes[tail] = Node{entry.offset + allocationSize, entry.size - allocationSize, node, entry.nextPhysical, NIL_NODE, NIL_NODE, false};
+            if (entry.nextPhysical != NIL_NODE)
+            {
+                nodes[entry.nextPhysical].prevPhysical = tail;
+            }
+            entry.nextPhysical = tail;
+            entry.size = allocationSize;
+            insertFree(tail);
+        }
+        allocationCount++;
+        allocatedBytes += allocationSize;
+        return node;
+    }
+
+    void CFXMemoryAllocator::Block::release(uint32_t node)
+    {
+        allocationCount--;
+        allocatedBytes -= nodes[node].size;
+
+        uint32_t prev = nodes[node].prevPhysical;
+        if (prev != NIL_NODE && nodes[prev].free)
+        {
+            removeFree(prev);
+            nodes[prev].size += nodes[node].size;
+            nodes[prev].nextPhysical = nodes[node].nextPhysical;
+            if (nodes[node].nextPhysical != NIL_NODE)
+            {
+                nodes[nodes[node].nextPhysical].prevPhysical = prev;
+            }
+            spareNodes.push_back(node);
+            node = prev;
+        }
+        uint32_t next = nodes[node].nextPhysical;
+        if (next != NIL_NODE && nodes[next].free)
+        {
+            removeFree(next);
+            nodes[node].size += nodes[next].size;
+            nodes[node].nextPhysical = nodes[next].nextPhysical;
+            if (nodes[next].nextPhysical != NIL_NODE)
+            {
+                nodes[nodes[next].nextPhysical].prevPhysical = node;
+            }
+            spareNodes.push_back(next);
+        }
+        insertFree(node);
+    }
+
+    VkDeviceSize CFXMemoryAllocator::Block::largestFreeRange() const
+    {
+        if (flBitmap == 0)
+        {
+            return 0;
+        }
+        uint32_t fl = log2Floor(flBitmap);
+        uint32_t sl = log2Floor(slBitmaps[fl]);
+        VkDeviceSize largest = 0;
+        for (uint32_t node = freeHeads[fl * SL_COUNT + sl]; node != NIL_NODE; node = nodes[node].nextFree)
+        {
+            largest = std::max(largest, nodes[node].size);
+        }
+        return largest;
+    }
+
+    CFXMemoryAllocator::CFXMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetSupported)
+        : device{device}, memoryTypes{physicalDevice, device, 1, memoryBudgetSupported}
+    {
+        const VkPhysicalDeviceMemoryProperties &memoryProperties = memoryTypes.getProperties();
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+        blocks.resize(memoryProperties.memoryTypeCount);
+        blockSizes.resize(memoryProperties.memoryTypeCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+            blockSizes[i] = std::min(DEFAULT_BLOCK_SIZE, std::max<VkDeviceSize>(heapSize / SMALL_HEAP_BLOCK_DIVISOR, 1));
+        }
+    }
+
+    CFXMemoryAllocator::~CFXMemoryAllocator()
+    {
+        for (auto &typeBlocks : blocks)
+        {
+            for (auto &block : typeBlocks)
+            {
+                if (block->mapped)
+                {
+                    vkUnmapMemory(device, block->memory);
+                }
+                vkFreeMemory(device, block->memory, nullptr);
+            }
+        }
+    }
+
+    CFXMemoryAllocator::Block *CFXMemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated,
+                                                               const VkMemoryDedicatedAllocateInfo *dedicatedInfo)
+    {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = dedicatedInfo;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+        {
+            return nullptr;
+        }
+        heapReserved[memoryTypes.getHeapIndex(memoryType)] += size;
+        auto block = std::make_unique<Block>();
+        block->memory = memory;
+        block->size = size;
+        block->memoryType = memoryType;
+        block->dedicated = dedicated;
+        if (!block->dedicated)
+        {
+            block->init();
+        }
+        blocks[memoryType].push_back(std::move(block));
+        return blocks[memoryType].back().get();
+    }
+
+    void CFXMemoryAllocator::destroyBlock(Block *block)
+    {
+        if (block->mapped)
+        {
+            vkUnmapMemory(device, block->memory);
+        }
+        vkFreeMemory(device, block->memory, nullptr);
+        heapReserved[memoryTypes.getHeapIndex(block->memoryType)] -= block->size;
+        auto &typeBlocks = blocks[block->memoryType];
+        typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(),
+                                      [block](const std::unique_ptr<Block> &entry)
+                                      { return entry.get() == block; }));
+    }
+
+    bool CFXMemoryAllocator::fitsBudget(uint32_t heap, VkDeviceSize size) const
+    {
+        VkDeviceSize used = heapReserved[heap];
+        if (memoryTypes.hasMemoryBudget())
+        {
+            // the driver's figure also counts memory allocated behind our back, the swapchain images to begin with
+            used = std::max(used, memoryTypes.getHeapUsage(heap));
+        }
+        return used + size <= memoryTypes.getHeapBudget(heap);
+    }
+
+    bool CFXMemoryAllocator::allocateFromType(uint32_t memoryType, VkDeviceSize size, VkDeviceSize alignment,
+                                              const VkMemoryDedicatedAllocateInfo *dedicatedInfo, bool prefersDedicated,
+                                              bool withinBudget, Allocation &allocation)
+    {
+        uint32_t heap = memoryTypes.getHeapIndex(memoryType);
+        allocation.memoryType = memoryType;
+
+        VkDeviceSize blockSize = blockSizes[memoryType];
+        if (!prefersDedicated && size <= blockSize / 2)
+        {
+            for (auto &block : blocks[memoryType])
+            {
+                if (block->dedicated)
+                {
+                    continue;
+                }
+                uint32_t node = block->allocate(size, alignment);
+                if (node != NIL_NODE)
+                {
+                    allocation.block = block.get();
+                    allocation.node = node;
+                    break;
+                }
+            }
+            // a smaller block may still fit when the heap is nearly full
+            for (VkDeviceSize newBlockSize = blockSize; !allocation.block && newBlockSize >= size * 2; newBlockSize /= 2)
+            {
+                if (withinBudget && !fitsBudget(heap, newBlockSize))
+                {
+                    continue;
+                }
+                if (Block *block = createBlock(memoryType, newBlockSize, false, nullptr))
+                {
+                    allocation.block = block;
+                    allocation.node = block->allocate(size, alignment);
+                }
+            }
+            if (allocation.block)
+            {
+                allocation.memory = allocation.block->memory;
+                allocation.offset = allocation.block->nodes[allocation.node].offset;
+                allocation.size = size;
+                return true;
+            }
+        }
+
+        if (withinBudget && !fitsBudget(heap, size))
+        {
+            return false;
+        }
+        Block *block = createBlock(memoryType, size, true, dedicatedInfo);
+        if (!block)
+        {
+            return false;
+        }
+        block->allocationCount = 1;
+        block->allocatedBytes = size;
+        allocation.memory = block->memory;
+        allocation.size = size;
+        allocation.dedicated = true;
+        allocation.block = block;
+        return true;
+    }
+
+    CFXMemoryAllocator::Allocation CFXMemoryAllocator::allocate(
+        const VkMemoryRequirements &requirements,
+        CFXMemoryTypeTable::Usage usage,
+        VkMemoryPropertyFlags properties,
+        ResourceKind kind,
+        const VkMemoryDedicatedAllocateInfo *dedicatedInfo,
+        bool prefersDedicated)
+    {
+        VkDeviceSize size = std::max<VkDeviceSize>(requirements.size, 1);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        if (kind == ResourceKind::Optimal)
+        {
+            // whole granularity pages, so a neighbouring buffer can never share one
+            alignment = std::max(alignment, bufferImageGranularity);
+            size = alignUp(size, bufferImageGranularity);
+        }
+
+        std::vector<uint32_t> candidates;
+        for (uint32_t memoryType : memoryTypes.rank(usage, properties))
+        {
+            if (requirements.memoryTypeBits & (1u << memoryType))
+            {
+                candidates.push_back(memoryType);
+            }
+        }
+        if (candidates.empty())
+        {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            // heaps over budget are passed over while there is another type to fall back to
+            bool withinBudget = i + 1 < candidates.size();
+            Allocation allocation{};
+            if (allocateFromType(candidates[i], size, alignment, dedicatedInfo, prefersDedicated, withinBudget, allocation))
+            {
+                return allocation;
+            }
+        }
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    void CFXMemoryAllocator::free(Allocation &allocation)
+    {
+        if (!allocation.block)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        Block *block = allocation.block;
+        if (block->dedicated)
+        {
+            destroyBlock(block);
+        }
+        else
+        {
+            block->release(allocation.node);
+            if (block->allocationCount == 0)
+            {
+                // keep one empty block per type around so a free and allocate pair does not hit the driver
+                auto &typeBlocks = blocks[block->memoryType];
+                bool otherEmpty = std::any_of(typeBlocks.begin(), typeBlocks.end(),
+                                              [block](const std::unique_ptr<Block> &entry)
+                                              { return entry.get() != block && !entry->dedicated && entry->allocationCount == 0; });
+                if (otherEmpty)
+                {
+                    destroyBlock(block);
+                }
+            }
+        }
+        allocation = Allocation{};
+    }
+
+    VkResult CFXMemoryAllocator::map(const Allocation &allocation, void **data)
+    {
+        assert(allocation.block && "Called map on an empty allocation");
+        std::lock_guard<std::mutex> lock{mutex};
+        Block *block = allocation.block;
+        if (block->mapCount == 0)
+        {
+            VkResult result = vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+            if (result != VK_SUCCESS)
+            {
+                block->mapped = nullptr;
+                return result;
+            }
+        }
+        block->mapCount++;
+        *data = static_cast<char *>(block->mapped) + allocation.offset;
+        return VK_SUCCESS;
+    }
+
+    void CFXMemoryAllocator::unmap(const Allocation &allocation)
+    {
+        assert(allocation.block && "Called unmap on an empty allocation");
+        std::lock_guard<std::mutex> lock{mutex};
+        Block *block = allocation.block;
+        assert(block->mapCount > 0 && "Unbalanced unmap");
+        if (--block->mapCount == 0)
+        {
+            vkUnmapMemory(device, block->memory);
+            block->mapped = nullptr;
+        }
+    }
+
+    bool CFXMemoryAllocator::isCoherent(const Allocation &allocation) const
+    {
+        return (memoryTypes.getFlags(allocation.memoryType) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    std::vector<VkMappedMemoryRange> CFXMemoryAllocator::mappedRanges(const Allocation &allocation, const Range *ranges, uint32_t rangeCount) const
+    {
+        // widen to whole atoms in memory object coordinates, the allocation itself need not start on one
+        std::vector<std::pair<VkDeviceSize, VkDeviceSize>> atoms;
+        atoms.reserve(rangeCount);
+        for (uint32_t i = 0; i < rangeCount; i++)
+        {
+            VkDeviceSize begin = allocation.offset + ranges[i].offset;
+            VkDeviceSize end = ranges[i].size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + ranges[i].size;
+            atoms.emplace_back(begin / nonCoherentAtomSize * nonCoherentAtomSize, alignUp(end, nonCoherentAtomSize));
+        }
+        std::sort(atoms.begin(), atoms.end());
+
+        std::vector<VkMappedMemoryRange> mapped;
+        for (const auto &atom : atoms)
+        {
+            if (!mapped.empty() && atom.first <= mapped.back().offset + mapped.back().size)
+            {
+                mapped.back().size = std::max(mapped.back().size, atom.second - mapped.back().offset);
+                continue;
+            }
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = allocation.memory;
+            range.offset = atom.first;
+            range.size = atom.second - atom.first;
+            mapped.push_back(range);
+        }
+        // the last atom may reach past the end of the memory object, which only VK_WHOLE_SIZE may cover
+        if (!mapped.empty() && mapped.back().offset + mapped.back().size >= allocation.block->size)
+        {
+            mapped.back().size = VK_WHOLE_SIZE;
+        }
+        return mapped;
+    }
+
+    VkResult CFXMemoryAllocator::flush(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        Range range{offset, size};
+        return flush(allocation, &range, 1);
+    }
+
+    VkResult CFXMemoryAllocator::flush(const Allocation &allocation, const Range *ranges, uint32_t rangeCount)
+    {
+        if (isCoherent(allocation) || rangeCount == 0)
+        {
+            return VK_SUCCESS;
+        }
+        std::vector<VkMappedMemoryRange> mapped = mappedRanges(allocation, ranges, rangeCount);
+        return vkFlushMappedMemoryRanges(device, static_cast<uint32_t>(mapped.size()), mapped.data());
+    }
+
+    VkResult CFXMemoryAllocator::invalidate(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        Range range{offset, size};
+        return invalidate(allocation, &range, 1);
+    }
+
+    VkResult CFXMemoryAllocator::invalidate(const Allocation &allocation, const Range *ranges, uint32_t rangeCount)
+    {
+        if (isCoherent(allocation) || rangeCount == 0)
+        {
+            return VK_SUCCESS;
+        }
+        std::vector<VkMappedMemoryRange> mapped = mappedRanges(allocation, ranges, rangeCount);
+        return vkInvalidateMappedMemoryRanges(device, static_cast<uint32_t>(mapped.size()), mapped.data());
+    }
+
+    void CFXMemoryAllocator::addStats(const Block &block, Stats &stats) const
+    {
+        stats.memoryCount++;
+        stats.reservedBytes += block.size;
+        stats.allocationCount += block.allocationCount;
+        stats.allocatedBytes += block.allocatedBytes;
+        if (block.dedicated)
+        {
+            stats.dedicatedCount++;
+        }
+        else
+        {
+            stats.largestFreeRange = std::max(stats.largestFreeRange, block.largestFreeRange());
+        }
+    }
+
+    CFXMemoryAllocator::Stats CFXMemoryAllocator::getStats() const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        Stats stats{};
+        for (const auto &typeBlocks : blocks)
+        {
+            for (const auto &block : typeBlocks)
+            {
+                addStats(*block, stats);
+            }
+        }
+        return stats;
+    }
+
+    CFXMemoryAllocator::Stats CFXMemoryAllocator::getStats(uint32_t memoryType) const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        Stats stats{};
+        for (const auto &block : blocks[memoryType])
+        {
+            addStats(*block, stats);
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "cfx_memory_type_table.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Device memory sub-allocator, one per device.
+     *
+     * Memory types are picked from the device's CFXMemoryTypeTable, best ranked first, moving
+     * down the ranking when a heap is over its budget or out of memory.
+     *
+     * Every memory type gets its own list of large VkDeviceMemory blocks that are carved up
+     * with a two level segregated fit (TLSF) free list: sizes map to a power-of-two first
+     * level and SL_COUNT linear second level classes, so finding and coalescing free ranges
+     * is constant time. Resources the driver prefers to keep on their own, and anything
+     * larger than half a block, get a dedicated VkDeviceMemory instead.
+     *
+     * Optimal tiling images are aligned and padded to bufferImageGranularity, so they never
+     * share a granularity page with a buffer placed next to them in the same block.
+     *
+     * Host visible blocks are mapped once for all of their allocations, map() hands out the
+     * allocation's bytes within that mapping.
+     */
+    class CFXMemoryAllocator
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+        // Blocks of small heaps are cut down to this fraction of the heap
+        static constexpr VkDeviceSize SMALL_HEAP_BLOCK_DIVISOR = 8;
+        static constexpr uint32_t SL_BITS = 5;
+        static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+        static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+        enum class ResourceKind
+        {
+            // buffers and linear images
+            Linear,
+            // optimal tiling images
+            Optimal
+        };
+
+        struct Block;
+
+        struct Allocation
+        {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint32_t memoryType = 0;
+            bool dedicated = false;
+            // owned by the allocator
+            Block *block = nullptr;
+            uint32_t node = 0;
+        };
+
+        // A byte range within an allocation
+        struct Range
+        {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+        };
+
+        struct Stats
+        {
+            // VkDeviceMemory objects, dedicated ones included
+            uint32_t memoryCount = 0;
+            uint32_t dedicatedCount = 0;
+            uint32_t allocationCount = 0;
+            // size of all VkDeviceMemory objects
+            VkDeviceSize reservedBytes = 0;
+            // bytes handed out, alignment padding included
+            VkDeviceSize allocatedBytes = 0;
+            VkDeviceSize largestFreeRange = 0;
+        };
+
+        CFXMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetSupported);
+        ~CFXMemoryAllocator();
+        CFXMemoryAllocator(const CFXMemoryAllocator &) = delete;
+        CFXMemoryAllocator &operator=(const CFXMemoryAllocator &) = delete;
+
+        // properties are the flags the memory type must have. dedicatedInfo names the resource and is chained in
+        // when the allocation ends up dedicated. Throws std::runtime_error when no allowed memory type has room.
+        Allocation allocate(
+            const VkMemoryRequirements &requirements,
+            CFXMemoryTypeTable::Usage usage,
+            VkMemoryPropertyFlags properties,
+            ResourceKind kind,
+            const VkMemoryDedicatedAllocateInfo *dedicatedInfo = nullptr,
+            bool prefersDedicated = false);
+        // Resets allocation, freeing an empty allocation does nothing
+        void free(Allocation &allocation);
+
+        // Points data at the first byte of the allocation, the memory stays mapped until the matching unmap()
+        VkResult map(const Allocation &allocation, void **data);
+        void unmap(const Allocation &allocation);
+        // Offsets are relative to the allocation. Ranges are widened to nonCoherentAtomSize, merged and passed to the
+        // driver in one call. Coherent memory needs neither, so nothing is called for it.
+        VkResult flush(const Allocation &allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+        VkResult flush(const Allocation &allocation, const Range *ranges, uint32_t rangeCount);
+        VkResult invalidate(const Allocation &allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+        VkResult invalidate(const Allocation &allocation, const Range *ranges, uint32_t rangeCount);
+        bool isCoherent(const Allocation &allocation) const;
+
+        Stats getStats() const;
+        Stats getStats(uint32_t memoryType) const;
+        VkDeviceSize getBlockSize(uint32_t memoryType) const { return blockSizes[memoryType]; }
+        // Bytes of VkDeviceMemory this allocator holds in the heap
+        VkDeviceSize getHeapReserved(uint32_t heap) const
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            return heapReserved[heap];
+        }
+        CFXMemoryTypeTable &getMemoryTypes() { return memoryTypes; }
+        const CFXMemoryTypeTable &getMemoryTypes() const { return memoryTypes; }
+
+    private:
+        bool fitsBudget(uint32_t heap, VkDeviceSize size) const;
+        // withinBudget keeps new memory from pushing the heap over its budget
+        bool allocateFromType(uint32_t memoryType, VkDeviceSize size, VkDeviceSize alignment,
+                              const VkMemoryDedicatedAllocateInfo *dedicatedInfo, bool prefersDedicated,
+                              bool withinBudget, Allocation &allocation);
+        Block *createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated, const VkMemoryDedicatedAllocateInfo *dedicatedInfo);
+        void destroyBlock(Block *block);
+        std::vector<VkMappedMemoryRange> mappedRanges(const Allocation &allocation, const Range *ranges, uint32_t rangeCount) const;
+        void addStats(const Block &block, Stats &stats) const;
+
+        VkDevice device;
+        CFXMemoryTypeTable memoryTypes;
+        VkDeviceSize bufferImageGranularity = 1;
+        VkDeviceSize nonCoherentAtomSize = 1;
+        std::vector<VkDeviceSize> blockSizes;
+
+        mutable std::mutex mutex;
+        // indexed by memory type, dedicated blocks included
+        std::vector<std::vector<std::unique_ptr<Block>>> blocks;
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapReserved{};
+    };
+}
@@ -0,0 +1,179 @@
+#include "cfx_memory_type_table.hpp"
+
+#include <algorithm>
+
+namespace cfx
+{
+    // AMD's device coherent and uncached types are slow for everything but cross-queue debugging
+    static constexpr VkMemoryPropertyFlags AMD_DEVICE_COHERENCE_FLAGS = 0x40 | 0x80;
+
+    CFXMemoryTypeTable::CFXMemoryTypeTable(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t groupDeviceCount, bool memoryBudgetSupported)
+        : physicalDevice{physicalDevice}, memoryBudgetSupported{memoryBudgetSupported}, groupDeviceCount{groupDeviceCount}
+    {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        ranked.resize(USAGE_COUNT * KEY_COUNT);
+        for (uint32_t usage = 0; usage < USAGE_COUNT; usage++)
+        {
+            for (uint32_t required = 0; required < KEY_COUNT; required++)
+            {
+                if ((required & KEY_FLAGS) == required)
+                {
+                    ranked[usage * KEY_COUNT + required] = computeRank(static_cast<Usage>(usage), required);
+                }
+            }
+        }
+
+        peerMemoryFeatures.resize(memoryProperties.memoryHeapCount * groupDeviceCount, 0);
+        for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+        {
+            for (uint32_t remote = 1; remote < groupDeviceCount; remote++)
+            {
+                vkGetDeviceGroupPeerMemoryFeatures(device, heap, 0, remote, &peerMemoryFeatures[heap * groupDeviceCount + remote]);
+            }
+        }
+
+        refreshBudgets();
+    }
+
+    CFXMemoryTypeTable::Usage CFXMemoryTypeTable::usageFor(VkMemoryPropertyFlags properties, VkBufferUsageFlags bufferUsage)
+    {
+        if (!(properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+        {
+            return Usage::GpuOnly;
+        }
+        if (properties & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
+        {
+            return Usage::Readback;
+        }
+        if (bufferUsage != 0 && (bufferUsage & ~VK_BUFFER_USAGE_TRANSFER_SRC_BIT) == 0)
+        {
+            return Usage::Upload;
+        }
+        return Usage::Dynamic;
+    }
+
+    int CFXMemoryTypeTable::score(Usage usage, VkMemoryPropertyFlags flags)
+    {
+        int deviceLocal = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? 1 : 0;
+        int hostVisible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? 1 : 0;
+        int coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? 1 : 0;
+        int cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? 1 : 0;
+        int score = 0;
+        switch (usage)
+        {
+        case Usage::GpuOnly:
+            // leave the host visible device memory, often a small BAR window, to the host's writes
+            score = deviceLocal * 8 - hostVisible * 2;
+            break;
+        case Usage::Upload:
+            // staging is read once by a copy, system memory is fine and coherent saves the flush
+            score = hostVisible * 8 + coherent * 4 - deviceLocal * 2 - cached;
+            break;
+        case Usage::Dynamic:
+            score = hostVisible * 8 + coherent * 4 + deviceLocal * 2;
+            break;
+        case Usage::Readback:
+            score = hostVisible * 8 + cached * 4 + coherent;
+            break;
+        case Usage::HostResident:
+            // the point is to free device memory, a BAR window would not
+            score = hostVisible * 8 + coherent * 4 - deviceLocal * 4;
+            break;
+        }
+        if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT | AMD_DEVICE_COHERENCE_FLAGS))
+        {
+            score -= 32;
+        }
+        return score;
+    }
+
+    std::vector<uint32_t> CFXMemoryTypeTable::computeRank(Usage usage, VkMemoryPropertyFlags required) const
+    {
+        std::vector<uint32_t> types;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((memoryProperties.memoryTypes[i].propertyFlags & required) == required)
+            {
+                types.push_back(i);
+            }
+        }
+        // unwanted bits only count against a type when the request did not ask for them
+        std::stable_sort(types.begin(), types.end(), [&](uint32_t a, uint32_t b)
+                         {
+                             int scoreA = score(usage, memoryProperties.memoryTypes[a].propertyFlags & ~required);
+                             int scoreB = score(usage, memoryProperties.memoryTypes[b].propertyFlags & ~required);
+                             if (scoreA != scoreB)
+                             {
+                                 return scoreA > scoreB;
+                             }
+                             return getHeapSize(getHeapIndex(a)) > getHeapSize(getHeapIndex(b)); });
+        return types;
+    }
+
+    std::vector<uint32_t> CFXMemoryTypeTable::rank(Usage usage, VkMemoryPropertyFlags required) const
+    {
+        if ((required & KEY_FLAGS) == required)
+        {
+            return ranked[static_cast<uint32_t>(usage) * KEY_COUNT + required];
+        }
+        return computeRank(usage, required);
+    }
+
+    uint32_t CFXMemoryTypeTable::find(uint32_t typeFilter, Usage usage, VkMemoryPropertyFlags required) const
+    {
+        for (uint32_t type : rank(usage, required))
+        {
+            if (typeFilter & (1u << type))
+            {
+                return type;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    VkDeviceSize CFXMemoryTypeTable::getHeapBudget(uint32_t heap) const
+    {
+        std::lock_guard<std::mutex> lock{budgetMutex};
+        return heapBudgets[heap];
+    }
+
+    VkDeviceSize CFXMemoryTypeTable::getHeapUsage(uint32_t heap) const
+    {
+        std::lock_guard<std::mutex> lock{budgetMutex};
+        return heapUsages[heap];
+    }
+
+    void CFXMemoryTypeTable::refreshBudgets()
+    {
+        std::lock_guard<std::mutex> lock{budgetMutex};
+        if (!memoryBudgetSupported)
+        {
+            for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+            {
+                heapBudgets[heap] = memoryProperties.memoryHeaps[heap].size;
+            }
+            return;
+        }
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+        for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+        {
+            heapBudgets[heap] = budget.heapBudget[heap];
+            heapUsages[heap] = budget.heapUsage[heap];
+        }
+    }
+
+    VkPeerMemoryFeatureFlags CFXMemoryTypeTable::getPeerMemoryFeatures(uint32_t heap, uint32_t remoteDeviceIndex) const
+    {
+        if (remoteDeviceIndex == 0 || remoteDeviceIndex >= groupDeviceCount)
+        {
+            return 0;
+        }
+        return peerMemoryFeatures[heap * groupDeviceCount + remoteDeviceIndex];
+    }
+}
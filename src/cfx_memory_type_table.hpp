@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Memory types, heaps, budgets and peer memory features of one device, queried once.
+     *
+     * For every usage intent and every combination of the KEY_FLAGS property bits the table
+     * holds the memory types that have all of those bits, best first. The later types are the
+     * fallbacks the allocator moves on to when the heaps of the earlier ones are out of memory
+     * or over budget.
+     */
+    class CFXMemoryTypeTable
+    {
+    public:
+        enum class Usage
+        {
+            // written by transfers or shaders only
+            GpuOnly,
+            // written once by the host and copied from, staging buffers
+            Upload,
+            // rewritten by the host every frame and read by shaders in place
+            Dynamic,
+            // written by the device and read back by the host
+            Readback,
+            // written once by the host and read in place by the device, kept out of device memory on purpose
+            HostResident
+        };
+        static constexpr uint32_t USAGE_COUNT = 5;
+
+        // property bits requests are keyed by, requests with other bits are ranked on the spot
+        static constexpr VkMemoryPropertyFlags KEY_FLAGS = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT |
+                                                           VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT;
+        static constexpr uint32_t KEY_COUNT = KEY_FLAGS + 1;
+
+        // groupDeviceCount is the number of physical devices behind device, peer features are only queried when it is above 1.
+        // memoryBudgetSupported says whether VK_EXT_memory_budget is enabled on device.
+        CFXMemoryTypeTable(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t groupDeviceCount, bool memoryBudgetSupported);
+        CFXMemoryTypeTable(const CFXMemoryTypeTable &) = delete;
+        CFXMemoryTypeTable &operator=(const CFXMemoryTypeTable &) = delete;
+
+        // Intent of a buffer created with the given property and usage flags
+        static Usage usageFor(VkMemoryPropertyFlags properties, VkBufferUsageFlags bufferUsage = 0);
+
+        // Memory types with every bit of required set, best first for usage
+        std::vector<uint32_t> rank(Usage usage, VkMemoryPropertyFlags required) const;
+        // Best ranked type in typeFilter, UINT32_MAX if there is none
+        uint32_t find(uint32_t typeFilter, Usage usage, VkMemoryPropertyFlags required) const;
+
+        const VkPhysicalDeviceMemoryProperties &getProperties() const { return memoryProperties; }
+        VkMemoryPropertyFlags getFlags(uint32_t memoryType) const { return memoryProperties.memoryTypes[memoryType].propertyFlags; }
+        uint32_t getHeapIndex(uint32_t memoryType) const { return memoryProperties.memoryTypes[memoryType].heapIndex; }
+        VkDeviceSize getHeapSize(uint32_t heap) const { return memoryProperties.memoryHeaps[heap].size; }
+        bool hasMemoryBudget() const { return memoryBudgetSupported; }
+        // What the process may allocate from the heap: the driver's budget with VK_EXT_memory_budget, else the heap size
+        VkDeviceSize getHeapBudget(uint32_t heap) const;
+        // What the process has allocated from the heap as the driver sees it, 0 without VK_EXT_memory_budget
+        VkDeviceSize getHeapUsage(uint32_t heap) const;
+        // Budgets move as this and other processes allocate, re-read them
+        void refreshBudgets();
+        // How the device may access the heap's memory on the group's remoteDeviceIndex device, 0 without peers
+        VkPeerMemoryFeatureFlags getPeerMemoryFeatures(uint32_t heap, uint32_t remoteDeviceIndex) const;
+
+    private:
+        static int score(Usage usage, VkMemoryPropertyFlags flags);
+        std::vector<uint32_t> computeRank(Usage usage, VkMemoryPropertyFlags required) const;
+
+        VkPhysicalDevice physicalDevice;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        bool memoryBudgetSupported;
+        uint32_t groupDeviceCount;
+        // indexed by usage * KEY_COUNT + required flags
+        std::vector<std::vector<uint32_t>> ranked;
+        // indexed by heap * groupDeviceCount + remote device index
+        std::vector<VkPeerMemoryFeatureFlags> peerMemoryFeatures;
+
+        mutable std::mutex budgetMutex;
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapBudgets{};
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapUsages{};
+    };
+}
@@ -0,0 +1,140 @@
+#include "cfx_mesh_cache.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace cfx
+{
+    static uint64_t alignSection(uint64_t offset)
+    {
+        return (offset + CFXMeshCache::SECTION_ALIGNMENT - 1) & ~(CFXMeshCache::SECTION_ALIGNMENT - 1);
+    }
+
+    std::string CFXMeshCache::cachePathFor(const std::string &sourcePath)
+    {
+        return sourcePath + ".cfxmesh";
+    }
+
+    bool CFXMeshCache::querySource(const std::string &sourcePath, uint64_t &size, int64_t &time)
+    {
+        // sources packed into the asset archive keep the time they were packed with, so the cache stays valid
+        return CFXMappedFile::query(sourcePath, size, time);
+    }
+
+    std::shared_ptr<CFXMeshCache> CFXMeshCache::open(const std::string &sourcePath, uint64_t layoutKey)
+    {
+        uint64_t sourceSize = 0;
+        int64_t sourceTime = 0;
+        if (!querySource(sourcePath, sourceSize, sourceTime))
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<CFXMappedFile> file = CFXMappedFile::open(cachePathFor(sourcePath));
+        if (file == nullptr || file->size() < sizeof(Header))
+        {
+            return nullptr;
+        }
+        size_t fileSize = file->size();
+
+        std::shared_ptr<CFXMeshCache> cache{new CFXMeshCache()};
+        cache->file = file;
+
+        const Header *header = reinterpret_cast<const Header *>(file->data());
+        if (header->magic != MAGIC || header->version != VERSION || header->layoutKey != layoutKey ||
+            header->sourceSize != sourceSize || header->sourceTime != sourceTime)
+        {
+            return nullptr;
+        }
+        if (sizeof(Header) + uint64_t(header->sectionCount) * sizeof(Section) > fileSize)
+        {
+            return nullptr;
+        }
+        cache->sections = reinterpret_cast<const Section *>(file->data() + sizeof(Header));
+        cache->sectionCount = header->sectionCount;
+        for (uint32_t i = 0; i < cache->sectionCount; i++)
+        {
+            const Section &section = cache->sections[i];
+            uint64_t byteSize = section.elementCount * section.elementSize;
+            if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > fileSize || byteSize > fileSize - section.offset)
+            {
+                return nullptr;
+            }
+        }
+        return cache;
+    }
+
+    bool CFXMeshCache::write(const std::string &sourcePath, uint64_t layoutKey, const std::vector<SectionData> &sectionData)
+    {
+        Header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.layoutKey = layoutKey;
+        header.sectionCount = static_cast<uint32_t>(sectionData.size());
+        if (!querySource(sourcePath, header.sourceSize, header.sourceTime))
+        {
+            return false;
+        }
+
+        std::vector<Section> table(sectionData.size());
+        uint64_t offset = alignSection(sizeof(Header) + table.size() * sizeof(Section));
+        for (size_t i = 0; i < sectionData.size(); i++)
+        {
+            table[i].tag = sectionData[i].tag;
+            table[i].elementSize = sectionData[i].elementSize;
+            table[i].elementCount = sectionData[i].elementCount;
+            table[i].offset = offset;
+            offset = alignSection(offset + table[i].elementCount * table[i].elementSize);
+        }
+
+        // write next to the final file and rename so a partially written cache is never picked up,
+        // the streamer's workers may write the same cache at once so every write gets its own file
+        static std::atomic<uint32_t> writeCount{0};
+        std::string cachePath = cachePathFor(sourcePath);
+        std::string tempPath = cachePath + "." + std::to_string(writeCount++) + ".tmp";
+        {
+            std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+            if (!file.is_open())
+            {
+                return false;
+            }
+            file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(Section));
+            uint64_t written = sizeof(Header) + table.size() * sizeof(Section);
+            const char padding[SECTION_ALIGNMENT] = {};
+            for (size_t i = 0; i < sectionData.size(); i++)
+            {
+                file.write(padding, table[i].offset - written);
+                uint64_t byteSize = table[i].elementCount * table[i].elementSize;
+                file.write(static_cast<const char *>(sectionData[i].data), byteSize);
+                written = table[i].offset + byteSize;
+            }
+            if (!file.good())
+            {
+                file.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    const CFXMeshCache::Section *CFXMeshCache::findSection(uint32_t tag) const
+    {
+        for (uint32_t i = 0; i < sectionCount; i++)
+        {
+            if (sections[i].tag == tag)
+            {
+                return &sections[i];
+            }
+        }
+        return nullptr;
+    }
+}
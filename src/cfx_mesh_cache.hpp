@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cfx_mapped_file.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Versioned binary cache of a processed mesh (.cfxmesh).
+     *
+     * The file is a fixed header, a table of sections and the raw section payloads,
+     * each aligned to SECTION_ALIGNMENT. On load the whole file is memory-mapped and
+     * sections are handed out as pointers into the mapping, so their bytes can be
+     * copied straight into a staging buffer.
+     */
+    class CFXMeshCache
+    {
+    public:
+        static constexpr uint32_t MAGIC = 0x4d584643; // "CFXM"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+        static constexpr uint32_t SECTION_VERTICES = 0x54524556; // "VERT"
+        static constexpr uint32_t SECTION_INDICES = 0x58444e49;  // "INDX"
+        static constexpr uint32_t SECTION_BOUNDS = 0x53444e42;   // "BNDS"
+        static constexpr uint32_t SECTION_SUBMESHES = 0x4d425553; // "SUBM"
+        static constexpr uint32_t SECTION_LODS = 0x53444f4c;      // "LODS"
+        static constexpr uint32_t SECTION_MESHLETS = 0x4c48534d;  // "MSHL"
+        // stands in for VERT when the vertices stay in the source file, see CFXModel::Builder
+        static constexpr uint32_t SECTION_VERTEX_ORDER = 0x44524f56; // "VORD"
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            uint64_t layoutKey;
+            uint32_t sectionCount;
+            uint32_t reserved;
+        };
+
+        struct Section
+        {
+            uint32_t tag;
+            uint32_t elementSize;
+            uint64_t elementCount;
+            uint64_t offset;
+        };
+
+        // A section payload to be written, the data is not owned
+        struct SectionData
+        {
+            uint32_t tag;
+            uint32_t elementSize;
+            uint64_t elementCount;
+            const void *data;
+        };
+
+        CFXMeshCache(const CFXMeshCache &) = delete;
+        CFXMeshCache &operator=(const CFXMeshCache &) = delete;
+
+        static std::string cachePathFor(const std::string &sourcePath);
+
+        // Maps the cache for sourcePath, returns nullptr if it is missing, corrupt or stale
+        static std::shared_ptr<CFXMeshCache> open(const std::string &sourcePath, uint64_t layoutKey);
+        // Writes the cache for sourcePath, returns false if the file could not be written
+        static bool write(const std::string &sourcePath, uint64_t layoutKey, const std::vector<SectionData> &sections);
+
+        const Section *findSection(uint32_t tag) const;
+        const void *sectionData(const Section &section) const { return file->data() + section.offset; }
+
+    private:
+        CFXMeshCache() = default;
+        static bool querySource(const std::string &sourcePath, uint64_t &size, int64_t &time);
+
+        std::shared_ptr<CFXMappedFile> file{};
+        const Section *sections = nullptr;
+        uint32_t sectionCount = 0;
+    };
+}
@@ -0,0 +1,348 @@
+#include "cfx_mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace cfx
+{
+    // Forsyth's scoring, see "Linear-Speed Vertex Cache Optimisation"
+    static constexpr int FORSYTH_CACHE_SIZE = 32;
+    static constexpr float CACHE_DECAY_POWER = 1.5f;
+    static constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    static constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    static constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+    static float vertexScore(int cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+        {
+            return -1.f;
+        }
+        float score = 0.f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+            {
+                // the triangle just emitted, reusing it right away is deliberately not the best choice
+                score = LAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                float scale = 1.f / (FORSYTH_CACHE_SIZE - 3);
+                score = std::pow(1.f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+            }
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    }
+
+    CFXMeshOptimizer::VertexCacheStats CFXMeshOptimizer::analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                                                           uint32_t cacheSize)
+    {
+        VertexCacheStats stats{0.f, 0.f};
+        if (indexCount < 3)
+        {
+            return stats;
+        }
+        // a vertex is resident while its timestamp is within cacheSize of the FIFO head
+        std::vector<size_t> cachedAt(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        size_t transformed = 0;
+        size_t referencedCount = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            uint32_t vertex = indices[i];
+            if (cachedAt[vertex] == 0 || transformed - cachedAt[vertex] >= cacheSize)
+            {
+                transformed++;
+                cachedAt[vertex] = transformed;
+            }
+            if (!referenced[vertex])
+            {
+                referenced[vertex] = true;
+                referencedCount++;
+            }
+        }
+        stats.acmr = static_cast<float>(transformed) / (indexCount / 3);
+        stats.atvr = static_cast<float>(transformed) / referencedCount;
+        return stats;
+    }
+
+    void CFXMeshOptimizer::optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+        {
+            return;
+        }
+
+        // vertex to triangle adjacency, trimmed as triangles get emitted
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            remaining[indices[i]]++;
+        }
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+        }
+        std::vector<uint32_t> adjacency(adjacencyOffset[vertexCount]);
+        std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            vertexScores[v] = vertexScore(-1, remaining[v]);
+        }
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<uint32_t> cache;
+        std::vector<uint32_t> nextCache;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+        std::vector<uint32_t> output(triangleCount * 3);
+
+        size_t bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+        size_t scanCursor = 0;
+        for (size_t outputTriangle = 0; outputTriangle < triangleCount; outputTriangle++)
+        {
+            if (bestTriangle == triangleCount)
+            {
+                // nothing adjacent to the cache is left, continue with the next unemitted triangle
+                while (emitted[scanCursor])
+                {
+                    scanCursor++;
+                }
+                bestTriangle = scanCursor;
+            }
+
+            const uint32_t *triangle = indices + 3 * bestTriangle;
+            std::copy(triangle, triangle + 3, output.begin() + 3 * outputTriangle);
+            emitted[bestTriangle] = true;
+
+            nextCache.assign(triangle, triangle + 3);
+            for (uint32_t vertex : cache)
+            {
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                {
+                    nextCache.push_back(vertex);
+                }
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t vertex = triangle[k];
+                uint32_t *begin = adjacency.data() + adjacencyOffset[vertex];
+                uint32_t *end = begin + remaining[vertex];
+                *std::find(begin, end, static_cast<uint32_t>(bestTriangle)) = end[-1];
+                remaining[vertex]--;
+            }
+
+            // evicted vertices lose their cache bonus, everything still cached gets rescored
+            for (size_t i = FORSYTH_CACHE_SIZE; i < nextCache.size(); i++)
+            {
+                cachePosition[nextCache[i]] = -1;
+            }
+            nextCache.resize(std::min<size_t>(nextCache.size(), FORSYTH_CACHE_SIZE));
+            for (size_t i = 0; i < nextCache.size(); i++)
+            {
+                cachePosition[nextCache[i]] = static_cast<int>(i);
+            }
+            for (uint32_t vertex : cache)
+            {
+                if (cachePosition[vertex] < 0)
+                {
+                    vertexScores[vertex] = vertexScore(-1, remaining[vertex]);
+                }
+            }
+            std::swap(cache, nextCache);
+
+            bestTriangle = triangleCount;
+            float bestScore = -1.f;
+            for (uint32_t vertex : cache)
+            {
+                vertexScores[vertex] = vertexScore(cachePosition[vertex], remaining[vertex]);
+            }
+            for (uint32_t vertex : cache)
+            {
+                const uint32_t *begin = adjacency.data() + adjacencyOffset[vertex];
+                for (const uint32_t *t = begin; t != begin + remaining[vertex]; t++)
+                {
+                    const uint32_t *candidate = indices + 3 * *t;
+                    float score = vertexScores[candidate[0]] + vertexScores[candidate[1]] + vertexScores[candidate[2]];
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        bestTriangle = *t;
+                    }
+                }
+            }
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    void CFXMeshOptimizer::optimizeOverdraw(uint32_t *indices, size_t indexCount, const float *positions, size_t positionStride,
+                                            size_t vertexCount, float threshold)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+        {
+            return;
+        }
+        auto position = [&](uint32_t vertex)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) + vertex * positionStride);
+        };
+
+        // split at hard cache boundaries, triangles whose three vertices all miss the cache,
+        // reordering whole clusters keeps most of the locality the vertex cache pass bought
+        std::vector<size_t> clusterStarts;
+        {
+            std::vector<size_t> cachedAt(vertexCount, 0);
+            size_t transformed = 0;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                int misses = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t vertex = indices[3 * t + k];
+                    if (cachedAt[vertex] == 0 || transformed - cachedAt[vertex] >= STATS_CACHE_SIZE)
+                    {
+                        transformed++;
+                        cachedAt[vertex] = transformed;
+                        misses++;
+                    }
+                }
+                if (t == 0 || misses == 3)
+                {
+                    clusterStarts.push_back(t);
+                }
+            }
+        }
+        clusterStarts.push_back(triangleCount);
+        size_t clusterCount = clusterStarts.size() - 1;
+        if (clusterCount < 2)
+        {
+            return;
+        }
+
+        double meshCentroid[3] = {0.0, 0.0, 0.0};
+        double meshArea = 0.0;
+        std::vector<double> clusterCentroids(3 * clusterCount, 0.0);
+        std::vector<double> clusterNormals(3 * clusterCount, 0.0);
+        std::vector<double> clusterAreas(clusterCount, 0.0);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+            {
+                const float *a = position(indices[3 * t]);
+                const float *b = position(indices[3 * t + 1]);
+                const float *d = position(indices[3 * t + 2]);
+                double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                double ad[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+                double normal[3] = {ab[1] * ad[2] - ab[2] * ad[1], ab[2] * ad[0] - ab[0] * ad[2], ab[0] * ad[1] - ab[1] * ad[0]};
+                double area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                for (int k = 0; k < 3; k++)
+                {
+                    double centroid = (a[k] + b[k] + d[k]) / 3.0;
+                    clusterCentroids[3 * c + k] += centroid * area;
+                    meshCentroid[k] += centroid * area;
+                    clusterNormals[3 * c + k] += normal[k];
+                }
+                clusterAreas[c] += area;
+                meshArea += area;
+            }
+        }
+        if (meshArea <= 0.0)
+        {
+            return;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            meshCentroid[k] /= meshArea;
+        }
+
+        // clusters facing away from the mesh center are the likely occluders, draw them first
+        std::vector<double> clusterKeys(clusterCount, 0.0);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            if (clusterAreas[c] <= 0.0)
+            {
+                continue;
+            }
+            double normalLength = std::sqrt(clusterNormals[3 * c] * clusterNormals[3 * c] + clusterNormals[3 * c + 1] * clusterNormals[3 * c + 1] +
+                                            clusterNormals[3 * c + 2] * clusterNormals[3 * c + 2]);
+            if (normalLength <= 0.0)
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                double offset = clusterCentroids[3 * c + k] / clusterAreas[c] - meshCentroid[k];
+                clusterKeys[c] += offset * clusterNormals[3 * c + k] / normalLength;
+            }
+        }
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                         { return clusterKeys[a] > clusterKeys[b]; });
+
+        std::vector<uint32_t> reordered;
+        reordered.reserve(triangleCount * 3);
+        for (size_t c : order)
+        {
+            reordered.insert(reordered.end(), indices + 3 * clusterStarts[c], indices + 3 * clusterStarts[c + 1]);
+        }
+        float before = analyzeVertexCache(indices, triangleCount * 3, vertexCount).acmr;
+        float after = analyzeVertexCache(reordered.data(), reordered.size(), vertexCount).acmr;
+        if (after <= before * threshold)
+        {
+            std::copy(reordered.begin(), reordered.end(), indices);
+        }
+    }
+
+    size_t CFXMeshOptimizer::optimizeVertexFetch(void *vertices, size_t vertexCount, size_t vertexSize, uint32_t *indices, size_t indexCount)
+    {
+        constexpr uint32_t UNUSED = UINT32_MAX;
+        std::vector<uint32_t> remap(vertexCount, UNUSED);
+        uint32_t nextVertex = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            uint32_t &target = remap[indices[i]];
+            if (target == UNUSED)
+            {
+                target = nextVertex++;
+            }
+            indices[i] = target;
+        }
+
+        uint8_t *bytes = static_cast<uint8_t *>(vertices);
+        std::vector<uint8_t> reordered(nextVertex * vertexSize);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (remap[v] != UNUSED)
+            {
+                memcpy(reordered.data() + remap[v] * vertexSize, bytes + v * vertexSize, vertexSize);
+            }
+        }
+        memcpy(bytes, reordered.data(), reordered.size());
+        return nextVertex;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cfx
+{
+    /*
+     * Load time index and vertex reordering for indexed triangle lists.
+     *
+     * The usual order is optimizeVertexCache, then optionally optimizeOverdraw, then
+     * optimizeVertexFetch, which renumbers the vertices and therefore has to come last.
+     */
+    class CFXMeshOptimizer
+    {
+    public:
+        // FIFO size used to measure post-transform cache efficiency
+        static constexpr uint32_t STATS_CACHE_SIZE = 16;
+
+        struct VertexCacheStats
+        {
+            float acmr; // transformed vertices per triangle, 0.5 is the ideal for a regular grid
+            float atvr; // transformed vertices per referenced vertex, 1.0 is the ideal
+        };
+
+        // Simulates a FIFO post-transform cache of cacheSize entries over the index stream
+        static VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                                   uint32_t cacheSize = STATS_CACHE_SIZE);
+
+        // Reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+        static void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+        // Reorders clusters of cache-optimized triangles so outward facing ones are drawn first,
+        // keeping the result only if the ACMR grows by no more than threshold (1.05 = 5%)
+        static void optimizeOverdraw(uint32_t *indices, size_t indexCount, const float *positions, size_t positionStride,
+                                     size_t vertexCount, float threshold = 1.05f);
+
+        // Renumbers vertices in first-use order and drops unreferenced ones, returns the new vertex count
+        static size_t optimizeVertexFetch(void *vertices, size_t vertexCount, size_t vertexSize, uint32_t *indices, size_t indexCount);
+    };
+}
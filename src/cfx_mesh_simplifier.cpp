@@ -0,0 +1,459 @@
+#include "cfx_mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace cfx
+{
+    // planes keeping open borders in place, relative to the surface planes
+    static constexpr double BORDER_WEIGHT = 10.0;
+    // a collapse is rejected when it turns a neighbouring triangle by more than ~78 degrees
+    static constexpr double MIN_NORMAL_COSINE = 0.2;
+
+    // Sum of squared distances to a set of weighted planes, see Garland and Heckbert,
+    // "Surface Simplification Using Quadric Error Metrics"
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        void addPlane(const double normal[3], double d, double w)
+        {
+            a00 += w * normal[0] * normal[0];
+            a01 += w * normal[0] * normal[1];
+            a02 += w * normal[0] * normal[2];
+            a11 += w * normal[1] * normal[1];
+            a12 += w * normal[1] * normal[2];
+            a22 += w * normal[2] * normal[2];
+            b0 += w * normal[0] * d;
+            b1 += w * normal[1] * d;
+            b2 += w * normal[2] * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &other)
+        {
+            a00 += other.a00;
+            a01 += other.a01;
+            a02 += other.a02;
+            a11 += other.a11;
+            a12 += other.a12;
+            a22 += other.a22;
+            b0 += other.b0;
+            b1 += other.b1;
+            b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // root mean square distance of p to the planes
+        float error(const float *p) const
+        {
+            if (weight <= 0.0)
+            {
+                return 0.f;
+            }
+            double x = p[0], y = p[1], z = p[2];
+            double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                       2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return static_cast<float>(std::sqrt(std::max(0.0, e) / weight));
+        }
+    };
+
+    struct Collapse
+    {
+        float error;
+        uint32_t from;
+        uint32_t to;
+        // versions of both vertices when the cost was computed, stale entries are skipped
+        uint32_t fromVersion;
+        uint32_t toVersion;
+        bool operator>(const Collapse &other) const { return error > other.error; }
+    };
+
+    static void triangleNormal(const float *a, const float *b, const float *c, double normal[3])
+    {
+        double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+        normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+        normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+    }
+
+    size_t CFXMeshSimplifier::simplify(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                                       const float *positions, size_t vertexStride, size_t vertexCount,
+                                       const float *attributes, size_t attributeCount,
+                                       size_t targetIndexCount, float targetError, float *resultError)
+    {
+        if (resultError != nullptr)
+        {
+            *resultError = 0.f;
+        }
+        size_t triangleCount = indexCount / 3;
+        auto position = [&](uint32_t vertex)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) + vertex * vertexStride);
+        };
+        auto attribute = [&](uint32_t vertex)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(attributes) + vertex * vertexStride);
+        };
+
+        // group vertices by position, remap points every vertex at the first of its group
+        std::vector<uint32_t> sorted(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            sorted[v] = v;
+        }
+        std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b)
+                  {
+                      const float *pa = position(a);
+                      const float *pb = position(b);
+                      return std::tie(pa[0], pa[1], pa[2], a) < std::tie(pb[0], pb[1], pb[2], b); });
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<uint32_t> groupBegin(vertexCount, 0);
+        std::vector<uint32_t> groupEnd(vertexCount, 0);
+        for (size_t begin = 0; begin < vertexCount;)
+        {
+            const float *p = position(sorted[begin]);
+            size_t end = begin + 1;
+            while (end < vertexCount && position(sorted[end])[0] == p[0] && position(sorted[end])[1] == p[1] && position(sorted[end])[2] == p[2])
+            {
+                end++;
+            }
+            uint32_t representative = sorted[begin];
+            for (size_t i = begin; i < end; i++)
+            {
+                remap[sorted[i]] = representative;
+            }
+            groupBegin[representative] = static_cast<uint32_t>(begin);
+            groupEnd[representative] = static_cast<uint32_t>(end);
+            begin = end;
+        }
+
+        std::vector<uint32_t> corners(indices, indices + triangleCount * 3);
+        std::vector<bool> alive(triangleCount, true);
+        size_t liveTriangles = 0;
+        std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t a = remap[corners[3 * t]], b = remap[corners[3 * t + 1]], c = remap[corners[3 * t + 2]];
+            if (a == b || b == c || a == c)
+            {
+                alive[t] = false;
+                continue;
+            }
+            liveTriangles++;
+            vertexTriangles[a].push_back(static_cast<uint32_t>(t));
+            vertexTriangles[b].push_back(static_cast<uint32_t>(t));
+            vertexTriangles[c].push_back(static_cast<uint32_t>(t));
+        }
+
+        // directed edge counts find open borders (no twin) and non-manifold edges (repeats)
+        auto edgeKey = [](uint32_t a, uint32_t b)
+        { return uint64_t(a) << 32 | b; };
+        std::unordered_map<uint64_t, uint32_t> edges;
+        edges.reserve(liveTriangles * 3);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; alive[t] && k < 3; k++)
+            {
+                edges[edgeKey(remap[corners[3 * t + k]], remap[corners[3 * t + (k + 1) % 3]])]++;
+            }
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        std::vector<bool> border(vertexCount, false);
+        std::vector<bool> locked(vertexCount, false);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (!alive[t])
+            {
+                continue;
+            }
+            uint32_t v[3] = {remap[corners[3 * t]], remap[corners[3 * t + 1]], remap[corners[3 * t + 2]]};
+            double normal[3];
+            triangleNormal(position(v[0]), position(v[1]), position(v[2]), normal);
+            double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length <= 0.0)
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                normal[k] /= length;
+            }
+            const float *p0 = position(v[0]);
+            double d = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+            for (int k = 0; k < 3; k++)
+            {
+                quadrics[v[k]].addPlane(normal, d, length * 0.5);
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = v[k], b = v[(k + 1) % 3];
+                if (edges[edgeKey(a, b)] > 1)
+                {
+                    locked[a] = locked[b] = true;
+                }
+                if (edges.count(edgeKey(b, a)) != 0)
+                {
+                    continue;
+                }
+                // plane through the border edge, perpendicular to the triangle
+                border[a] = border[b] = true;
+                const float *pa = position(a);
+                const float *pb = position(b);
+                double edge[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+                double plane[3] = {edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2],
+                                   edge[0] * normal[1] - edge[1] * normal[0]};
+                double planeLength = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+                if (planeLength <= 0.0)
+                {
+                    continue;
+                }
+                for (int i = 0; i < 3; i++)
+                {
+                    plane[i] /= planeLength;
+                }
+                double planeD = -(plane[0] * pa[0] + plane[1] * pa[1] + plane[2] * pa[2]);
+                double edgeLengthSquared = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+                quadrics[a].addPlane(plane, planeD, edgeLengthSquared * BORDER_WEIGHT);
+                quadrics[b].addPlane(plane, planeD, edgeLengthSquared * BORDER_WEIGHT);
+            }
+        }
+
+        std::vector<uint32_t> versions(vertexCount, 0);
+        std::vector<bool> removed(vertexCount, false);
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+        auto pushCollapse = [&](uint32_t from, uint32_t to)
+        {
+            if (from == to || removed[from] || removed[to] || locked[from] || (border[from] && !border[to]))
+            {
+                return;
+            }
+            Quadric merged = quadrics[from];
+            merged.add(quadrics[to]);
+            queue.push(Collapse{merged.error(position(to)), from, to, versions[from], versions[to]});
+        };
+        auto contains = [&](uint32_t t, uint32_t vertex)
+        {
+            return remap[corners[3 * t]] == vertex || remap[corners[3 * t + 1]] == vertex || remap[corners[3 * t + 2]] == vertex;
+        };
+        auto compact = [&](uint32_t vertex)
+        {
+            auto &list = vertexTriangles[vertex];
+            list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t)
+                                      { return !alive[t]; }),
+                       list.end());
+        };
+        auto neighbours = [&](uint32_t vertex, uint32_t exclude, std::vector<uint32_t> &out)
+        {
+            out.clear();
+            for (uint32_t t : vertexTriangles[vertex])
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t other = remap[corners[3 * t + k]];
+                    if (other != vertex && other != exclude)
+                    {
+                        out.push_back(other);
+                    }
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        };
+
+        std::vector<uint32_t> fromNeighbours;
+        std::vector<uint32_t> toNeighbours;
+        auto canCollapse = [&](uint32_t from, uint32_t to)
+        {
+            compact(from);
+            compact(to);
+            size_t shared = 0;
+            for (uint32_t t : vertexTriangles[from])
+            {
+                shared += contains(t, to) ? 1 : 0;
+            }
+            // no longer adjacent, or a border vertex leaving its border
+            if (shared == 0 || (border[from] && shared != 1))
+            {
+                return false;
+            }
+            // link condition: only the vertices opposite the collapsed edge may be shared
+            neighbours(from, to, fromNeighbours);
+            neighbours(to, from, toNeighbours);
+            size_t common = 0;
+            for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();)
+            {
+                if (fromNeighbours[i] == toNeighbours[j])
+                {
+                    common++;
+                    i++;
+                    j++;
+                }
+                else if (fromNeighbours[i] < toNeighbours[j])
+                {
+                    i++;
+                }
+                else
+                {
+                    j++;
+                }
+            }
+            if (common != shared)
+            {
+                return false;
+            }
+
+            for (uint32_t t : vertexTriangles[from])
+            {
+                if (contains(t, to))
+                {
+                    continue;
+                }
+                const float *p[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = position(remap[corners[3 * t + k]]);
+                }
+                double before[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                for (int k = 0; k < 3; k++)
+                {
+                    if (remap[corners[3 * t + k]] == from)
+                    {
+                        p[k] = position(to);
+                    }
+                }
+                double after[3];
+                triangleNormal(p[0], p[1], p[2], after);
+                double beforeLength = std::sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+                double afterLength = std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+                double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                if (afterLength <= 0.0 || dot < MIN_NORMAL_COSINE * beforeLength * afterLength)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        // the vertex at position to whose attributes are closest to those of vertex
+        auto closestVertex = [&](uint32_t to, uint32_t vertex)
+        {
+            uint32_t best = to;
+            if (attributes == nullptr || groupEnd[to] - groupBegin[to] == 1)
+            {
+                return best;
+            }
+            float bestDistance = INFINITY;
+            const float *reference = attribute(vertex);
+            for (uint32_t i = groupBegin[to]; i < groupEnd[to]; i++)
+            {
+                const float *candidate = attribute(sorted[i]);
+                float distance = 0.f;
+                for (size_t k = 0; k < attributeCount; k++)
+                {
+                    distance += (candidate[k] - reference[k]) * (candidate[k] - reference[k]);
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = sorted[i];
+                }
+            }
+            return best;
+        };
+
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; alive[t] && k < 3; k++)
+            {
+                uint32_t a = remap[corners[3 * t + k]], b = remap[corners[3 * t + (k + 1) % 3]];
+                pushCollapse(a, b);
+                pushCollapse(b, a);
+            }
+        }
+
+        float maxError = 0.f;
+        while (liveTriangles * 3 > targetIndexCount && !queue.empty())
+        {
+            Collapse collapse = queue.top();
+            queue.pop();
+            uint32_t from = collapse.from;
+            uint32_t to = collapse.to;
+            if (removed[from] || removed[to] || versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion)
+            {
+                continue;
+            }
+            if (collapse.error > targetError)
+            {
+                break;
+            }
+            if (!canCollapse(from, to))
+            {
+                continue;
+            }
+
+            for (uint32_t t : vertexTriangles[from])
+            {
+                if (contains(t, to))
+                {
+                    alive[t] = false;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    if (remap[corners[3 * t + k]] == from)
+                    {
+                        corners[3 * t + k] = closestVertex(to, corners[3 * t + k]);
+                    }
+                }
+                vertexTriangles[to].push_back(t);
+            }
+            vertexTriangles[from].clear();
+            quadrics[to].add(quadrics[from]);
+            removed[from] = true;
+            versions[to]++;
+            maxError = std::max(maxError, collapse.error);
+
+            compact(to);
+            for (uint32_t t : vertexTriangles[to])
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t other = remap[corners[3 * t + k]];
+                    pushCollapse(other, to);
+                    pushCollapse(to, other);
+                }
+            }
+        }
+
+        size_t written = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (alive[t])
+            {
+                std::copy(corners.begin() + 3 * t, corners.begin() + 3 * t + 3, destination + written);
+                written += 3;
+            }
+        }
+        if (resultError != nullptr)
+        {
+            *resultError = maxError;
+        }
+        return written;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cfx
+{
+    /*
+     * Quadric error metric edge collapse for indexed triangle lists.
+     *
+     * Vertices sharing a position are collapsed together, and every collapse moves a vertex
+     * onto one of its neighbours instead of to a new position. The result therefore indexes
+     * the original vertex buffer, and any number of levels can share one vertex buffer.
+     * Where a position has several vertices (normal or uv seams), each corner picks the
+     * vertex of the kept position whose attributes are closest to the one it had.
+     *
+     * Open borders only collapse along themselves, non-manifold vertices never move, and
+     * collapses that would flip a triangle are skipped.
+     */
+    class CFXMeshSimplifier
+    {
+    public:
+        // Writes at most indexCount indices to destination and returns how many were written.
+        // Collapses edges until the index count reaches targetIndexCount or the next collapse
+        // costs more than targetError, a distance in model units. positions and attributes
+        // (attributeCount floats, may be null) share vertexStride. resultError, if not null,
+        // receives the largest error of the collapses made.
+        static size_t simplify(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                               const float *positions, size_t vertexStride, size_t vertexCount,
+                               const float *attributes, size_t attributeCount,
+                               size_t targetIndexCount, float targetError, float *resultError);
+    };
+}
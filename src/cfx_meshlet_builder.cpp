@@ -0,0 +1,113 @@
+#include "cfx_meshlet_builder.hpp"
+#include "cfx_bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cfx
+{
+    // narrower than this (cosine of the widest normal from the axis) the cone culls too little to bother
+    static constexpr float MIN_CONE_SPREAD = 0.1f;
+
+    static glm::vec3 positionAt(const float *positions, size_t vertexStride, uint32_t index)
+    {
+        const float *position = reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + index * vertexStride);
+        return glm::vec3{position[0], position[1], position[2]};
+    }
+
+    static void finishMeshlet(CFXMeshlet &meshlet, const uint32_t *indices, const float *positions, size_t vertexStride)
+    {
+        const uint32_t *meshletIndices = indices + meshlet.firstIndex;
+        CFXBounds bounds = CFXBounds::fromIndexedPositions(positions, vertexStride, meshletIndices, meshlet.indexCount);
+        meshlet.center = bounds.center;
+        meshlet.radius = bounds.radius;
+
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.indexCount / 3);
+        glm::vec3 axis{0.f};
+        for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+        {
+            glm::vec3 a = positionAt(positions, vertexStride, meshletIndices[i]);
+            glm::vec3 b = positionAt(positions, vertexStride, meshletIndices[i + 1]);
+            glm::vec3 c = positionAt(positions, vertexStride, meshletIndices[i + 2]);
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = std::sqrt(glm::dot(normal, normal));
+            if (length > 0.f)
+            {
+                normals.push_back(normal * (1.f / length));
+                axis = axis + normals.back();
+            }
+        }
+
+        meshlet.coneAxis = glm::vec3{0.f};
+        meshlet.coneCutoff = 1.f;
+        float axisLength = std::sqrt(glm::dot(axis, axis));
+        if (axisLength == 0.f)
+        {
+            return;
+        }
+        axis = axis * (1.f / axisLength);
+        float minCosine = 1.f;
+        for (const glm::vec3 &normal : normals)
+        {
+            minCosine = std::min(minCosine, glm::dot(axis, normal));
+        }
+        meshlet.coneAxis = axis;
+        if (minCosine > MIN_CONE_SPREAD)
+        {
+            meshlet.coneCutoff = std::sqrt(1.f - minCosine * minCosine);
+        }
+    }
+
+    void CFXMeshletBuilder::build(std::vector<CFXMeshlet> &meshlets, const uint32_t *indices, size_t indexCount, uint32_t firstIndex,
+                                  const float *positions, size_t vertexStride, size_t vertexCount)
+    {
+        // stamp[v] is the meshlet that last took vertex v
+        std::vector<uint32_t> stamp(vertexCount, UINT32_MAX);
+        uint32_t meshletId = 0;
+        CFXMeshlet meshlet{};
+        meshlet.firstIndex = 0;
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const uint32_t *triangle = indices + i;
+            uint32_t newVertices = 0;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                bool repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+                newVertices += stamp[triangle[corner]] != meshletId && !repeated ? 1 : 0;
+            }
+
+            if (meshlet.indexCount == MAX_TRIANGLES * 3 || meshlet.vertexCount + newVertices > MAX_VERTICES)
+            {
+                finishMeshlet(meshlet, indices, positions, vertexStride);
+                meshlet.firstIndex += firstIndex;
+                meshlets.push_back(meshlet);
+
+                meshlet = CFXMeshlet{};
+                meshlet.firstIndex = static_cast<uint32_t>(i);
+                meshletId++;
+                newVertices = 0;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    bool repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+                    newVertices += repeated ? 0 : 1;
+                }
+            }
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                stamp[triangle[corner]] = meshletId;
+            }
+            meshlet.vertexCount += newVertices;
+            meshlet.indexCount += 3;
+        }
+
+        if (meshlet.indexCount > 0)
+        {
+            finishMeshlet(meshlet, indices, positions, vertexStride);
+            meshlet.firstIndex += firstIndex;
+            meshlets.push_back(meshlet);
+        }
+    }
+}
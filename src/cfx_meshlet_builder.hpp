@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * A cluster of at most CFXMeshletBuilder::MAX_VERTICES vertices and MAX_TRIANGLES
+     * triangles, stored as a contiguous range of the model's index buffer so it draws with
+     * a plain indexed draw. Laid out like the Meshlet struct of meshlet_cull.comp (std430),
+     * and plain data so it goes to the mesh cache and the geometry arena as is.
+     */
+    struct CFXMeshlet
+    {
+        // bounding sphere, model space
+        glm::vec3 center{0.f};
+        float radius = 0.f;
+        // every triangle normal lies within the cone, coneCutoff is the sine of its half angle
+        // and 1 when the cone is too wide to ever cull anything
+        glm::vec3 coneAxis{0.f};
+        float coneCutoff = 1.f;
+        // relative to the first index of the model
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t vertexCount = 0;
+        uint32_t padding = 0;
+    };
+    static_assert(sizeof(CFXMeshlet) == 48, "CFXMeshlet must match the std430 layout of meshlet_cull.comp");
+
+    class CFXMeshletBuilder
+    {
+    public:
+        static constexpr uint32_t MAX_VERTICES = 64;
+        static constexpr uint32_t MAX_TRIANGLES = 124;
+
+        // Splits indices[0, indexCount) into meshlets in index order, so a cache-optimized
+        // index buffer gives compact clusters and keeps its order. firstIndex is added to the
+        // ranges of the appended meshlets.
+        static void build(std::vector<CFXMeshlet> &meshlets, const uint32_t *indices, size_t indexCount, uint32_t firstIndex,
+                          const float *positions, size_t vertexStride, size_t vertexCount);
+    };
+}
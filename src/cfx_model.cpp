@@ -1,116 +1,261 @@
+// the tinyobj implementation block has no include guard, so pull in its declarations first
+#include "cfx_obj_loader.hpp"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 #include "cfx_model.hpp"
-#include "cfx_utils.hpp"
+#include "cfx_asset_archive.hpp"
+#include "cfx_mesh_optimizer.hpp"
+#include "cfx_mesh_simplifier.hpp"
+#include "cfx_vertex_dedup.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <iostream>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
-#include <unordered_map>
-
-namespace std
+namespace cfx
 {
-    template <>
-    struct hash<cfx::CFXModel::Vertex>
+    // LOD simplification stops at this error relative to the bounding radius
+    static constexpr float LOD_MAX_RELATIVE_ERROR = 0.05f;
+    // and when a level keeps more than this fraction of the previous level's indices
+    static constexpr float LOD_MIN_REDUCTION = 0.85f;
+
+    CFXModel::CFXModel(CFXDevice &device, CFXGeometryArena &arena, const CFXModel::Builder &builder)
+        : CFXModel{device, arena, builder.vertexFormat}
+    {
+        upload(builder);
+        // the caller submits the upload queue before the first frame records a draw
+        ready = true;
+    }
+    CFXModel::CFXModel(CFXDevice &device, CFXGeometryArena &arena, VertexFormat vertexFormat)
+        : cfxDevice{device}, geometryArena{arena}, vertexFormat{vertexFormat}
     {
-        size_t operator()(cfx::CFXModel::Vertex const &vertex) const
+    }
+    void CFXModel::upload(const CFXModel::Builder &builder)
+    {
+        bounds = builder.bounds;
+        submeshes = builder.submeshes;
+        lods = builder.lods;
+        if (lods.empty())
         {
-            size_t seed = 0;
-            cfx::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
-
-            // cout << "SEED " << seed << endl;
-            return seed;
+            // hand built meshes only have the full detail level
+            lods.push_back(Lod{0, static_cast<uint32_t>(builder.indexCount()), 0.f});
         }
-    };
-}
-
-namespace cfx
-{
-    CFXModel::CFXModel(CFXDevice &device, const CFXModel::Builder &builder) : cfxDevice{device}
-    {
-        vertexBuffer.resize(cfxDevice.getDevicesinDeviceGroup());
-        indexBuffer.resize(cfxDevice.getDevicesinDeviceGroup());
-        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        if (builder.vertexCount() <= UINT16_MAX + 1u)
+        {
+            indexType = VK_INDEX_TYPE_UINT16;
+        }
+        // straight into the staging memory, from the mesh cache or GLB mapping when the builder keeps them there
+        if (vertexFormat == VertexFormat::Packed)
+        {
+            computePositionTransform();
+            createVertexBuffers(sizeof(PackedVertex), builder.vertexCount(), [this, &builder](void *destination)
+                                { packVertices(builder, static_cast<PackedVertex *>(destination)); });
+        }
+        else
+        {
+            createVertexBuffers(sizeof(Vertex), builder.vertexCount(), [&builder](void *destination)
+                                { builder.copyVertices(static_cast<Vertex *>(destination), 0, builder.vertexCount()); });
+        }
+        if (indexType == VK_INDEX_TYPE_UINT16)
+        {
+            // narrowed while staging
+            createIndexBuffers(sizeof(uint16_t), builder.indexCount(), [&builder](void *destination)
+                               { std::copy(builder.indexData(), builder.indexData() + builder.indexCount(), static_cast<uint16_t *>(destination)); });
+        }
+        else
         {
-            createVertexBuffers(builder.vertices, i);
-            createIndexBuffers(builder.indices, i);
+            createIndexBuffers(sizeof(uint32_t), builder.indexCount(), [&builder](void *destination)
+                               { memcpy(destination, builder.indexData(), builder.indexCount() * sizeof(uint32_t)); });
         }
+        createMeshletBuffers(builder.meshlets.data(), static_cast<uint32_t>(builder.meshlets.size()));
     }
     CFXModel::~CFXModel()
     {
+        release();
+    }
+    void CFXModel::release()
+    {
+        geometryArena.free(CFXGeometryArena::Pool::Vertex, vertexAllocation);
+        geometryArena.free(CFXGeometryArena::Pool::Index, indexAllocation);
+        geometryArena.free(CFXGeometryArena::Pool::Meshlet, meshletAllocation);
+        vertexAllocation = {};
+        indexAllocation = {};
+        meshletAllocation = {};
+        ready = false;
+    }
+    CFXModel *CFXModel::getDrawable()
+    {
+        used = true;
+        if (ready)
+        {
+            return this;
+        }
+        return placeholder && placeholder->ready ? placeholder.get() : nullptr;
     }
-    std::unique_ptr<CFXModel> CFXModel::createModelFromFile(CFXDevice &device, const std::string &filepath)
+    std::unique_ptr<CFXModel> CFXModel::createModelFromFile(CFXDevice &device, CFXGeometryArena &arena, const std::string &filepath, VertexFormat vertexFormat)
     {
         Builder builder{};
+        builder.vertexFormat = vertexFormat;
         builder.loadModel(filepath);
         // std::cout << "Vertex Count "<< builder.vertices.size() << std::endl;
-        return std::make_unique<CFXModel>(device, builder);
+        return std::make_unique<CFXModel>(device, arena, builder);
     }
-    void CFXModel::createVertexBuffers(const std::vector<Vertex> &vertices, int deviceIndex)
+    static_assert(sizeof(CFXModel::PackedVertex) == 20, "PackedVertex must match its vertex attribute layout");
+
+    static int16_t quantizeSnorm16(float value)
     {
-        vertexCount = static_cast<uint32_t>(vertices.size());
-        assert(vertexCount >= 3 && "Vertex count must be at least 3");
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-        uint32_t vertexSize = sizeof(vertices[0]);
-        CFXBuffer stagingBuffer{cfxDevice, vertexSize, vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, deviceIndex};
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void *)vertices.data());
+        return static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f));
+    }
+
+    static uint8_t quantizeUnorm8(float value)
+    {
+        return static_cast<uint8_t>(std::round(std::clamp(value, 0.f, 1.f) * 255.f));
+    }
+
+    // Octahedral normal encoding, see "A Survey of Efficient Representations for Independent Unit Vectors"
+    static glm::vec2 encodeOctahedral(glm::vec3 normal)
+    {
+        float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (l1 == 0.f)
+        {
+            return glm::vec2{0.f, 0.f};
+        }
+        glm::vec2 encoded{normal.x / l1, normal.y / l1};
+        if (normal.z < 0.f)
+        {
+            encoded = glm::vec2{(1.f - std::abs(encoded.y)) * (encoded.x >= 0.f ? 1.f : -1.f),
+                                (1.f - std::abs(encoded.x)) * (encoded.y >= 0.f ? 1.f : -1.f)};
+        }
+        return encoded;
+    }
+
+    void CFXModel::computePositionTransform()
+    {
+        glm::vec3 halfExtent = bounds.extent() * 0.5f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // flat axes (the floor quad) quantize to 0 whatever the scale
+            if (halfExtent[axis] <= 0.f)
+            {
+                halfExtent[axis] = 1.f;
+            }
+        }
+        positionTransform = glm::scale(glm::translate(glm::mat4{1.f}, bounds.center), halfExtent);
+    }
 
-        vertexBuffer[deviceIndex] = std::make_unique<CFXBuffer>(cfxDevice, vertexSize, vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceIndex);
+    void CFXModel::packVertices(const Builder &builder, PackedVertex *packed) const
+    {
+        // vertices the builder does not hold in memory are gathered a chunk at a time
+        static constexpr uint32_t CHUNK_SIZE = 256;
+        glm::vec3 center{positionTransform[3]};
+        glm::vec3 halfExtent{positionTransform[0][0], positionTransform[1][1], positionTransform[2][2]};
+        const Vertex *vertices = builder.vertexData();
+        std::vector<Vertex> chunk{};
+        for (uint32_t first = 0; first < builder.vertexCount(); first += CHUNK_SIZE)
+        {
+            uint32_t count = std::min(CHUNK_SIZE, builder.vertexCount() - first);
+            const Vertex *source = vertices + first;
+            if (vertices == nullptr)
+            {
+                chunk.resize(count);
+                builder.copyVertices(chunk.data(), first, count);
+                source = chunk.data();
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const Vertex &vertex = source[i];
+                PackedVertex out;
+                glm::vec3 position = (vertex.position - center) / halfExtent;
+                glm::vec2 normal = encodeOctahedral(vertex.normal);
+                out.position[0] = quantizeSnorm16(position.x);
+                out.position[1] = quantizeSnorm16(position.y);
+                out.position[2] = quantizeSnorm16(position.z);
+                out.position[3] = 0;
+                out.normal[0] = quantizeSnorm16(normal.x);
+                out.normal[1] = quantizeSnorm16(normal.y);
+                out.color[0] = quantizeUnorm8(vertex.color.x);
+                out.color[1] = quantizeUnorm8(vertex.color.y);
+                out.color[2] = quantizeUnorm8(vertex.color.z);
+                out.color[3] = 255;
+                out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+                out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+                // staging memory is usually write combined, so whole vertices are stored at once
+                packed[first + i] = out;
+            }
+        }
+    }
 
-        cfxDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer[deviceIndex]->getBuffer(), bufferSize, deviceIndex);
+    void CFXModel::createVertexBuffers(uint32_t vertexSize, uint32_t count, const std::function<void(void *)> &write)
+    {
+        vertexCount = count;
+        assert(vertexCount >= 3 && "Vertex count must be at least 3");
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexSize) * vertexCount;
+        // aligned to the stride so the offset is a whole number of vertices
+        vertexAllocation = geometryArena.allocate(CFXGeometryArena::Pool::Vertex, bufferSize, vertexSize, placement);
+        vertexOffset = static_cast<int32_t>(vertexAllocation.offset / vertexSize);
+        geometryArena.upload(CFXGeometryArena::Pool::Vertex, vertexAllocation, write);
     }
 
-    void CFXModel::createIndexBuffers(const std::vector<uint32_t> &indices, int deviceIndex)
+    void CFXModel::createIndexBuffers(uint32_t indexSize, uint32_t count, const std::function<void(void *)> &write)
     {
-        indexCount = static_cast<uint32_t>(indices.size());
+        indexCount = count;
         hasIndexBuffer = indexCount > 0;
         if (!hasIndexBuffer)
         {
             return;
         }
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-        uint32_t indexSize = sizeof(indices[0]);
-        CFXBuffer stagingBuffer{cfxDevice, indexSize, indexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, deviceIndex};
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void *)indices.data());
-
-        indexBuffer[deviceIndex] = std::make_unique<CFXBuffer>(cfxDevice, indexSize, indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceIndex);
-
-        cfxDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer[deviceIndex]->getBuffer(), bufferSize, deviceIndex);
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * indexCount;
+        indexAllocation = geometryArena.allocate(CFXGeometryArena::Pool::Index, bufferSize, indexSize, placement);
+        firstIndex = static_cast<uint32_t>(indexAllocation.offset / indexSize);
+        geometryArena.upload(CFXGeometryArena::Pool::Index, indexAllocation, write);
     }
-    void CFXModel::draw(VkCommandBuffer commandBuffer)
+    void CFXModel::createMeshletBuffers(const CFXMeshlet *meshlets, uint32_t count)
+    {
+        meshletCount = count;
+        if (meshletCount == 0)
+        {
+            return;
+        }
+        VkDeviceSize bufferSize = sizeof(CFXMeshlet) * meshletCount;
+        meshletAllocation = geometryArena.allocate(CFXGeometryArena::Pool::Meshlet, bufferSize, sizeof(CFXMeshlet), placement);
+        geometryArena.upload(CFXGeometryArena::Pool::Meshlet, meshletAllocation, meshlets);
+    }
+    void CFXModel::drawMeshlets(VkCommandBuffer commandBuffer, VkBuffer drawBuffer, VkDeviceSize drawOffset, bool multiDrawIndirect)
+    {
+        if (multiDrawIndirect)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset, meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
+        for (uint32_t i = 0; i < meshletCount; i++)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset + i * sizeof(VkDrawIndexedIndirectCommand), 1, 0);
+        }
+    }
+    void CFXModel::draw(VkCommandBuffer commandBuffer, uint32_t lod)
     {
         if (hasIndexBuffer)
         {
-            vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+            const Lod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+            vkCmdDrawIndexed(commandBuffer, level.indexCount, 1, firstIndex + level.firstIndex, vertexOffset, 0);
         }
         else
         {
-            vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, vertexCount, 1, static_cast<uint32_t>(vertexOffset), 0);
         }
     }
 
-    void CFXModel::bind(VkCommandBuffer commandBuffer, int deviceIndex)
+    void CFXModel::bind(VkCommandBuffer commandBuffer, int deviceIndex, CFXGeometryArena::BindState &bindState)
     {
         // std::cout << "BIND OBJECT TO COMMAND BUFFER " << deviceIndex <<std::endl;
-
-        VkDeviceSize offsets[] = {0};
-        VkBuffer buffers[] = {vertexBuffer[deviceIndex]->getBuffer()};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
-
-        if (hasIndexBuffer)
-        {
-            vkCmdBindIndexBuffer(commandBuffer, indexBuffer[deviceIndex]->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
-        }
-        // std::cout << "BIND OBJECT TO COMMAND BUFFER END" <<std::endl;
+        geometryArena.bind(commandBuffer, deviceIndex, bindState, vertexAllocation, indexAllocation, indexType);
     }
 
     std::vector<VkVertexInputBindingDescription> CFXModel::Vertex::getBindingDescriptions()
@@ -130,23 +275,515 @@ namespace cfx
         inputAttributeDescriptions.push_back({3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)});
         return inputAttributeDescriptions;
     }
+    std::vector<VkVertexInputBindingDescription> CFXModel::PackedVertex::getBindingDescriptions()
+    {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(PackedVertex);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescriptions;
+    }
+    std::vector<VkVertexInputAttributeDescription> CFXModel::PackedVertex::getAttributeDescriptions()
+    {
+        // same locations as Vertex, the shader reads a 2 component normal as (x, y, 0)
+        std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions{};
+        inputAttributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, position)});
+        inputAttributeDescriptions.push_back({1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)});
+        inputAttributeDescriptions.push_back({2, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)});
+        inputAttributeDescriptions.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)});
+        return inputAttributeDescriptions;
+    }
+    std::vector<VkVertexInputBindingDescription> CFXModel::getBindingDescriptions(VertexFormat vertexFormat)
+    {
+        return vertexFormat == VertexFormat::Packed ? PackedVertex::getBindingDescriptions() : Vertex::getBindingDescriptions();
+    }
+    std::vector<VkVertexInputAttributeDescription> CFXModel::getAttributeDescriptions(VertexFormat vertexFormat)
+    {
+        return vertexFormat == VertexFormat::Packed ? PackedVertex::getAttributeDescriptions() : Vertex::getAttributeDescriptions();
+    }
+    // the cached mesh depends on the element sizes and on which optimizations produced it
+    uint64_t CFXModel::Builder::cacheLayoutKey() const
+    {
+        uint64_t processing = (optimizeVertexCache ? 1u : 0u) | (optimizeVertexCache && optimizeOverdraw ? 2u : 0u) | uint64_t(maxLodLevels & 0xff) << 2;
+        uint64_t creaseDegrees = static_cast<uint64_t>(std::lround(std::max(0.f, normalCreaseAngle) * 180.f / 3.14159265f)) & 0xff;
+        uint64_t normals = (normalWeighting == CFXNormalGenerator::Weighting::Angle ? 1u : 0u) | creaseDegrees << 1;
+        return processing << 48 | uint64_t(sizeof(Vertex)) << 32 | normals << 8 | sizeof(uint32_t);
+    }
+
+    // tinyobj opens files itself, files that were read ahead or packed into the asset archive are handed to it as a stream
+    static bool loadObjTinyObj(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes, std::vector<tinyobj::material_t> *materials,
+                               std::string *warn, std::string *error, const std::string &filepath, std::shared_ptr<CFXMappedFile> file)
+    {
+        const std::shared_ptr<CFXAssetArchive> &archive = CFXAssetArchive::mounted();
+        const CFXAssetArchive::Entry *entry = archive && file == nullptr ? archive->find(filepath) : nullptr;
+        if (entry != nullptr)
+        {
+            file = archive->read(*entry);
+        }
+        if (file == nullptr)
+        {
+            return tinyobj::LoadObj(attrib, shapes, materials, warn, error, filepath.c_str());
+        }
+        std::istringstream stream{std::string(reinterpret_cast<const char *>(file->data()), file->size())};
+        return tinyobj::LoadObj(attrib, shapes, materials, warn, error, &stream);
+    }
+
+    static bool hasGlbExtension(const std::string &filepath)
+    {
+        if (filepath.size() < 4)
+        {
+            return false;
+        }
+        std::string extension = filepath.substr(filepath.size() - 4);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        return extension == ".glb";
+    }
+
+    static float readGlbComponent(const CFXGlbFile::Accessor &accessor, uint32_t element, uint32_t component)
+    {
+        const uint8_t *data = accessor.data + static_cast<size_t>(element) * accessor.stride;
+        switch (accessor.componentType)
+        {
+        case CFXGlbFile::UNSIGNED_BYTE:
+            return data[component] / 255.f;
+        case CFXGlbFile::UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            memcpy(&value, data + component * sizeof(uint16_t), sizeof(value));
+            return value / 65535.f;
+        }
+        default:
+        {
+            float value;
+            memcpy(&value, data + component * sizeof(float), sizeof(value));
+            return value;
+        }
+        }
+    }
+
+    static uint32_t readGlbIndex(const CFXGlbFile::Accessor &accessor, uint32_t element)
+    {
+        const uint8_t *data = accessor.data + static_cast<size_t>(element) * accessor.stride;
+        switch (accessor.componentType)
+        {
+        case CFXGlbFile::UNSIGNED_BYTE:
+            return data[0];
+        case CFXGlbFile::UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+        default:
+        {
+            uint32_t value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+        }
+    }
+
+    static CFXModel::Vertex readGlbVertex(const CFXGlbFile::Primitive &primitive, uint32_t element)
+    {
+        CFXModel::Vertex vertex{};
+        // same default as tinyobj for meshes without vertex colors
+        vertex.color = {1.f, 1.f, 1.f};
+        memcpy(&vertex.position, primitive.position.data + static_cast<size_t>(element) * primitive.position.stride, sizeof(glm::vec3));
+        if (primitive.normal.valid())
+        {
+            memcpy(&vertex.normal, primitive.normal.data + static_cast<size_t>(element) * primitive.normal.stride, sizeof(glm::vec3));
+        }
+        if (primitive.texcoord.valid())
+        {
+            memcpy(&vertex.uv, primitive.texcoord.data + static_cast<size_t>(element) * primitive.texcoord.stride, sizeof(glm::vec2));
+        }
+        if (primitive.color.valid())
+        {
+            vertex.color = {readGlbComponent(primitive.color, element, 0), readGlbComponent(primitive.color, element, 1),
+                            readGlbComponent(primitive.color, element, 2)};
+        }
+        return vertex;
+    }
+
+    void CFXModel::Builder::copyVertices(Vertex *destination, uint32_t first, uint32_t count) const
+    {
+        if (glbFile == nullptr)
+        {
+            memcpy(destination, vertexData() + first, static_cast<size_t>(count) * sizeof(Vertex));
+            return;
+        }
+        const std::vector<CFXGlbFile::Primitive> &primitives = glbFile->getPrimitives();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t element = glbVertexOrder[first + i];
+            size_t primitive = std::upper_bound(glbFirstElements.begin(), glbFirstElements.end(), element) - glbFirstElements.begin() - 1;
+            destination[i] = readGlbVertex(primitives[primitive], element - glbFirstElements[primitive]);
+        }
+    }
+
     void CFXModel::Builder::loadModel(const std::string &filepath)
     {
+        stats = {};
+        releaseMappedData();
+        if (loadCache(filepath))
+        {
+            return;
+        }
+        if (hasGlbExtension(filepath))
+        {
+            loadGlb(filepath);
+        }
+        else
+        {
+            loadObj(filepath);
+        }
+        if (missingNormals)
+        {
+            generateNormals();
+        }
+        if (optimizeVertexCache)
+        {
+            optimizeMesh();
+        }
+        computeBounds();
+        buildMeshlets();
+        buildLods();
+        writeCache(filepath);
+        // only the processing reads it, the upload gathers from the mapping
+        shapeVertices.clear();
+        shapeVertices.shrink_to_fit();
+    }
+
+    const float *CFXModel::Builder::shapePositions() const
+    {
+        return glbFile ? &shapeVertices.data()->position.x : &vertices.data()->position.x;
+    }
+
+    const float *CFXModel::Builder::shapeAttributes() const
+    {
+        return glbFile ? &shapeVertices.data()->normal.x : &vertices.data()->normal.x;
+    }
+
+    size_t CFXModel::Builder::shapeStride() const
+    {
+        return glbFile ? sizeof(ShapeVertex) : sizeof(Vertex);
+    }
+
+    void CFXModel::Builder::generateNormals()
+    {
+        if (indices.empty())
+        {
+            return;
+        }
+        auto normalStart = std::chrono::high_resolution_clock::now();
+        if (normalCreaseAngle <= 0.f)
+        {
+            std::vector<float> normals(vertices.size() * 3);
+            CFXNormalGenerator::generateVertexNormals(normals.data(), &vertices[0].position.x, sizeof(Vertex), vertices.size(),
+                                                      indices.data(), indices.size(), normalWeighting);
+            for (size_t i = 0; i < vertices.size(); i++)
+            {
+                if (vertices[i].normal == glm::vec3{0.f})
+                {
+                    vertices[i].normal = {normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]};
+                }
+            }
+        }
+        else
+        {
+            // corners of one vertex may end up on different sides of a crease, so the
+            // vertices are rebuilt from the corners and deduplicated again
+            std::vector<float> normals(indices.size() * 3);
+            CFXNormalGenerator::generateCornerNormals(normals.data(), &vertices[0].position.x, sizeof(Vertex), vertices.size(),
+                                                      indices.data(), indices.size(), normalWeighting, normalCreaseAngle);
+            std::vector<Vertex> creasedVertices{};
+            CFXVertexDedup uniqueVertices{creasedVertices, indices.size()};
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                Vertex vertex = vertices[indices[i]];
+                if (vertex.normal == glm::vec3{0.f})
+                {
+                    vertex.normal = {normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]};
+                }
+                indices[i] = uniqueVertices.insert(vertex);
+            }
+            vertices.swap(creasedVertices);
+        }
+        if (collectStats)
+        {
+            stats.normalTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - normalStart).count();
+        }
+    }
+
+    bool CFXModel::Builder::hasValidCache(const std::string &filepath) const
+    {
+        return CFXMeshCache::open(filepath, cacheLayoutKey()) != nullptr;
+    }
+
+    void CFXModel::Builder::optimizeMesh()
+    {
+        if (indices.empty())
+        {
+            return;
+        }
+        if (collectStats)
+        {
+            CFXMeshOptimizer::VertexCacheStats before = CFXMeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount());
+            stats.acmrBefore = before.acmr;
+            stats.atvrBefore = before.atvr;
+        }
+        // triangles only move within their submesh so the ranges stay valid
+        for (const Submesh &submesh : submeshes)
+        {
+            uint32_t *submeshIndices = indices.data() + submesh.firstIndex;
+            CFXMeshOptimizer::optimizeVertexCache(submeshIndices, submesh.indexCount, vertexCount());
+            if (optimizeOverdraw)
+            {
+                CFXMeshOptimizer::optimizeOverdraw(submeshIndices, submesh.indexCount, shapePositions(), shapeStride(), vertexCount());
+            }
+        }
+        if (glbFile)
+        {
+            // the mapped vertices stay where they are, only the order they are uploaded in changes
+            size_t count = CFXMeshOptimizer::optimizeVertexFetch(shapeVertices.data(), shapeVertices.size(), sizeof(ShapeVertex), indices.data(), indices.size());
+            shapeVertices.resize(count);
+            vertexOrder.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                vertexOrder[i] = shapeVertices[i].source;
+            }
+            glbVertexOrder = vertexOrder.data();
+            glbVertexCount = static_cast<uint32_t>(count);
+        }
+        else
+        {
+            size_t count = CFXMeshOptimizer::optimizeVertexFetch(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size());
+            vertices.resize(count);
+        }
+        if (collectStats)
+        {
+            CFXMeshOptimizer::VertexCacheStats after = CFXMeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount());
+            stats.acmrAfter = after.acmr;
+            stats.atvrAfter = after.atvr;
+        }
+    }
+
+    void CFXModel::Builder::computeBounds()
+    {
+        if (vertexCount() == 0)
+        {
+            return;
+        }
+        const float *positions = shapePositions();
+        bounds = CFXBounds::fromPositions(positions, shapeStride(), vertexCount());
+        for (Submesh &submesh : submeshes)
+        {
+            submesh.bounds = CFXBounds::fromIndexedPositions(positions, shapeStride(), indexData() + submesh.firstIndex, submesh.indexCount);
+        }
+    }
+
+    void CFXModel::Builder::buildMeshlets()
+    {
+        meshlets.clear();
+        for (const Submesh &submesh : submeshes)
+        {
+            CFXMeshletBuilder::build(meshlets, indexData() + submesh.firstIndex, submesh.indexCount, submesh.firstIndex,
+                                     shapePositions(), shapeStride(), vertexCount());
+        }
+    }
+
+    void CFXModel::Builder::buildLods()
+    {
+        lods.assign(1, Lod{0, indexCount(), 0.f});
+        if (indexCount() == 0 || maxLodLevels <= 1)
+        {
+            return;
+        }
+        float maxError = bounds.radius * LOD_MAX_RELATIVE_ERROR;
+        std::vector<uint32_t> simplified;
+        std::vector<uint32_t> levelIndices;
+        for (uint32_t level = 1; level < maxLodLevels; level++)
+        {
+            float ratio = std::ldexp(1.f, -static_cast<int>(level));
+            float levelError = 0.f;
+            levelIndices.clear();
+            // per submesh so their borders stay put and the levels keep the same shapes
+            for (const Submesh &submesh : submeshes)
+            {
+                simplified.resize(submesh.indexCount);
+                size_t target = static_cast<size_t>(submesh.indexCount * ratio) / 3 * 3;
+                float error = 0.f;
+                // normal and uv are contiguous, seams pick the closest of those
+                size_t count = CFXMeshSimplifier::simplify(simplified.data(), indices.data() + submesh.firstIndex, submesh.indexCount,
+                                                           shapePositions(), shapeStride(), vertexCount(),
+                                                           shapeAttributes(), 5, target, maxError, &error);
+                levelIndices.insert(levelIndices.end(), simplified.begin(), simplified.begin() + count);
+                levelError = std::max(levelError, error);
+            }
+            if (levelIndices.empty() || levelIndices.size() > lods.back().indexCount * LOD_MIN_REDUCTION)
+            {
+                break;
+            }
+            CFXMeshOptimizer::optimizeVertexCache(levelIndices.data(), levelIndices.size(), vertexCount());
+            lods.push_back(Lod{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(levelIndices.size()), levelError});
+            indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+        }
+    }
+
+    bool CFXModel::Builder::loadCache(const std::string &filepath)
+    {
+        std::shared_ptr<CFXMeshCache> cache = CFXMeshCache::open(filepath, cacheLayoutKey());
+        if (cache == nullptr)
+        {
+            return false;
+        }
+        const CFXMeshCache::Section *vertexSection = cache->findSection(CFXMeshCache::SECTION_VERTICES);
+        const CFXMeshCache::Section *indexSection = cache->findSection(CFXMeshCache::SECTION_INDICES);
+        const CFXMeshCache::Section *boundsSection = cache->findSection(CFXMeshCache::SECTION_BOUNDS);
+        const CFXMeshCache::Section *submeshSection = cache->findSection(CFXMeshCache::SECTION_SUBMESHES);
+        const CFXMeshCache::Section *lodSection = cache->findSection(CFXMeshCache::SECTION_LODS);
+        const CFXMeshCache::Section *meshletSection = cache->findSection(CFXMeshCache::SECTION_MESHLETS);
+        // vertices kept in a GLB are cached as the order of their elements
+        const CFXMeshCache::Section *orderSection = vertexSection ? nullptr : cache->findSection(CFXMeshCache::SECTION_VERTEX_ORDER);
+        bool vertexLayout = (vertexSection != nullptr && vertexSection->elementSize == sizeof(Vertex)) ||
+                            (orderSection != nullptr && orderSection->elementSize == sizeof(uint32_t));
+        if (!vertexLayout ||
+            indexSection == nullptr || indexSection->elementSize != sizeof(uint32_t) ||
+            boundsSection == nullptr || boundsSection->elementSize != sizeof(CFXBounds) || boundsSection->elementCount != 1 ||
+            submeshSection == nullptr || submeshSection->elementSize != sizeof(Submesh) ||
+            lodSection == nullptr || lodSection->elementSize != sizeof(Lod) || lodSection->elementCount == 0 ||
+            meshletSection == nullptr || meshletSection->elementSize != sizeof(CFXMeshlet))
+        {
+            return false;
+        }
+        // a stale or damaged cache must not hand out-of-range indices to the GPU
+        uint64_t cacheVertexCount = orderSection != nullptr ? orderSection->elementCount : vertexSection->elementCount;
+        const uint32_t *cachedIndexData = static_cast<const uint32_t *>(cache->sectionData(*indexSection));
+        if (std::any_of(cachedIndexData, cachedIndexData + indexSection->elementCount, [cacheVertexCount](uint32_t index)
+                        { return index >= cacheVertexCount; }))
+        {
+            return false;
+        }
+        if (orderSection != nullptr)
+        {
+            std::shared_ptr<CFXGlbFile> glb = CFXGlbFile::open(filepath, source);
+            uint32_t elementCount = 0;
+            for (const CFXGlbFile::Primitive &primitive : glb->getPrimitives())
+            {
+                elementCount += primitive.position.count;
+            }
+            const uint32_t *order = static_cast<const uint32_t *>(cache->sectionData(*orderSection));
+            if (std::any_of(order, order + orderSection->elementCount, [elementCount](uint32_t element)
+                            { return element >= elementCount; }))
+            {
+                return false;
+            }
+            useGlb(std::move(glb));
+            glbVertexOrder = order;
+            glbVertexCount = static_cast<uint32_t>(orderSection->elementCount);
+        }
+        else
+        {
+            cachedVertices = static_cast<const Vertex *>(cache->sectionData(*vertexSection));
+            cachedVertexCount = static_cast<uint32_t>(vertexSection->elementCount);
+        }
+        const CFXMeshlet *cachedMeshlets = static_cast<const CFXMeshlet *>(cache->sectionData(*meshletSection));
+        meshlets.assign(cachedMeshlets, cachedMeshlets + meshletSection->elementCount);
+        const Lod *cachedLods = static_cast<const Lod *>(cache->sectionData(*lodSection));
+        lods.assign(cachedLods, cachedLods + lodSection->elementCount);
+        bounds = *static_cast<const CFXBounds *>(cache->sectionData(*boundsSection));
+        const Submesh *cachedSubmeshes = static_cast<const Submesh *>(cache->sectionData(*submeshSection));
+        submeshes.assign(cachedSubmeshes, cachedSubmeshes + submeshSection->elementCount);
+        vertices.clear();
+        indices.clear();
+        cachedIndices = cachedIndexData;
+        cachedIndexCount = static_cast<uint32_t>(indexSection->elementCount);
+        meshCache = std::move(cache);
+        return true;
+    }
+
+    void CFXModel::Builder::writeCache(const std::string &filepath) const
+    {
+        CFXMeshCache::SectionData vertexSection{CFXMeshCache::SECTION_VERTICES, sizeof(Vertex), vertices.size(), vertices.data()};
+        if (glbFile)
+        {
+            vertexSection = {CFXMeshCache::SECTION_VERTEX_ORDER, sizeof(uint32_t), glbVertexCount, glbVertexOrder};
+        }
+        std::vector<CFXMeshCache::SectionData> sections{
+            vertexSection,
+            {CFXMeshCache::SECTION_INDICES, sizeof(uint32_t), indices.size(), indices.data()},
+            {CFXMeshCache::SECTION_BOUNDS, sizeof(CFXBounds), 1, &bounds},
+            {CFXMeshCache::SECTION_SUBMESHES, sizeof(Submesh), submeshes.size(), submeshes.data()},
+            {CFXMeshCache::SECTION_LODS, sizeof(Lod), lods.size(), lods.data()},
+            {CFXMeshCache::SECTION_MESHLETS, sizeof(CFXMeshlet), meshlets.size(), meshlets.data()},
+        };
+        if (!CFXMeshCache::write(filepath, cacheLayoutKey(), sections))
+        {
+            std::cerr << "Could not write mesh cache for " << filepath << std::endl;
+        }
+    }
+
+    void CFXModel::Builder::releaseMappedData()
+    {
+        meshCache.reset();
+        glbFile.reset();
+        glbFirstElements.clear();
+        glbVertexOrder = nullptr;
+        glbVertexCount = 0;
+        vertexOrder.clear();
+        shapeVertices.clear();
+        cachedVertices = nullptr;
+        cachedVertexCount = 0;
+        cachedIndices = nullptr;
+        cachedIndexCount = 0;
+    }
+
+    void CFXModel::Builder::loadObj(const std::string &filepath)
+    {
+        releaseMappedData();
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
         std::string warn;
         std::string error;
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, filepath.c_str()))
+        auto parseStart = std::chrono::high_resolution_clock::now();
+        bool loaded;
+        if (objParser == ObjParser::TinyObj)
+        {
+            loaded = loadObjTinyObj(&attrib, &shapes, &materials, &warn, &error, filepath, source);
+        }
+        else
+        {
+            loaded = source ? loadObjParallel(&attrib, &shapes, &warn, &error, filepath, *source)
+                            : loadObjParallel(&attrib, &shapes, &warn, &error, filepath);
+        }
+        if (!loaded)
         {
             throw std::runtime_error(warn + error);
         }
+        if (collectStats)
+        {
+            stats.parseTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - parseStart).count();
+        }
         vertices.clear();
         indices.clear();
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+        submeshes.clear();
+        missingNormals = false;
+        size_t indexTotal = 0;
+        for (const auto &shape : shapes)
+        {
+            indexTotal += shape.mesh.indices.size();
+        }
+        indices.reserve(indexTotal);
+        CFXVertexDedup uniqueVertices{vertices, indexTotal};
 
-                for (const auto &shape : shapes)
+        for (const auto &shape : shapes)
         {
+            if (!shape.mesh.indices.empty())
+            {
+                submeshes.push_back(Submesh{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(shape.mesh.indices.size()), {}});
+            }
             for (const auto &index : shape.mesh.indices)
             {
                 Vertex vertex{};
@@ -174,6 +811,10 @@ namespace cfx
                         attrib.normals[3 * index.normal_index + 2],
                     };
                 }
+                else
+                {
+                    missingNormals = true;
+                }
 
                 if (index.texcoord_index >= 0)
                 {
@@ -183,13 +824,131 @@ namespace cfx
                     };
                 }
 
-                if (uniqueVertices.count(vertex) == 0)
+                indices.push_back(uniqueVertices.insert(vertex));
+            }
+        }
+    }
+
+
+    void CFXModel::Builder::useGlb(std::shared_ptr<CFXGlbFile> glb)
+    {
+        glbFirstElements.clear();
+        uint32_t elementCount = 0;
+        for (const CFXGlbFile::Primitive &primitive : glb->getPrimitives())
+        {
+            glbFirstElements.push_back(elementCount);
+            elementCount += primitive.position.count;
+        }
+        glbFile = std::move(glb);
+    }
+
+    void CFXModel::Builder::loadGlb(const std::string &filepath)
+    {
+        releaseMappedData();
+        auto parseStart = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<CFXGlbFile> glb = CFXGlbFile::open(filepath, source);
+        vertices.clear();
+        indices.clear();
+        submeshes.clear();
+        missingNormals = false;
+
+        size_t vertexTotal = 0;
+        size_t indexTotal = 0;
+        // indexed primitives that come with normals are uploaded from the mapping as they are,
+        // anything else is rebuilt into vertices
+        bool keepMapped = true;
+        for (const CFXGlbFile::Primitive &primitive : glb->getPrimitives())
+        {
+            vertexTotal += primitive.position.count;
+            indexTotal += primitive.indices.valid() ? primitive.indices.count : primitive.position.count;
+            keepMapped &= primitive.indices.valid() && primitive.normal.valid();
+        }
+        if (keepMapped)
+        {
+            useGlb(glb);
+            shapeVertices.reserve(vertexTotal);
+        }
+        else
+        {
+            vertices.reserve(vertexTotal);
+        }
+        indices.reserve(indexTotal);
+
+        std::vector<Vertex> unindexedVertices{};
+        for (const CFXGlbFile::Primitive &primitive : glb->getPrimitives())
+        {
+            missingNormals |= !primitive.normal.valid();
+            uint32_t firstIndex = static_cast<uint32_t>(indices.size());
+            uint32_t baseVertex = static_cast<uint32_t>(keepMapped ? shapeVertices.size() : vertices.size());
+            if (primitive.indices.valid())
+            {
+                // already indexed, vertices are taken as they are without hashing
+                if (keepMapped)
+                {
+                    for (uint32_t i = 0; i < primitive.position.count; i++)
+                    {
+                        ShapeVertex vertex{};
+                        memcpy(&vertex.position, primitive.position.data + static_cast<size_t>(i) * primitive.position.stride, sizeof(glm::vec3));
+                        memcpy(&vertex.normal, primitive.normal.data + static_cast<size_t>(i) * primitive.normal.stride, sizeof(glm::vec3));
+                        if (primitive.texcoord.valid())
+                        {
+                            memcpy(&vertex.uv, primitive.texcoord.data + static_cast<size_t>(i) * primitive.texcoord.stride, sizeof(glm::vec2));
+                        }
+                        vertex.source = baseVertex + i;
+                        shapeVertices.push_back(vertex);
+                    }
+                }
+                else
+                {
+                    vertices.resize(baseVertex + primitive.position.count);
+                    for (uint32_t i = 0; i < primitive.position.count; i++)
+                    {
+                        vertices[baseVertex + i] = readGlbVertex(primitive, i);
+                    }
+                }
+                for (uint32_t i = 0; i < primitive.indices.count; i++)
+                {
+                    uint32_t index = readGlbIndex(primitive.indices, i);
+                    if (index >= primitive.position.count)
+                    {
+                        throw std::runtime_error(filepath + ": index out of range");
+                    }
+                    indices.push_back(baseVertex + index);
+                }
+            }
+            else
+            {
+                unindexedVertices.clear();
+                CFXVertexDedup uniqueVertices{unindexedVertices, primitive.position.count};
+                for (uint32_t i = 0; i < primitive.position.count; i++)
                 {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
+                    indices.push_back(baseVertex + uniqueVertices.insert(readGlbVertex(primitive, i)));
                 }
-                indices.push_back(uniqueVertices[vertex]);
+                vertices.insert(vertices.end(), unindexedVertices.begin(), unindexedVertices.end());
             }
+            uint32_t indexCount = static_cast<uint32_t>(indices.size()) - firstIndex;
+            if (indexCount % 3 != 0)
+            {
+                throw std::runtime_error(filepath + ": triangle list index count is not a multiple of 3");
+            }
+            if (indexCount > 0)
+            {
+                submeshes.push_back(Submesh{firstIndex, indexCount, {}});
+            }
+        }
+        if (keepMapped)
+        {
+            vertexOrder.resize(shapeVertices.size());
+            for (size_t i = 0; i < vertexOrder.size(); i++)
+            {
+                vertexOrder[i] = static_cast<uint32_t>(i);
+            }
+            glbVertexOrder = vertexOrder.data();
+            glbVertexCount = static_cast<uint32_t>(vertexOrder.size());
+        }
+        if (collectStats)
+        {
+            stats.parseTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - parseStart).count();
         }
     }
 
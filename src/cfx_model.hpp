@@ -1,19 +1,41 @@
 #pragma once
 
+#include "cfx_bounds.hpp"
 #include "cfx_device.hpp"
-#include "cfx_buffer.hpp"
+#include "cfx_geometry_arena.hpp"
+#include "cfx_glb_file.hpp"
+#include "cfx_mesh_cache.hpp"
+#include "cfx_meshlet_builder.hpp"
+#include "cfx_normal_generator.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <string>
 
 namespace cfx
 {
     class CFXModel
     {
     public:
+        // OBJ front end used when a model has no valid mesh cache
+        enum class ObjParser
+        {
+            TinyObj,
+            Parallel
+        };
+
+        // Layout of the vertex buffer uploaded to the GPU
+        enum class VertexFormat
+        {
+            Full,  // Vertex as is, 48 bytes
+            Packed // PackedVertex, 20 bytes
+        };
+        static constexpr size_t VERTEX_FORMAT_COUNT = 2;
+
         struct Vertex
         {
             glm::vec3 position{};
@@ -29,30 +51,236 @@ namespace cfx
                 return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
             }
         };
+
+        /*
+         * Quantized GPU vertex. Positions are snorm16 relative to the mesh bounds and get
+         * rescaled through getPositionTransform(), normals are octahedral snorm16x2, color is
+         * unorm8 and uvs are half floats. simple_shader.vert decodes the normal when its
+         * packedVertices specialization constant is set.
+         */
+        struct PackedVertex
+        {
+            int16_t position[4];
+            int16_t normal[2];
+            uint8_t color[4];
+            uint16_t uv[2];
+            static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+            static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        };
+        // Index range of one OBJ shape inside the model's index buffer
+        struct Submesh
+        {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            CFXBounds bounds;
+        };
+
+        // Index range of one detail level, error is its simplification error in model units
+        struct Lod
+        {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            float error;
+        };
+
         struct Builder
         {
+            // Filled when the mesh is parsed from OBJ or rebuilt from a GLB, left empty when it is
+            // mapped from the mesh cache or kept in the GLB mapping
             std::vector<Vertex> vertices{};
             std::vector<uint32_t> indices{};
+            ObjParser objParser = ObjParser::Parallel;
+            VertexFormat vertexFormat = VertexFormat::Full;
+            // Reorder freshly parsed meshes for the post-transform cache, then for overdraw
+            bool optimizeVertexCache = true;
+            bool optimizeOverdraw = true;
+            // Used for meshes that come without normals, corners of a vertex within normalCreaseAngle
+            // radians are smoothed together and 0 smooths across every edge
+            CFXNormalGenerator::Weighting normalWeighting = CFXNormalGenerator::Weighting::Angle;
+            float normalCreaseAngle = 0.f;
+            // Detail levels including the full mesh, each simplified to about half of the previous one
+            uint32_t maxLodLevels = 5;
+            // Filled either way, from the vertices or from the cache
+            CFXBounds bounds{};
+            std::vector<Submesh> submeshes{};
+            // Level 0 is the full mesh, the others follow it in the same index buffer
+            std::vector<Lod> lods{};
+            // Clusters of the full detail level, per submesh
+            std::vector<CFXMeshlet> meshlets{};
+            // Bytes of the model file if the caller already read them, e.g. through CFXFileReader,
+            // loadModel opens the file itself otherwise
+            std::shared_ptr<CFXMappedFile> source{};
+            // Timings and mesh statistics of the last loadModel, only measured while collectStats is set
+            struct Stats
+            {
+                // milliseconds spent reading the source file into vertices and indices
+                float parseTime = 0.f;
+                // milliseconds spent generating missing normals, 0 when the model has its own
+                float normalTime = 0.f;
+                // vertex cache efficiency of the full detail level around optimizeMesh, 0 when it did not run
+                float acmrBefore = 0.f;
+                float acmrAfter = 0.f;
+                float atvrBefore = 0.f;
+                float atvrAfter = 0.f;
+            };
+            bool collectStats = false;
+            Stats stats{};
+            // .glb files go through loadGlb, anything else is parsed as OBJ
             void loadModel(const std::string &filepath);
+            // True if the mesh cache for filepath is current, loadModel then never looks at the source
+            bool hasValidCache(const std::string &filepath) const;
+
+            // Mesh data to upload, pointing either into the vectors above or into a mapped file.
+            // vertexData() is null while the vertices are kept in a GLB mapping, copyVertices() works either way.
+            const Vertex *vertexData() const { return cachedVertices ? cachedVertices : glbFile ? nullptr : vertices.data(); }
+            uint32_t vertexCount() const
+            {
+                return cachedVertices ? cachedVertexCount : glbFile ? glbVertexCount : static_cast<uint32_t>(vertices.size());
+            }
+            // Writes vertices [first, first + count) to destination, reading the GLB accessors attribute
+            // by attribute when the vertices are kept in the mapping
+            void copyVertices(Vertex *destination, uint32_t first, uint32_t count) const;
+            const uint32_t *indexData() const { return cachedIndices ? cachedIndices : indices.data(); }
+            uint32_t indexCount() const { return cachedIndices ? cachedIndexCount : static_cast<uint32_t>(indices.size()); }
+
+        private:
+            // What the processing steps read of a vertex kept in the GLB mapping, normal and uv are
+            // contiguous as in Vertex. source is the GLB element it is uploaded from.
+            struct ShapeVertex
+            {
+                glm::vec3 position;
+                glm::vec3 normal;
+                glm::vec2 uv;
+                uint32_t source;
+            };
+
+            void loadObj(const std::string &filepath);
+            void loadGlb(const std::string &filepath);
+            void useGlb(std::shared_ptr<CFXGlbFile> glb);
+            void releaseMappedData();
+            // Positions and the normal and uv attributes of the mesh being processed
+            const float *shapePositions() const;
+            const float *shapeAttributes() const;
+            size_t shapeStride() const;
+            void generateNormals();
+            void optimizeMesh();
+            void computeBounds();
+            void buildLods();
+            void buildMeshlets();
+            uint64_t cacheLayoutKey() const;
+            bool loadCache(const std::string &filepath);
+            void writeCache(const std::string &filepath) const;
+
+            std::shared_ptr<CFXMeshCache> meshCache{};
+            // set while the vertices are kept in the GLB mapping, its primitives' elements are numbered in a row
+            std::shared_ptr<CFXGlbFile> glbFile{};
+            std::vector<uint32_t> glbFirstElements{};
+            // GLB element of every vertex in upload order, pointing into vertexOrder or the mesh cache
+            const uint32_t *glbVertexOrder = nullptr;
+            uint32_t glbVertexCount = 0;
+            std::vector<uint32_t> vertexOrder{};
+            // only filled while a GLB kept in the mapping is processed
+            std::vector<ShapeVertex> shapeVertices{};
+            const Vertex *cachedVertices = nullptr;
+            uint32_t cachedVertexCount = 0;
+            const uint32_t *cachedIndices = nullptr;
+            uint32_t cachedIndexCount = 0;
+            // set by the loaders when some vertex had no normal in the file
+            bool missingNormals = false;
         };
-        CFXModel(CFXDevice &device, const CFXModel::Builder &builder);
+        CFXModel(CFXDevice &device, CFXGeometryArena &arena, const CFXModel::Builder &builder);
+        // An empty model that CFXModelStreamer fills in later, it draws nothing until then
+        CFXModel(CFXDevice &device, CFXGeometryArena &arena, VertexFormat vertexFormat);
         ~CFXModel();
         CFXModel(const CFXModel &) = delete;
         CFXModel &operator=(const CFXModel &) = delete;
 
-        static std::unique_ptr<CFXModel> createModelFromFile(CFXDevice &device, const std::string &filepath);
+        static std::unique_ptr<CFXModel> createModelFromFile(CFXDevice &device, CFXGeometryArena &arena, const std::string &filepath,
+                                                             VertexFormat vertexFormat = VertexFormat::Full);
+
+        static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(VertexFormat vertexFormat);
+        static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexFormat vertexFormat);
 
-        void bind(VkCommandBuffer commandBuffer, int deviceIndex);
-        void draw(VkCommandBuffer commandBuffer);
+        // Binds the arena blocks holding this model unless bindState says they already are
+        void bind(VkCommandBuffer commandBuffer, int deviceIndex, CFXGeometryArena::BindState &bindState);
+        void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+        // Draws level 0 through one VkDrawIndexedIndirectCommand per meshlet at drawOffset, culled
+        // meshlets have an instance count of 0. One draw call each without multiDrawIndirect.
+        void drawMeshlets(VkCommandBuffer commandBuffer, VkBuffer drawBuffer, VkDeviceSize drawOffset, bool multiDrawIndirect);
+
+        // True once the geometry has landed on every device
+        bool isReady() const { return ready; }
+        // The model to draw in place of this one: itself when ready, else a ready placeholder or nullptr.
+        // Counts as a use for CFXResidencyManager, which re-streams evicted models asked for here.
+        CFXModel *getDrawable();
+        // Where the geometry lives while ready
+        CFXGeometryArena::Placement getPlacement() const { return placement; }
+        // Arena bytes of the geometry on each device, 0 while not uploaded
+        VkDeviceSize getGeometryBytes() const { return vertexAllocation.size + indexAllocation.size + meshletAllocation.size; }
+        // The file the streamer loaded the model from, empty for models built in place
+        const std::string &getSourcePath() const { return sourcePath; }
+
+        VertexFormat getVertexFormat() const { return vertexFormat; }
+        VkIndexType getIndexType() const { return indexType; }
+        // Maps vertex positions into model space, identity unless the positions are quantized
+        const glm::mat4 &getPositionTransform() const { return positionTransform; }
+        // Model space, unaffected by position quantization
+        const CFXBounds &getBounds() const { return bounds; }
+        const std::vector<Submesh> &getSubmeshes() const { return submeshes; }
+        const std::vector<Lod> &getLods() const { return lods; }
+        // The meshlets of level 0 live in the arena's meshlet pool, starting at getMeshletOffset() elements
+        uint32_t getMeshletCount() const { return meshletCount; }
+        uint32_t getMeshletOffset() const { return static_cast<uint32_t>(meshletAllocation.offset / sizeof(CFXMeshlet)); }
+        uint32_t getMeshletBlock() const { return meshletAllocation.block; }
+        uint32_t getFirstIndex() const { return firstIndex; }
+        int32_t getVertexOffset() const { return vertexOffset; }
 
     private:
-        void createVertexBuffers(const std::vector<Vertex> &vertices, int deviceIndex);
-        void createIndexBuffers(const std::vector<uint32_t> &indices, int deviceIndex);
+        friend class CFXModelStreamer;
+        friend class CFXResidencyManager;
+
+        void upload(const Builder &builder);
+        // Gives the arena ranges back and stops drawing the model until it is uploaded again
+        void release();
+        void computePositionTransform();
+        // Writes the builder's vertices quantized through positionTransform to packed
+        void packVertices(const Builder &builder, PackedVertex *packed) const;
+        // write fills the staging memory of each device with count vertices
+        void createVertexBuffers(uint32_t vertexSize, uint32_t count, const std::function<void(void *)> &write);
+        // and write with count indices of indexSize bytes
+        void createIndexBuffers(uint32_t indexSize, uint32_t count, const std::function<void(void *)> &write);
+        void createMeshletBuffers(const CFXMeshlet *meshlets, uint32_t count);
         CFXDevice &cfxDevice;
-        std::vector<std::unique_ptr<CFXBuffer>> vertexBuffer;
-        uint32_t vertexCount;
-        bool hasIndexBuffer;
-        std::vector<std::unique_ptr<CFXBuffer>> indexBuffer;
-        uint32_t indexCount;
+        CFXGeometryArena &geometryArena;
+        VertexFormat vertexFormat;
+        glm::mat4 positionTransform{1.f};
+        CFXBounds bounds{};
+        std::vector<Submesh> submeshes{};
+        std::vector<Lod> lods{};
+        CFXGeometryArena::Allocation vertexAllocation{};
+        // position of the first vertex/index inside the arena blocks, in elements
+        int32_t vertexOffset = 0;
+        uint32_t firstIndex = 0;
+        uint32_t vertexCount = 0;
+        bool hasIndexBuffer = false;
+        // UINT16 whenever every vertex is addressable with 16 bits
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        CFXGeometryArena::Allocation indexAllocation{};
+        uint32_t indexCount = 0;
+        CFXGeometryArena::Allocation meshletAllocation{};
+        uint32_t meshletCount = 0;
+        bool ready = false;
+        // queued in the streamer, the residency manager leaves it alone meanwhile
+        bool streaming = false;
+        // set by getDrawable(), collected and cleared by the residency manager every frame
+        bool used = false;
+        uint64_t lastUsedFrame = 0;
+        // released by the residency manager, streamed in again on the next use
+        bool evicted = false;
+        // geometry bytes it held before the eviction, what streaming it in again will take
+        VkDeviceSize evictedBytes = 0;
+        CFXGeometryArena::Placement placement = CFXGeometryArena::Placement::DeviceLocal;
+        std::string sourcePath{};
+        std::shared_ptr<CFXModel> placeholder{};
     };
 }
\ No newline at end of file
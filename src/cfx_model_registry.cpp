@@ -0,0 +1,109 @@
+#include "cfx_model_registry.hpp"
+#include "cfx_mapped_file.hpp"
+
+#include <cstring>
+#include <filesystem>
+
+namespace cfx
+{
+    CFXModelRegistry::CFXModelRegistry(CFXModelStreamer &streamer)
+        : modelStreamer{streamer}, self{std::make_shared<CFXModelRegistry *>(this)}
+    {
+    }
+
+    CFXModelRegistry::~CFXModelRegistry()
+    {
+        *self = nullptr;
+    }
+
+    uint64_t CFXModelRegistry::hashContent(const uint8_t *data, size_t size)
+    {
+        // FNV-1a over 8-byte words, then the tail bytes
+        uint64_t hash = 0xcbf29ce484222325ull;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        for (; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 0x100000001b3ull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    bool CFXModelRegistry::querySource(const std::string &filepath, SourceInfo &info)
+    {
+        std::error_code error;
+        std::string canonicalPath = std::filesystem::weakly_canonical(filepath, error).string();
+        if (error)
+        {
+            canonicalPath = filepath;
+        }
+
+        if (!CFXMappedFile::query(canonicalPath, info.size, info.time))
+        {
+            return false;
+        }
+
+        auto known = sources.find(canonicalPath);
+        if (known != sources.end() && known->second.size == info.size && known->second.time == info.time)
+        {
+            info.contentHash = known->second.contentHash;
+            return true;
+        }
+
+        std::shared_ptr<CFXMappedFile> file = CFXMappedFile::open(canonicalPath);
+        if (file == nullptr)
+        {
+            return false;
+        }
+        info.contentHash = hashContent(file->data(), file->size());
+        sources[canonicalPath] = info;
+        return true;
+    }
+
+    std::shared_ptr<CFXModel> CFXModelRegistry::acquire(const std::string &filepath, CFXModel::VertexFormat vertexFormat)
+    {
+        SourceInfo info{};
+        if (!querySource(filepath, info))
+        {
+            // unreadable, let the streamer report it instead of caching anything
+            return modelStreamer.load(filepath, vertexFormat);
+        }
+
+        ModelKey key{info.contentHash, info.size, vertexFormat};
+        auto entry = models.find(key);
+        if (entry != models.end())
+        {
+            if (auto model = entry->second.lock())
+            {
+                return model;
+            }
+        }
+
+        // the handle keeps the streamed model alive and unregisters it when the last copy goes
+        std::shared_ptr<CFXModel> streamed = modelStreamer.load(filepath, vertexFormat);
+        std::weak_ptr<CFXModelRegistry *> registry = self;
+        std::shared_ptr<CFXModel> handle{streamed.get(), [streamed, registry, key](CFXModel *) mutable
+                                         {
+                                             auto owner = registry.lock();
+                                             if (owner && *owner)
+                                             {
+                                                 auto entry = (*owner)->models.find(key);
+                                                 if (entry != (*owner)->models.end() && entry->second.expired())
+                                                 {
+                                                     (*owner)->models.erase(entry);
+                                                 }
+                                             }
+                                             streamed.reset();
+                                         }};
+        models[key] = handle;
+        return handle;
+    }
+}
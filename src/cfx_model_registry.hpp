@@ -0,0 +1,72 @@
+#pragma once
+
+#include "cfx_model_streamer.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace cfx
+{
+    /*
+     * Shares model instances between everyone asking for the same asset.
+     *
+     * Models are keyed by a hash of the file content and the vertex format, so the same
+     * file under two paths is still loaded and uploaded once. The content hash of each
+     * canonical path is remembered and only recomputed when the file size or mtime changes.
+     * The registry holds weak references only: when the last handle is released the model
+     * is destroyed, which gives its arena ranges back, and its entry is dropped.
+     *
+     * Main thread only, like the streamer's update().
+     */
+    class CFXModelRegistry
+    {
+    public:
+        CFXModelRegistry(CFXModelStreamer &streamer);
+        ~CFXModelRegistry();
+        CFXModelRegistry(const CFXModelRegistry &) = delete;
+        CFXModelRegistry &operator=(const CFXModelRegistry &) = delete;
+
+        // Returns the resident model for this content and format, streaming it in on first use
+        std::shared_ptr<CFXModel> acquire(const std::string &filepath, CFXModel::VertexFormat vertexFormat = CFXModel::VertexFormat::Full);
+        size_t residentCount() const { return models.size(); }
+
+    private:
+        struct SourceInfo
+        {
+            uint64_t size;
+            int64_t time;
+            uint64_t contentHash;
+        };
+
+        struct ModelKey
+        {
+            uint64_t contentHash;
+            uint64_t size;
+            CFXModel::VertexFormat vertexFormat;
+            bool operator==(const ModelKey &other) const
+            {
+                return contentHash == other.contentHash && size == other.size && vertexFormat == other.vertexFormat;
+            }
+        };
+
+        struct ModelKeyHash
+        {
+            size_t operator()(const ModelKey &key) const
+            {
+                return static_cast<size_t>(key.contentHash ^ (key.size * 0x9e3779b97f4a7c15ull) ^ static_cast<uint64_t>(key.vertexFormat));
+            }
+        };
+
+        // Returns false if the file cannot be read
+        bool querySource(const std::string &filepath, SourceInfo &info);
+        static uint64_t hashContent(const uint8_t *data, size_t size);
+
+        CFXModelStreamer &modelStreamer;
+        // canonical path -> content hash, revalidated against size and mtime
+        std::unordered_map<std::string, SourceInfo> sources;
+        std::unordered_map<ModelKey, std::weak_ptr<CFXModel>, ModelKeyHash> models;
+        // cleared on destruction so handles outliving the registry do not touch it
+        std::shared_ptr<CFXModelRegistry *> self;
+    };
+}
@@ -0,0 +1,171 @@
+#include "cfx_model_streamer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace cfx
+{
+    CFXModelStreamer::CFXModelStreamer(CFXDevice &device, CFXGeometryArena &arena, CFXUploadQueue &uploadQueue, uint32_t workerCount)
+        : cfxDevice{device}, geometryArena{arena}, uploadQueue{uploadQueue}
+    {
+        for (uint32_t i = 0; i < std::max(1u, workerCount); i++)
+        {
+            workers.emplace_back(&CFXModelStreamer::workerLoop, this);
+        }
+    }
+
+    CFXModelStreamer::~CFXModelStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+            jobs.clear();
+        }
+        jobAvailable.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    std::shared_ptr<CFXModel> CFXModelStreamer::load(const std::string &filepath, CFXModel::VertexFormat vertexFormat,
+                                                     std::shared_ptr<CFXModel> placeholder)
+    {
+        auto model = std::make_shared<CFXModel>(cfxDevice, geometryArena, vertexFormat);
+        model->placeholder = std::move(placeholder);
+        model->sourcePath = filepath;
+        models.push_back(model);
+        enqueue(model);
+        return model;
+    }
+
+    void CFXModelStreamer::reload(const std::shared_ptr<CFXModel> &model, CFXGeometryArena::Placement placement)
+    {
+        assert(!model->streaming && "Model is already streaming");
+        model->release();
+        model->placement = placement;
+        enqueue(model);
+    }
+
+    void CFXModelStreamer::enqueue(const std::shared_ptr<CFXModel> &model)
+    {
+        model->streaming = true;
+        auto builder = std::make_unique<CFXModel::Builder>();
+        builder->vertexFormat = model->vertexFormat;
+        std::future<std::shared_ptr<CFXMappedFile>> source;
+        if (!builder->hasValidCache(model->sourcePath))
+        {
+            source = CFXFileReader::shared().read(model->sourcePath);
+        }
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            jobs.push_back(Job{model, model->sourcePath, std::move(builder), std::move(source)});
+        }
+        jobAvailable.notify_one();
+    }
+
+    void CFXModelStreamer::workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                jobAvailable.wait(lock, [this]
+                                  { return stopping || !jobs.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                jobsInProgress++;
+            }
+
+            Parsed result{job.model, job.filepath, nullptr, {}};
+            // nobody holds the model anymore, skip the parse
+            if (!job.model.expired())
+            {
+                try
+                {
+                    if (job.source.valid())
+                    {
+                        job.builder->source = job.source.get();
+                    }
+                    job.builder->loadModel(job.filepath);
+                    job.builder->source.reset();
+                    result.builder = std::move(job.builder);
+                }
+                catch (const std::exception &e)
+                {
+                    result.error = e.what();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock{mutex};
+            parsed.push_back(std::move(result));
+            jobsInProgress--;
+        }
+    }
+
+    void CFXModelStreamer::update()
+    {
+        std::vector<Parsed> finished;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            finished.swap(parsed);
+        }
+
+        std::vector<std::shared_ptr<CFXModel>> uploaded;
+        for (auto &result : finished)
+        {
+            auto model = result.model.lock();
+            if (!model)
+            {
+                continue;
+            }
+            if (!result.builder)
+            {
+                std::cerr << "failed to stream " << result.filepath << ": " << result.error << std::endl;
+                model->streaming = false;
+                continue;
+            }
+            model->upload(*result.builder);
+            uploaded.push_back(std::move(model));
+        }
+        if (!uploaded.empty())
+        {
+            CFXUploadQueue::Ticket ticket = uploadQueue.submit();
+            for (auto &model : uploaded)
+            {
+                uploads.push_back(Upload{model, ticket});
+            }
+        }
+
+        uploads.erase(std::remove_if(uploads.begin(), uploads.end(), [this](const Upload &upload)
+                                     {
+                                         auto model = upload.model.lock();
+                                         if (!model)
+                                         {
+                                             return true;
+                                         }
+                                         if (!uploadQueue.isComplete(upload.ticket))
+                                         {
+                                             return false;
+                                         }
+                                         model->ready = true;
+                                         model->streaming = false;
+                                         return true; }),
+                      uploads.end());
+        models.erase(std::remove_if(models.begin(), models.end(), [](const std::weak_ptr<CFXModel> &model)
+                                    { return model.expired(); }),
+                     models.end());
+    }
+
+    size_t CFXModelStreamer::pendingCount()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return jobs.size() + jobsInProgress + parsed.size() + uploads.size();
+    }
+}
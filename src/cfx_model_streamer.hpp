@@ -0,0 +1,96 @@
+#pragma once
+
+#include "cfx_file_reader.hpp"
+#include "cfx_model.hpp"
+#include "cfx_upload_queue.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Loads models in the background.
+     *
+     * load() hands back an empty model straight away, starts reading the file through
+     * CFXFileReader and queues it for a worker thread, which runs Builder::loadModel (cache
+     * lookup or OBJ parse, dedup, optimization) once the bytes are in. Reads of queued files
+     * overlap with the parsing of earlier ones.
+     * update() runs on the main thread once per frame: it uploads whatever the workers
+     * finished through the upload queue with one submit, and marks models ready once their
+     * ticket completes. Until then CFXModel::getDrawable() returns the placeholder given to
+     * load(), or nothing.
+     */
+    class CFXModelStreamer
+    {
+    public:
+        static constexpr uint32_t DEFAULT_WORKER_COUNT = 2;
+
+        CFXModelStreamer(CFXDevice &device, CFXGeometryArena &arena, CFXUploadQueue &uploadQueue,
+                         uint32_t workerCount = DEFAULT_WORKER_COUNT);
+        ~CFXModelStreamer();
+        CFXModelStreamer(const CFXModelStreamer &) = delete;
+        CFXModelStreamer &operator=(const CFXModelStreamer &) = delete;
+
+        std::shared_ptr<CFXModel> load(const std::string &filepath, CFXModel::VertexFormat vertexFormat = CFXModel::VertexFormat::Full,
+                                       std::shared_ptr<CFXModel> placeholder = nullptr);
+        // Releases the model's geometry and streams it in again from its source file into the placement,
+        // the model draws its placeholder until then. Main thread only.
+        void reload(const std::shared_ptr<CFXModel> &model, CFXGeometryArena::Placement placement);
+        void update();
+        // Models queued, parsed or uploading that are not ready yet
+        size_t pendingCount();
+        // Every model load() handed out that is still alive, main thread only
+        const std::vector<std::weak_ptr<CFXModel>> &getModels() const { return models; }
+
+    private:
+        struct Job
+        {
+            std::weak_ptr<CFXModel> model;
+            std::string filepath;
+            std::unique_ptr<CFXModel::Builder> builder;
+            // read ahead through CFXFileReader unless the mesh cache is current
+            std::future<std::shared_ptr<CFXMappedFile>> source;
+        };
+
+        struct Parsed
+        {
+            std::weak_ptr<CFXModel> model;
+            std::string filepath;
+            // null when loading failed, error says why
+            std::unique_ptr<CFXModel::Builder> builder;
+            std::string error;
+        };
+
+        struct Upload
+        {
+            std::weak_ptr<CFXModel> model;
+            CFXUploadQueue::Ticket ticket;
+        };
+
+        void enqueue(const std::shared_ptr<CFXModel> &model);
+        void workerLoop();
+
+        CFXDevice &cfxDevice;
+        CFXGeometryArena &geometryArena;
+        CFXUploadQueue &uploadQueue;
+
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::deque<Job> jobs;
+        std::vector<Parsed> parsed;
+        size_t jobsInProgress = 0;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        // main thread only
+        std::vector<Upload> uploads;
+        std::vector<std::weak_ptr<CFXModel>> models;
+    };
+}
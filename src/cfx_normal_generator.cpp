@@ -0,0 +1,367 @@
+#include "cfx_normal_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CFX_NORMALS_SSE 1
+#endif
+
+namespace cfx
+{
+    // ranges smaller than this are not worth a thread of their own
+    static constexpr size_t MIN_PARALLEL_ITEMS = 16 * 1024;
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    // Unit face normals and the weight of every corner, degenerate faces get zero for both
+    struct FaceData
+    {
+        std::vector<float> normals;
+        std::vector<float> cornerWeights;
+        // position id of every corner
+        std::vector<uint32_t> cornerPositions;
+    };
+
+    // Three arrays rather than xyz triples so four sums normalize with straight SSE loads
+    struct NormalSums
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        explicit NormalSums(size_t count) : x(count, 0.f), y(count, 0.f), z(count, 0.f) {}
+    };
+
+    static unsigned resolveThreadCount(unsigned threadCount, size_t items)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, items / MIN_PARALLEL_ITEMS)));
+    }
+
+    // Calls fn(begin, end) on threadCount contiguous slices of [0, count)
+    template <typename Fn>
+    static void parallelFor(size_t count, unsigned threadCount, Fn fn)
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(threadCount - 1);
+        for (unsigned i = 1; i < threadCount; i++)
+        {
+            workers.emplace_back(fn, count * i / threadCount, count * (i + 1) / threadCount);
+        }
+        fn(0, count / threadCount);
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    static const float *positionAt(const float *positions, size_t positionStride, size_t vertex)
+    {
+        return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + vertex * positionStride);
+    }
+
+    static uint32_t hashPosition(const float *position)
+    {
+        uint32_t hash = 0x811c9dc5u;
+        for (int i = 0; i < 3; i++)
+        {
+            // +0 and -0 are the same position
+            float value = position[i] == 0.f ? 0.f : position[i];
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            hash = (hash ^ bits) * 0x01000193u;
+            hash ^= hash >> 15;
+        }
+        return hash;
+    }
+
+    // Gives every vertex the id of its position, returns how many distinct positions there are
+    static uint32_t weldPositions(std::vector<uint32_t> &positionIds, const float *positions, size_t positionStride, size_t vertexCount)
+    {
+        size_t slotCount = 16;
+        while (slotCount < vertexCount * 2)
+        {
+            slotCount *= 2;
+        }
+        std::vector<uint32_t> slots(slotCount, EMPTY_SLOT);
+        size_t mask = slotCount - 1;
+        positionIds.resize(vertexCount);
+        uint32_t positionCount = 0;
+        for (size_t vertex = 0; vertex < vertexCount; vertex++)
+        {
+            const float *position = positionAt(positions, positionStride, vertex);
+            for (size_t slot = hashPosition(position) & mask;; slot = (slot + 1) & mask)
+            {
+                if (slots[slot] == EMPTY_SLOT)
+                {
+                    slots[slot] = static_cast<uint32_t>(vertex);
+                    positionIds[vertex] = positionCount++;
+                    break;
+                }
+                const float *other = positionAt(positions, positionStride, slots[slot]);
+                if (position[0] == other[0] && position[1] == other[1] && position[2] == other[2])
+                {
+                    positionIds[vertex] = positionIds[slots[slot]];
+                    break;
+                }
+            }
+        }
+        return positionCount;
+    }
+
+    static float cornerAngle(const float *corner, const float *a, const float *b)
+    {
+        float e0[3] = {a[0] - corner[0], a[1] - corner[1], a[2] - corner[2]};
+        float e1[3] = {b[0] - corner[0], b[1] - corner[1], b[2] - corner[2]};
+        float lengths = std::sqrt((e0[0] * e0[0] + e0[1] * e0[1] + e0[2] * e0[2]) * (e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]));
+        if (lengths == 0.f)
+        {
+            return 0.f;
+        }
+        float cosine = (e0[0] * e1[0] + e0[1] * e1[1] + e0[2] * e1[2]) / lengths;
+        return std::acos(std::min(1.f, std::max(-1.f, cosine)));
+    }
+
+    static void computeFaces(FaceData &faces, const std::vector<uint32_t> &positionIds, const float *positions, size_t positionStride,
+                             const uint32_t *indices, size_t triangleCount, CFXNormalGenerator::Weighting weighting, unsigned threadCount)
+    {
+        faces.normals.resize(triangleCount * 3);
+        faces.cornerWeights.resize(triangleCount * 3);
+        faces.cornerPositions.resize(triangleCount * 3);
+        parallelFor(triangleCount, threadCount, [&](size_t begin, size_t end)
+                    {
+            for (size_t triangle = begin; triangle < end; triangle++)
+            {
+                const uint32_t *corners = indices + triangle * 3;
+                const float *a = positionAt(positions, positionStride, corners[0]);
+                const float *b = positionAt(positions, positionStride, corners[1]);
+                const float *c = positionAt(positions, positionStride, corners[2]);
+                float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+                float n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                float inverse = length > 0.f ? 1.f / length : 0.f;
+                float *normal = &faces.normals[triangle * 3];
+                normal[0] = n[0] * inverse;
+                normal[1] = n[1] * inverse;
+                normal[2] = n[2] * inverse;
+
+                float *weights = &faces.cornerWeights[triangle * 3];
+                if (length == 0.f)
+                {
+                    weights[0] = weights[1] = weights[2] = 0.f;
+                }
+                else if (weighting == CFXNormalGenerator::Weighting::Area)
+                {
+                    weights[0] = weights[1] = weights[2] = 0.5f * length;
+                }
+                else
+                {
+                    weights[0] = cornerAngle(a, b, c);
+                    weights[1] = cornerAngle(b, c, a);
+                    weights[2] = cornerAngle(c, a, b);
+                }
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    faces.cornerPositions[triangle * 3 + corner] = positionIds[corners[corner]];
+                }
+            } });
+    }
+
+    // The corners around every position, as offsets into one array
+    static void bucketCorners(std::vector<uint32_t> &cornerOffsets, std::vector<uint32_t> &positionCorners, const FaceData &faces,
+                              uint32_t positionCount)
+    {
+        cornerOffsets.assign(static_cast<size_t>(positionCount) + 1, 0);
+        for (uint32_t position : faces.cornerPositions)
+        {
+            cornerOffsets[position + 1]++;
+        }
+        for (size_t i = 1; i < cornerOffsets.size(); i++)
+        {
+            cornerOffsets[i] += cornerOffsets[i - 1];
+        }
+        positionCorners.resize(faces.cornerPositions.size());
+        std::vector<uint32_t> cursor(cornerOffsets.begin(), cornerOffsets.end() - 1);
+        for (size_t corner = 0; corner < faces.cornerPositions.size(); corner++)
+        {
+            positionCorners[cursor[faces.cornerPositions[corner]]++] = static_cast<uint32_t>(corner);
+        }
+    }
+
+    static void normalizeSums(NormalSums &sums, size_t begin, size_t end)
+    {
+        float *x = sums.x.data();
+        float *y = sums.y.data();
+        float *z = sums.z.data();
+        size_t i = begin;
+#ifdef CFX_NORMALS_SSE
+        const __m128 minLengthSquared = _mm_set1_ps(1e-30f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 threeHalves = _mm_set1_ps(1.5f);
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 vx = _mm_loadu_ps(x + i);
+            __m128 vy = _mm_loadu_ps(y + i);
+            __m128 vz = _mm_loadu_ps(z + i);
+            __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+            __m128 inverse = _mm_rsqrt_ps(lengthSquared);
+            // one Newton-Raphson step, rsqrt alone is only good to about 12 bits
+            inverse = _mm_mul_ps(inverse, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, lengthSquared), _mm_mul_ps(inverse, inverse))));
+            // sums that cancelled out stay zero instead of turning into NaN
+            inverse = _mm_and_ps(inverse, _mm_cmpgt_ps(lengthSquared, minLengthSquared));
+            _mm_storeu_ps(x + i, _mm_mul_ps(vx, inverse));
+            _mm_storeu_ps(y + i, _mm_mul_ps(vy, inverse));
+            _mm_storeu_ps(z + i, _mm_mul_ps(vz, inverse));
+        }
+#endif
+        for (; i < end; i++)
+        {
+            float lengthSquared = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+            float inverse = lengthSquared > 1e-30f ? 1.f / std::sqrt(lengthSquared) : 0.f;
+            x[i] *= inverse;
+            y[i] *= inverse;
+            z[i] *= inverse;
+        }
+    }
+
+    void CFXNormalGenerator::generateVertexNormals(float *normals, const float *positions, size_t positionStride, size_t vertexCount,
+                                                   const uint32_t *indices, size_t indexCount, Weighting weighting, unsigned threadCount)
+    {
+        std::fill(normals, normals + vertexCount * 3, 0.f);
+        size_t triangleCount = indexCount / 3;
+        if (vertexCount == 0 || triangleCount == 0)
+        {
+            return;
+        }
+        std::vector<uint32_t> positionIds;
+        uint32_t positionCount = weldPositions(positionIds, positions, positionStride, vertexCount);
+        FaceData faces{};
+        computeFaces(faces, positionIds, positions, positionStride, indices, triangleCount, weighting, resolveThreadCount(threadCount, triangleCount));
+
+        // every thread only visits the corners of the positions it owns
+        std::vector<uint32_t> cornerOffsets;
+        std::vector<uint32_t> positionCorners;
+        bucketCorners(cornerOffsets, positionCorners, faces, positionCount);
+        NormalSums sums{positionCount};
+        parallelFor(positionCount, resolveThreadCount(threadCount, triangleCount), [&](size_t begin, size_t end)
+                    {
+            for (size_t position = begin; position < end; position++)
+            {
+                float sum[3] = {0.f, 0.f, 0.f};
+                for (uint32_t k = cornerOffsets[position]; k < cornerOffsets[position + 1]; k++)
+                {
+                    uint32_t corner = positionCorners[k];
+                    const float *normal = &faces.normals[corner / 3 * 3];
+                    float weight = faces.cornerWeights[corner];
+                    sum[0] += normal[0] * weight;
+                    sum[1] += normal[1] * weight;
+                    sum[2] += normal[2] * weight;
+                }
+                sums.x[position] = sum[0];
+                sums.y[position] = sum[1];
+                sums.z[position] = sum[2];
+            }
+            normalizeSums(sums, begin, end); });
+
+        parallelFor(vertexCount, resolveThreadCount(threadCount, vertexCount), [&](size_t begin, size_t end)
+                    {
+            for (size_t vertex = begin; vertex < end; vertex++)
+            {
+                uint32_t position = positionIds[vertex];
+                normals[vertex * 3 + 0] = sums.x[position];
+                normals[vertex * 3 + 1] = sums.y[position];
+                normals[vertex * 3 + 2] = sums.z[position];
+            } });
+    }
+
+    void CFXNormalGenerator::generateCornerNormals(float *normals, const float *positions, size_t positionStride, size_t vertexCount,
+                                                   const uint32_t *indices, size_t indexCount, Weighting weighting, float creaseAngle,
+                                                   unsigned threadCount)
+    {
+        std::fill(normals, normals + indexCount * 3, 0.f);
+        size_t triangleCount = indexCount / 3;
+        if (vertexCount == 0 || triangleCount == 0)
+        {
+            return;
+        }
+        std::vector<uint32_t> positionIds;
+        uint32_t positionCount = weldPositions(positionIds, positions, positionStride, vertexCount);
+        unsigned faceThreads = resolveThreadCount(threadCount, triangleCount);
+        FaceData faces{};
+        computeFaces(faces, positionIds, positions, positionStride, indices, triangleCount, weighting, faceThreads);
+
+        std::vector<uint32_t> cornerOffsets;
+        std::vector<uint32_t> positionCorners;
+        bucketCorners(cornerOffsets, positionCorners, faces, positionCount);
+
+        // gathers rather than scatters: the fan around a position is copied out once and every
+        // corner in it sums the faces on its side of the crease into its own slot
+        float minCosine = std::cos(creaseAngle);
+        NormalSums sums{triangleCount * 3};
+        parallelFor(positionCount, faceThreads, [&](size_t begin, size_t end)
+                    {
+            std::vector<float> fan{};
+            for (size_t position = begin; position < end; position++)
+            {
+                uint32_t first = cornerOffsets[position];
+                uint32_t count = cornerOffsets[position + 1] - first;
+                fan.resize(count * 4);
+                for (uint32_t k = 0; k < count; k++)
+                {
+                    uint32_t corner = positionCorners[first + k];
+                    const float *normal = &faces.normals[corner / 3 * 3];
+                    fan[k * 4 + 0] = normal[0];
+                    fan[k * 4 + 1] = normal[1];
+                    fan[k * 4 + 2] = normal[2];
+                    fan[k * 4 + 3] = faces.cornerWeights[corner];
+                }
+                for (uint32_t k = 0; k < count; k++)
+                {
+                    const float *own = &fan[k * 4];
+                    // a degenerate face has no side of the crease to be on and takes every neighbour
+                    float cosine = own[0] == 0.f && own[1] == 0.f && own[2] == 0.f ? -1.f : minCosine;
+                    float sum[3] = {0.f, 0.f, 0.f};
+                    for (uint32_t j = 0; j < count; j++)
+                    {
+                        const float *other = &fan[j * 4];
+                        if (j != k && own[0] * other[0] + own[1] * other[1] + own[2] * other[2] < cosine)
+                        {
+                            continue;
+                        }
+                        sum[0] += other[0] * other[3];
+                        sum[1] += other[1] * other[3];
+                        sum[2] += other[2] * other[3];
+                    }
+                    // slivers have next to no angle of their own, they still get their face normal
+                    if (sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2] <= 1e-30f)
+                    {
+                        sum[0] = own[0];
+                        sum[1] = own[1];
+                        sum[2] = own[2];
+                    }
+                    uint32_t corner = positionCorners[first + k];
+                    sums.x[corner] = sum[0];
+                    sums.y[corner] = sum[1];
+                    sums.z[corner] = sum[2];
+                }
+            } });
+
+        parallelFor(triangleCount, faceThreads, [&](size_t begin, size_t end)
+                    {
+            normalizeSums(sums, begin * 3, end * 3);
+            for (size_t corner = begin * 3; corner < end * 3; corner++)
+            {
+                normals[corner * 3 + 0] = sums.x[corner];
+                normals[corner * 3 + 1] = sums.y[corner];
+                normals[corner * 3 + 2] = sums.z[corner];
+            } });
+    }
+}
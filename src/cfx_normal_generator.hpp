@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cfx
+{
+    /*
+     * Load time vertex normals for meshes that come without them.
+     *
+     * Vertices sharing a position are welded first, so a normal does not break along uv or
+     * color seams. Face normals are computed in parallel, bucketed by position once and
+     * summed per position, every thread owning a range of positions and only their corners. The
+     * sums are normalized four at a time with SSE. Crease-aware normals are gathered per
+     * corner from the fan of faces around its position instead.
+     *
+     * threadCount == 0 picks one thread per hardware core.
+     */
+    class CFXNormalGenerator
+    {
+    public:
+        enum class Weighting
+        {
+            Area, // plain smooth normals, big faces count more
+            Angle // each face by its corner angle, independent of how the surface is triangulated
+        };
+
+        // Writes one normal per vertex to normals (3 floats each), the same for every vertex of a position
+        static void generateVertexNormals(float *normals, const float *positions, size_t positionStride, size_t vertexCount,
+                                          const uint32_t *indices, size_t indexCount, Weighting weighting, unsigned threadCount = 0);
+
+        // Writes one normal per index to normals (3 floats each). Only the faces around a corner whose
+        // normals are within creaseAngle radians of the corner's own face contribute, so hard
+        // edges stay hard; corners of one vertex may therefore get different normals.
+        static void generateCornerNormals(float *normals, const float *positions, size_t positionStride, size_t vertexCount,
+                                          const uint32_t *indices, size_t indexCount, Weighting weighting, float creaseAngle,
+                                          unsigned threadCount = 0);
+    };
+}
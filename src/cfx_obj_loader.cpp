@@ -0,0 +1,519 @@
+#include "cfx_obj_loader.hpp"
+#include "cfx_mapped_file.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace cfx
+{
+    // chunks smaller than this are not worth a thread of their own
+    static constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    struct ObjChunk
+    {
+        const char *begin;
+        const char *end;
+
+        size_t vertexCount = 0;
+        size_t normalCount = 0;
+        size_t texcoordCount = 0;
+        size_t vertexBase = 0;
+        size_t normalBase = 0;
+        size_t texcoordBase = 0;
+
+        // polygons with indices resolved against the whole file, one size per face
+        std::vector<tinyobj::index_t> polygons;
+        std::vector<uint32_t> faceSizes;
+        // triangulated faces, filled once every chunk has written its positions
+        std::vector<tinyobj::index_t> indices;
+        // 'o' and 'g' records as (offset into faceSizes, later into indices, name)
+        std::vector<std::pair<size_t, std::string>> groups;
+        std::string error;
+    };
+
+    static inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    static const char *skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    static const char *lineEnd(const char *p, const char *end)
+    {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        return newline != nullptr ? newline : end;
+    }
+
+    // Decimal float parser for the plain notation OBJ exporters write. Values that need more
+    // than 19 significant digits or an exponent outside the exact double range go through strtod.
+    static const char *parseFloat(const char *p, const char *end, float &out)
+    {
+        static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        const char *start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int significantDigits = 0;
+        int exponent = 0;
+        bool hasDigits = false;
+        while (p < end && isDigit(*p))
+        {
+            if (significantDigits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                significantDigits += mantissa != 0;
+            }
+            else
+            {
+                exponent++;
+            }
+            hasDigits = true;
+            p++;
+        }
+        if (p < end && *p == '.')
+        {
+            p++;
+            while (p < end && isDigit(*p))
+            {
+                if (significantDigits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    significantDigits += mantissa != 0;
+                    exponent--;
+                }
+                hasDigits = true;
+                p++;
+            }
+        }
+        if (!hasDigits)
+        {
+            return nullptr;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && isDigit(*q))
+            {
+                int value = 0;
+                while (q < end && isDigit(*q))
+                {
+                    value = std::min(value * 10 + (*q - '0'), 100000);
+                    q++;
+                }
+                exponent += negativeExponent ? -value : value;
+                p = q;
+            }
+        }
+
+        double value = static_cast<double>(mantissa);
+        if (exponent >= 0 && exponent <= 22)
+        {
+            value *= powersOfTen[exponent];
+        }
+        else if (exponent < 0 && exponent >= -22)
+        {
+            value /= powersOfTen[-exponent];
+        }
+        else
+        {
+            // the mapping is not null terminated, so strtod gets its own copy of the token
+            std::string token{start, p};
+            out = strtof(token.c_str(), nullptr);
+            return p;
+        }
+        out = static_cast<float>(negative ? -value : value);
+        return p;
+    }
+
+    static const char *parseInt(const char *p, const char *end, int &out)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        if (p >= end || !isDigit(*p))
+        {
+            return nullptr;
+        }
+        int value = 0;
+        while (p < end && isDigit(*p))
+        {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        out = negative ? -value : value;
+        return p;
+    }
+
+    static int parseFloats(const char *p, const char *end, float *values, int maxCount)
+    {
+        int count = 0;
+        while (count < maxCount)
+        {
+            p = skipSpaces(p, end);
+            const char *next = parseFloat(p, end, values[count]);
+            if (next == nullptr)
+            {
+                break;
+            }
+            p = next;
+            count++;
+        }
+        return count;
+    }
+
+    // OBJ indices are 1-based, negative values count back from the most recent element
+    static bool resolveIndex(int index, size_t elementCount, size_t elementTotal, int &resolved)
+    {
+        if (index > 0 && static_cast<size_t>(index) <= elementTotal)
+        {
+            resolved = index - 1;
+        }
+        else if (index < 0 && static_cast<size_t>(-index) <= elementCount)
+        {
+            resolved = static_cast<int>(elementCount) + index;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static void countElements(ObjChunk &chunk)
+    {
+        const char *p = chunk.begin;
+        while (p < chunk.end)
+        {
+            const char *end = lineEnd(p, chunk.end);
+            p = skipSpaces(p, end);
+            if (end - p > 2 && p[0] == 'v')
+            {
+                if (isSpace(p[1]))
+                {
+                    chunk.vertexCount++;
+                }
+                else if (p[1] == 'n' && isSpace(p[2]))
+                {
+                    chunk.normalCount++;
+                }
+                else if (p[1] == 't' && isSpace(p[2]))
+                {
+                    chunk.texcoordCount++;
+                }
+            }
+            p = end + 1;
+        }
+    }
+
+    static void parseChunk(ObjChunk &chunk, tinyobj::attrib_t &attrib)
+    {
+        float *positions = attrib.vertices.data() + 3 * chunk.vertexBase;
+        float *colors = attrib.colors.data() + 3 * chunk.vertexBase;
+        float *normals = attrib.normals.data() + 3 * chunk.normalBase;
+        float *texcoords = attrib.texcoords.data() + 2 * chunk.texcoordBase;
+        size_t vertexCount = 0;
+        size_t normalCount = 0;
+        size_t texcoordCount = 0;
+
+        const char *p = chunk.begin;
+        while (p < chunk.end)
+        {
+            const char *end = lineEnd(p, chunk.end);
+            const char *next = end + 1;
+            if (end > p && end[-1] == '\r')
+            {
+                end--;
+            }
+            p = skipSpaces(p, end);
+            if (end - p < 2)
+            {
+                p = next;
+                continue;
+            }
+
+            if (p[0] == 'v' && isSpace(p[1]))
+            {
+                float values[6] = {0.f, 0.f, 0.f, 1.f, 1.f, 1.f};
+                int count = parseFloats(p + 2, end, values, 6);
+                if (count < 3)
+                {
+                    chunk.error = "malformed vertex position";
+                    return;
+                }
+                // like tinyobj, vertices without a color fall back to white
+                if (count < 6)
+                {
+                    std::fill(values + 3, values + 6, 1.f);
+                }
+                std::copy(values, values + 3, positions + 3 * vertexCount);
+                std::copy(values + 3, values + 6, colors + 3 * vertexCount);
+                vertexCount++;
+            }
+            else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && isSpace(p[2]))
+            {
+                float values[3] = {0.f, 0.f, 0.f};
+                parseFloats(p + 3, end, values, 3);
+                std::copy(values, values + 3, normals + 3 * normalCount);
+                normalCount++;
+            }
+            else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && isSpace(p[2]))
+            {
+                float values[2] = {0.f, 0.f};
+                parseFloats(p + 3, end, values, 2);
+                std::copy(values, values + 2, texcoords + 2 * texcoordCount);
+                texcoordCount++;
+            }
+            else if (p[0] == 'f' && isSpace(p[1]))
+            {
+                size_t faceBegin = chunk.polygons.size();
+                const char *q = skipSpaces(p + 2, end);
+                while (q < end)
+                {
+                    tinyobj::index_t index{-1, -1, -1};
+                    int value = 0;
+                    q = parseInt(q, end, value);
+                    if (q == nullptr || !resolveIndex(value, chunk.vertexBase + vertexCount, attrib.vertices.size() / 3, index.vertex_index))
+                    {
+                        chunk.error = "malformed face";
+                        return;
+                    }
+                    if (q < end && *q == '/')
+                    {
+                        q++;
+                        if (q < end && *q != '/')
+                        {
+                            q = parseInt(q, end, value);
+                            if (q == nullptr || !resolveIndex(value, chunk.texcoordBase + texcoordCount, attrib.texcoords.size() / 2, index.texcoord_index))
+                            {
+                                chunk.error = "malformed face texcoord index";
+                                return;
+                            }
+                        }
+                        if (q < end && *q == '/')
+                        {
+                            q = parseInt(q + 1, end, value);
+                            if (q == nullptr || !resolveIndex(value, chunk.normalBase + normalCount, attrib.normals.size() / 3, index.normal_index))
+                            {
+                                chunk.error = "malformed face normal index";
+                                return;
+                            }
+                        }
+                    }
+                    chunk.polygons.push_back(index);
+                    q = skipSpaces(q, end);
+                }
+                chunk.faceSizes.push_back(static_cast<uint32_t>(chunk.polygons.size() - faceBegin));
+            }
+            else if ((p[0] == 'o' || p[0] == 'g') && isSpace(p[1]))
+            {
+                const char *nameBegin = skipSpaces(p + 2, end);
+                const char *nameEnd = end;
+                while (nameEnd > nameBegin && isSpace(nameEnd[-1]))
+                {
+                    nameEnd--;
+                }
+                chunk.groups.emplace_back(chunk.faceSizes.size(), std::string{nameBegin, nameEnd});
+            }
+            p = next;
+        }
+    }
+
+    static float squaredDistance(const std::vector<float> &positions, int a, int b)
+    {
+        float dx = positions[3 * b + 0] - positions[3 * a + 0];
+        float dy = positions[3 * b + 1] - positions[3 * a + 1];
+        float dz = positions[3 * b + 2] - positions[3 * a + 2];
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Quads are split along their shorter diagonal like tinyobj does, larger polygons as a fan
+    static void triangulateChunk(ObjChunk &chunk, const std::vector<float> &positions)
+    {
+        chunk.indices.reserve(3 * chunk.faceSizes.size());
+        const tinyobj::index_t *face = chunk.polygons.data();
+        size_t nextGroup = 0;
+        for (size_t f = 0; f < chunk.faceSizes.size(); f++)
+        {
+            while (nextGroup < chunk.groups.size() && chunk.groups[nextGroup].first == f)
+            {
+                chunk.groups[nextGroup++].first = chunk.indices.size();
+            }
+            uint32_t size = chunk.faceSizes[f];
+            if (size == 4 && squaredDistance(positions, face[0].vertex_index, face[2].vertex_index) >=
+                                 squaredDistance(positions, face[1].vertex_index, face[3].vertex_index))
+            {
+                chunk.indices.insert(chunk.indices.end(), {face[0], face[1], face[3], face[1], face[2], face[3]});
+            }
+            else
+            {
+                for (uint32_t k = 1; k + 1 < size; k++)
+                {
+                    chunk.indices.insert(chunk.indices.end(), {face[0], face[k], face[k + 1]});
+                }
+            }
+            face += size;
+        }
+        for (; nextGroup < chunk.groups.size(); nextGroup++)
+        {
+            chunk.groups[nextGroup].first = chunk.indices.size();
+        }
+        chunk.polygons = {};
+        chunk.faceSizes = {};
+    }
+
+    template <typename Fn>
+    static void forEachChunk(std::vector<ObjChunk> &chunks, Fn fn)
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(chunks.size() - 1);
+        for (size_t i = 1; i < chunks.size(); i++)
+        {
+            workers.emplace_back(fn, std::ref(chunks[i]));
+        }
+        fn(chunks[0]);
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    static void appendShape(std::vector<tinyobj::shape_t> &shapes, tinyobj::shape_t &shape)
+    {
+        if (shape.mesh.indices.empty())
+        {
+            return;
+        }
+        size_t faceCount = shape.mesh.indices.size() / 3;
+        shape.mesh.num_face_vertices.assign(faceCount, 3);
+        shape.mesh.material_ids.assign(faceCount, -1);
+        shape.mesh.smoothing_group_ids.assign(faceCount, 0);
+        shapes.push_back(std::move(shape));
+        shape = tinyobj::shape_t{};
+    }
+
+    bool loadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes, std::string *warn,
+                         std::string *err, const std::string &filepath, unsigned threadCount)
+    {
+        std::shared_ptr<CFXMappedFile> file = CFXMappedFile::open(filepath);
+        if (file == nullptr)
+        {
+            if (err)
+            {
+                *err += "Cannot open file [" + filepath + "]\n";
+            }
+            return false;
+        }
+        return loadObjParallel(attrib, shapes, warn, err, filepath, *file, threadCount);
+    }
+
+    bool loadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes, std::string *warn,
+                         std::string *err, const std::string &filepath, const CFXMappedFile &file, unsigned threadCount)
+    {
+        const char *data = reinterpret_cast<const char *>(file.data());
+        size_t size = file.size();
+
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MIN_CHUNK_SIZE));
+
+        // split on line boundaries so no record straddles two chunks
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char *chunkBegin = data;
+        for (size_t i = 0; i < chunkCount; i++)
+        {
+            const char *chunkEnd = data + size;
+            if (i + 1 < chunkCount)
+            {
+                chunkEnd = std::max(chunkBegin, data + size * (i + 1) / chunkCount);
+                chunkEnd = std::min(lineEnd(chunkEnd, data + size) + 1, data + size);
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        // first pass sizes the attribute arrays so the second pass can write in place
+        forEachChunk(chunks, countElements);
+        size_t vertexTotal = 0;
+        size_t normalTotal = 0;
+        size_t texcoordTotal = 0;
+        for (auto &chunk : chunks)
+        {
+            chunk.vertexBase = vertexTotal;
+            chunk.normalBase = normalTotal;
+            chunk.texcoordBase = texcoordTotal;
+            vertexTotal += chunk.vertexCount;
+            normalTotal += chunk.normalCount;
+            texcoordTotal += chunk.texcoordCount;
+        }
+        *attrib = tinyobj::attrib_t{};
+        attrib->vertices.resize(3 * vertexTotal);
+        attrib->colors.resize(3 * vertexTotal);
+        attrib->normals.resize(3 * normalTotal);
+        attrib->texcoords.resize(2 * texcoordTotal);
+
+        forEachChunk(chunks, [attrib](ObjChunk &chunk)
+                     { parseChunk(chunk, *attrib); });
+
+        for (auto &chunk : chunks)
+        {
+            if (!chunk.error.empty())
+            {
+                if (err)
+                {
+                    *err += chunk.error + " in [" + filepath + "]\n";
+                }
+                return false;
+            }
+        }
+        forEachChunk(chunks, [attrib](ObjChunk &chunk)
+                     { triangulateChunk(chunk, attrib->vertices); });
+
+        // stitch the per-chunk faces back together, starting a new shape at every 'o' or 'g'
+        shapes->clear();
+        tinyobj::shape_t shape{};
+        for (auto &chunk : chunks)
+        {
+            size_t consumed = 0;
+            for (auto &group : chunk.groups)
+            {
+                shape.mesh.indices.insert(shape.mesh.indices.end(), chunk.indices.begin() + consumed, chunk.indices.begin() + group.first);
+                consumed = group.first;
+                appendShape(*shapes, shape);
+                shape.name = group.second;
+            }
+            shape.mesh.indices.insert(shape.mesh.indices.end(), chunk.indices.begin() + consumed, chunk.indices.end());
+        }
+        appendShape(*shapes, shape);
+
+        if (warn && shapes->empty())
+        {
+            *warn += "No faces found in [" + filepath + "]\n";
+        }
+        return true;
+    }
+}
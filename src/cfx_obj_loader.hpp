@@ -0,0 +1,26 @@
+#pragma once
+
+#include "cfx_mapped_file.hpp"
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Multithreaded replacement for tinyobj::LoadObj covering the records CFXModel uses
+     * (v with optional vertex color, vn, vt, f, o and g). The file is memory-mapped, split on
+     * line boundaries into one chunk per thread and every chunk is parsed in parallel; the
+     * results are written into the same attrib_t/shape_t layout tinyobj produces. Quads are
+     * split like tinyobj splits them, larger polygons are triangulated as a fan rather than
+     * ear-clipped. Materials, lines, points and tinyobj extensions are ignored.
+     *
+     * threadCount == 0 picks one thread per hardware core.
+     */
+    bool loadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes, std::string *warn,
+                         std::string *err, const std::string &filepath, unsigned threadCount = 0);
+    // Same, for a file that was already read, filepath only names it in messages
+    bool loadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes, std::string *warn,
+                         std::string *err, const std::string &filepath, const CFXMappedFile &file, unsigned threadCount = 0);
+}
@@ -1,6 +1,6 @@
 #include "cfx_pipeline.hpp"
 #include "cfx_model.hpp"
-#include <fstream>
+#include "cfx_file_reader.hpp"
 #include <iostream>
 #include <cassert>
 namespace cfx
@@ -14,32 +14,52 @@ namespace cfx
     {
         vkDestroyShaderModule(cfxDevice.device(deviceIndex), vertShaderModule, nullptr);
         vkDestroyShaderModule(cfxDevice.device(deviceIndex), fragShaderModule, nullptr);
-        vkDestroyPipeline(cfxDevice.device(deviceIndex), graphicsPipeline, nullptr);
+        // frames in flight may still be bound to it
+        VkDevice device = cfxDevice.device(deviceIndex);
+        cfxDevice.getDeletionQueue(deviceIndex).defer([device, pipeline = graphicsPipeline]
+                                                      { vkDestroyPipeline(device, pipeline, nullptr); });
     }
     std::vector<char> CFXPipeLine::readFile(const std::string &filepath)
     {
-        std::ifstream file{filepath, std::ios::ate | std::ios::binary};
-        if (!file.is_open())
+        return std::move(readFiles({filepath}).front());
+    }
+    std::vector<std::vector<char>> CFXPipeLine::readFiles(const std::vector<std::string> &filepaths)
+    {
+        // one batch on the shared reader, so the stages are read in parallel
+        auto reads = CFXFileReader::shared().read(filepaths);
+        std::vector<std::vector<char>> files;
+        for (auto &read : reads)
         {
-            throw std::runtime_error("failed to open file: " + filepath);
+            std::shared_ptr<CFXMappedFile> file;
+            try
+            {
+                file = read.get();
+            }
+            catch (const std::exception &e)
+            {
+                throw std::runtime_error(std::string("failed to open file: ") + e.what());
+            }
+            files.emplace_back(file->data(), file->data() + file->size());
         }
-        size_t fileSize = static_cast<size_t>(file.tellg());
-        std::vector<char> buffer(fileSize);
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-        return buffer;
+        return files;
     }
     void CFXPipeLine::createGraphicsPipeLine(const PipelineConfigInfo &configInfo, const std::string &vertFilePath, const std::string &fragFilePath, int deviceIndex)
     {
         // std::cout << "CREATING GRAPHICS PIPELINE " << deviceIndex << std::endl;
         assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create pipeline: no pipelineLayout provided in configInfo");
         assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create pipeline: no renderpass provided in configInfo");
-        auto vertCode = readFile(vertFilePath);
-        auto fragCode = readFile(fragFilePath);
+        auto code = readFiles({vertFilePath, fragFilePath});
+
+        createShaderModule(code[0], &vertShaderModule, deviceIndex);
+        createShaderModule(code[1], &fragShaderModule, deviceIndex);
+
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationMapEntries.size());
+        specializationInfo.pMapEntries = configInfo.specializationMapEntries.data();
+        specializationInfo.dataSize = configInfo.specializationData.size();
+        specializationInfo.pData = configInfo.specializationData.data();
+        const VkSpecializationInfo *stageSpecializationInfo = configInfo.specializationMapEntries.empty() ? nullptr : &specializationInfo;
 
-        createShaderModule(vertCode, &vertShaderModule, deviceIndex);
-        createShaderModule(fragCode, &fragShaderModule, deviceIndex);
         VkPipelineShaderStageCreateInfo shaderStages[2];
         shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -47,7 +67,7 @@ namespace cfx
         shaderStages[0].pName = "main";
         shaderStages[0].flags = 0;
         shaderStages[0].pNext = nullptr;
-        shaderStages[0].pSpecializationInfo = nullptr;
+        shaderStages[0].pSpecializationInfo = stageSpecializationInfo;
 
         shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -55,7 +75,7 @@ namespace cfx
         shaderStages[1].pName = "main";
         shaderStages[1].flags = 0;
         shaderStages[1].pNext = nullptr;
-        shaderStages[1].pSpecializationInfo = nullptr;
+        shaderStages[1].pSpecializationInfo = stageSpecializationInfo;
 
         auto &bindingDescriptions = configInfo.bindingDescriptions;
         auto &attributeDescriptions = configInfo.attributeDescriptions;
@@ -187,4 +207,45 @@ namespace cfx
             static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
         configInfo.dynamicStateInfo.flags = 0;
     }
-}
\ No newline at end of file
+
+    CFXComputePipeLine::CFXComputePipeLine(CFXDevice &device, VkPipelineLayout pipelineLayout, const std::string &compFilePath, int deviceIndex)
+        : cfxDevice{device}, deviceIndex{deviceIndex}
+    {
+        assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+        auto compCode = CFXPipeLine::readFile(compFilePath);
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = compCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t *>(compCode.data());
+        if (vkCreateShaderModule(cfxDevice.device(deviceIndex), &moduleInfo, nullptr, &compShaderModule) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create shader module");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = compShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+        if (vkCreateComputePipelines(cfxDevice.device(deviceIndex), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create compute pipeline");
+        }
+    }
+    CFXComputePipeLine::~CFXComputePipeLine()
+    {
+        vkDestroyShaderModule(cfxDevice.device(deviceIndex), compShaderModule, nullptr);
+        VkDevice device = cfxDevice.device(deviceIndex);
+        cfxDevice.getDeletionQueue(deviceIndex).defer([device, pipeline = computePipeline]
+                                                      { vkDestroyPipeline(device, pipeline, nullptr); });
+    }
+    void CFXComputePipeLine::bind(VkCommandBuffer commandBuffer)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    }
+}
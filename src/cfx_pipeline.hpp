@@ -11,6 +11,9 @@ namespace cfx
 
         std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
         std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+        // specialization constants, applied to every shader stage
+        std::vector<VkSpecializationMapEntry> specializationMapEntries{};
+        std::vector<uint8_t> specializationData{};
         VkPipelineViewportStateCreateInfo viewportInfo;
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
         VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -38,7 +41,9 @@ namespace cfx
         void bind(VkCommandBuffer commandBuffer);
 
     private:
+        friend class CFXComputePipeLine;
         static std::vector<char> readFile(const std::string &filepath);
+        static std::vector<std::vector<char>> readFiles(const std::vector<std::string> &filepaths);
 
         void createGraphicsPipeLine(const PipelineConfigInfo &configInfo, const std::string &vertFilePath, const std::string &fragFilePath, int deviceIndex);
         void createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule, int deviceIndex);
@@ -48,4 +53,20 @@ namespace cfx
         VkShaderModule fragShaderModule;
         int deviceIndex;
     };
+    class CFXComputePipeLine
+    {
+    public:
+        CFXComputePipeLine(CFXDevice &device, VkPipelineLayout pipelineLayout, const std::string &compFilePath, int deviceIndex);
+        ~CFXComputePipeLine();
+        CFXComputePipeLine(const CFXComputePipeLine &) = delete;
+        void operator=(const CFXComputePipeLine &) = delete;
+
+        void bind(VkCommandBuffer commandBuffer);
+
+    private:
+        CFXDevice &cfxDevice;
+        VkPipeline computePipeline{};
+        VkShaderModule compShaderModule;
+        int deviceIndex;
+    };
 }
\ No newline at end of file
@@ -7,7 +7,7 @@
 namespace cfx
 {
 
-    Renderer::Renderer(CFXWindow &window, CFXDevice &device) : cfxWindow{window}, cfxDevice{device}
+    Renderer::Renderer(CFXWindow &window, CFXDevice &device) : cfxWindow{window}, cfxDevice{device}, gpuTimer{device}
     {
         deviceCount = cfxDevice.getDevicesinDeviceGroup();
         commandBuffers.resize(deviceCount);
@@ -20,6 +20,11 @@ namespace cfx
     }
     Renderer::~Renderer()
     {
+        std::shared_ptr<CFXSwapChain> swapChain = std::move(cfxSwapChain);
+        for (int i = 0; i < deviceCount; i++)
+        {
+            cfxDevice.getDeletionQueue(i).defer([swapChain] {});
+        }
         // for(int i = 0; i < deviceCount; i++){
         //     freeCommandBuffers(i);
         // }
@@ -34,10 +39,6 @@ namespace cfx
             extent = cfxWindow.getExtent();
             glfwWaitEvents();
         }
-        for (int i = 0; i < deviceCount; i++)
-        {
-            vkDeviceWaitIdle(cfxDevice.device(i));
-        }
         if (cfxSwapChain == nullptr)
         {
             cfxSwapChain = std::make_unique<CFXSwapChain>(cfxDevice, extent);
@@ -51,6 +52,11 @@ namespace cfx
             {
                 throw std::runtime_error("Swapchain Image or Depth format changed");
             }
+            // frames in flight still render into the old images and wait on the old sync objects
+            for (int i = 0; i < deviceCount; i++)
+            {
+                cfxDevice.getDeletionQueue(i).defer([oldSwapchain] {});
+            }
             // if(cfxSwapChain->imageCount() != commandBuffers.size()){
             //     freeCommandBuffers();
             //     createCommandBuffers();
@@ -92,7 +98,7 @@ namespace cfx
         renderBuffer.commandBuffer = commandBuffer;
 
         renderBuffer.deviceIndex = deviceIndex;
-        std::cout << "BEGIN FRAME FOR GPU " << deviceIndex <<": " << cfxDevice.getDeviceName(deviceIndex) << std::endl;
+        // std::cout << "BEGIN FRAME FOR GPU " << deviceIndex <<": " << cfxDevice.getDeviceName(deviceIndex) << std::endl;
         auto result = cfxSwapChain->acquireNextImage(&currentImageIndex, deviceIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR)
         {
@@ -105,6 +111,7 @@ namespace cfx
         {
             throw std::runtime_error("failed to aquire swap chain image");
         }
+        cfxDevice.getDeletionQueue(deviceIndex).collect();
 
         // std::cout << "BEGIN COMMAND BUFFER" <<std::endl;
 
@@ -115,6 +122,7 @@ namespace cfx
             // std::cout << "BEGIN COMMAND BUFFER FAIL" <<std::endl;
             throw std::runtime_error("failed to begin recording command buffer!");
         }
+        gpuTimer.beginFrame(commandBuffer, deviceIndex, currentFrameIndex);
         //   std::cout << "BEGIN COMMAND BUFFER SUCCESS" <<std::endl;
         //   if(cfxDevice.getDevicesinDeviceGroup() > 1){
         //       vkCmdSetDeviceMask(commandBuffer,renderBuffer.deviceMask);
@@ -127,6 +135,7 @@ namespace cfx
     {
         assert(isFrameStarted && "cant call endFrame while frame is not in progress");
         auto commandBuffer = getCurrentCommandBuffer(deviceIndex);
+        gpuTimer.endFrame(commandBuffer, deviceIndex, currentFrameIndex);
 
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
         {
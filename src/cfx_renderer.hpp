@@ -3,6 +3,7 @@
 #include "cfx_window.hpp"
 #include "cfx_device.hpp"
 #include "cfx_swapchain.hpp"
+#include "cfx_gpu_timer.hpp"
 #include "cfx_model.hpp"
 
 #include <memory>
@@ -45,6 +46,10 @@ namespace cfx
         void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, uint32_t deviceMask, uint32_t deviceIndex);
         void endSwapChainRenderPass(VkCommandBuffer commandBuffer, uint32_t deviceMask, int deviceIndex);
         float getAspectRatio() const { return cfxSwapChain->extentAspectRatio(); }
+        uint32_t getSwapChainHeight() const { return cfxSwapChain->height(); }
+        VkFence getInFlightFence(int deviceIndex) const { return cfxSwapChain->getInFlightFence(deviceIndex); }
+        // Milliseconds the device's latest finished frame took on the GPU, a few frames behind the CPU
+        float getGpuFrameTime(int deviceIndex) const { return gpuTimer.getFrameTime(deviceIndex); }
 
     private:
         void createCommandBuffers(int deviceIndex);
@@ -55,6 +60,7 @@ namespace cfx
         CFXDevice &cfxDevice;
         // CFXSwapChain cfxSwapChain{cfxDevice,window.getExtent()};
         std::unique_ptr<CFXSwapChain> cfxSwapChain;
+        CFXGpuTimer gpuTimer;
         // CFXPipeLine cfxPipeLine{cfxDevice,CFXPipeLine::defaultPipelineConfigInfo(WIDTH,HEIGHT),"shaders/simple_shader.vert.spv","shaders/simple_shader.frag.spv"};
         std::vector<std::vector<VkCommandBuffer>> commandBuffers;
         uint32_t currentImageIndex;
@@ -0,0 +1,231 @@
+#include "cfx_residency_manager.hpp"
+
+#include <algorithm>
+
+namespace cfx
+{
+    CFXResidencyManager::CFXResidencyManager(CFXDevice &device, CFXGeometryArena &arena, CFXModelStreamer &streamer, VkDeviceSize budgetLimit)
+        : cfxDevice{device}, geometryArena{arena}, modelStreamer{streamer}, budgetLimit{budgetLimit}
+    {
+        deviceStats.resize(cfxDevice.getDevicesinDeviceGroup());
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            // the heaps the arena's two kinds of blocks land in
+            const CFXMemoryTypeTable &memoryTypes = cfxDevice.getMemoryAllocator(i).getMemoryTypes();
+            uint32_t deviceLocalType = memoryTypes.find(UINT32_MAX, CFXMemoryTypeTable::Usage::GpuOnly, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            uint32_t hostVisibleType = memoryTypes.find(UINT32_MAX, CFXMemoryTypeTable::Usage::HostResident, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            deviceStats[i].deviceLocal.heap = memoryTypes.getHeapIndex(deviceLocalType);
+            deviceStats[i].hostVisible.heap = memoryTypes.getHeapIndex(hostVisibleType);
+            separateHostHeap &= deviceStats[i].deviceLocal.heap != deviceStats[i].hostVisible.heap;
+        }
+    }
+
+    void CFXResidencyManager::measure()
+    {
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            CFXMemoryAllocator &allocator = cfxDevice.getMemoryAllocator(i);
+            CFXMemoryTypeTable &memoryTypes = allocator.getMemoryTypes();
+            memoryTypes.refreshBudgets();
+            Stats &stats = deviceStats[i];
+            for (HeapStats *heap : {&stats.deviceLocal, &stats.hostVisible})
+            {
+                // the driver also counts memory we do not know about, e.g. the swapchain images
+                VkDeviceSize usage = std::max(allocator.getHeapReserved(heap->heap), memoryTypes.getHeapUsage(heap->heap));
+                // whatever the heap gave back since the last frame settles the pending bytes first
+                VkDeviceSize released = heap->usage > usage ? heap->usage - usage : 0;
+                heap->pending -= std::min(heap->pending, released);
+                if (frame - heap->pendingFrame > RELEASE_TIMEOUT_FRAMES)
+                {
+                    heap->pending = 0;
+                }
+                heap->usage = usage;
+                heap->budget = memoryTypes.getHeapBudget(heap->heap);
+            }
+            if (budgetLimit != 0)
+            {
+                stats.deviceLocal.budget = std::min(stats.deviceLocal.budget, budgetLimit);
+            }
+            stats.deviceLocalArenaBytes = geometryArena.getReservedBytes(CFXGeometryArena::Placement::DeviceLocal);
+            stats.hostVisibleArenaBytes = geometryArena.getReservedBytes(CFXGeometryArena::Placement::HostVisible);
+        }
+    }
+
+    VkDeviceSize CFXResidencyManager::excess(HeapStats Stats::*heap, float fraction) const
+    {
+        VkDeviceSize result = 0;
+        for (const Stats &stats : deviceStats)
+        {
+            const HeapStats &heapStats = stats.*heap;
+            VkDeviceSize target = static_cast<VkDeviceSize>(heapStats.budget * fraction);
+            VkDeviceSize usage = heapStats.usage - std::min(heapStats.usage, heapStats.pending);
+            if (usage > target)
+            {
+                result = std::max(result, usage - target);
+            }
+        }
+        return result;
+    }
+
+    bool CFXResidencyManager::fits(HeapStats Stats::*heap, VkDeviceSize size, float fraction) const
+    {
+        for (const Stats &stats : deviceStats)
+        {
+            const HeapStats &heapStats = stats.*heap;
+            if (heapStats.usage + size > static_cast<VkDeviceSize>(heapStats.budget * fraction))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CFXResidencyManager::addPending(HeapStats Stats::*heap, VkDeviceSize bytes)
+    {
+        for (Stats &stats : deviceStats)
+        {
+            HeapStats &heapStats = stats.*heap;
+            heapStats.pending += bytes;
+            heapStats.pendingFrame = frame;
+        }
+    }
+
+    void CFXResidencyManager::update()
+    {
+        frame++;
+        measure();
+
+        std::vector<std::shared_ptr<CFXModel>> models;
+        for (const auto &streamed : modelStreamer.getModels())
+        {
+            if (auto model = streamed.lock())
+            {
+                models.push_back(std::move(model));
+            }
+        }
+
+        // bring back what was asked for since the last update
+        VkDeviceSize promoted = 0;
+        for (auto &model : models)
+        {
+            if (!model->used)
+            {
+                continue;
+            }
+            model->used = false;
+            model->lastUsedFrame = frame;
+            if (model->streaming)
+            {
+                continue;
+            }
+            if (model->evicted)
+            {
+                bool deviceLocal = !separateHostHeap || fits(&Stats::deviceLocal, promoted + model->evictedBytes, PROMOTE_BUDGET_FRACTION);
+                if (deviceLocal)
+                {
+                    promoted += model->evictedBytes;
+                }
+                modelStreamer.reload(model, deviceLocal ? CFXGeometryArena::Placement::DeviceLocal : CFXGeometryArena::Placement::HostVisible);
+                model->evicted = false;
+                restreams++;
+            }
+            else if (model->ready && model->placement == CFXGeometryArena::Placement::HostVisible &&
+                     fits(&Stats::deviceLocal, promoted + model->getGeometryBytes(), PROMOTE_BUDGET_FRACTION))
+            {
+                promoted += model->getGeometryBytes();
+                modelStreamer.reload(model, CFXGeometryArena::Placement::DeviceLocal);
+                promotions++;
+            }
+        }
+
+        VkDeviceSize deviceExcess = excess(&Stats::deviceLocal, EVICT_BUDGET_FRACTION);
+        VkDeviceSize hostExcess = separateHostHeap ? excess(&Stats::hostVisible, EVICT_BUDGET_FRACTION) : 0;
+        if (deviceExcess > 0 || hostExcess > 0)
+        {
+            std::vector<std::shared_ptr<CFXModel>> candidates;
+            for (auto &model : models)
+            {
+                if (model->ready && !model->streaming && frame - model->lastUsedFrame >= MIN_IDLE_FRAMES)
+                {
+                    candidates.push_back(model);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const std::shared_ptr<CFXModel> &a, const std::shared_ptr<CFXModel> &b)
+                      { return a->lastUsedFrame < b->lastUsedFrame; });
+
+            VkDeviceSize demoted = 0;
+            for (auto &model : candidates)
+            {
+                if (deviceExcess == 0 && hostExcess == 0)
+                {
+                    break;
+                }
+                VkDeviceSize bytes = model->getGeometryBytes();
+                bool inDeviceLocal = model->placement == CFXGeometryArena::Placement::DeviceLocal;
+                VkDeviceSize &heapExcess = inDeviceLocal ? deviceExcess : hostExcess;
+                if (heapExcess == 0)
+                {
+                    continue;
+                }
+                if (inDeviceLocal && separateHostHeap && hostExcess == 0 &&
+                    fits(&Stats::hostVisible, demoted + bytes, EVICT_BUDGET_FRACTION))
+                {
+                    demoted += bytes;
+                    modelStreamer.reload(model, CFXGeometryArena::Placement::HostVisible);
+                    demotions++;
+                }
+                else
+                {
+                    model->release();
+                    model->evicted = true;
+                    model->evictedBytes = bytes;
+                    evictions++;
+                }
+                addPending(inDeviceLocal ? &Stats::deviceLocal : &Stats::hostVisible, bytes);
+                heapExcess -= std::min(heapExcess, bytes);
+            }
+            geometryArena.releaseEmptyBlocks();
+        }
+
+        countModels(models);
+    }
+
+    void CFXResidencyManager::countModels(const std::vector<std::shared_ptr<CFXModel>> &models)
+    {
+        Stats counts{};
+        for (const auto &model : models)
+        {
+            if (model->streaming)
+            {
+                counts.streamingCount++;
+            }
+            else if (model->evicted)
+            {
+                counts.evictedCount++;
+            }
+            else if (model->ready && model->placement == CFXGeometryArena::Placement::HostVisible)
+            {
+                counts.demotedCount++;
+                counts.demotedBytes += model->getGeometryBytes();
+            }
+            else if (model->ready)
+            {
+                counts.residentCount++;
+                counts.residentBytes += model->getGeometryBytes();
+            }
+        }
+        for (Stats &stats : deviceStats)
+        {
+            stats.residentCount = counts.residentCount;
+            stats.demotedCount = counts.demotedCount;
+            stats.evictedCount = counts.evictedCount;
+            stats.streamingCount = counts.streamingCount;
+            stats.residentBytes = counts.residentBytes;
+            stats.demotedBytes = counts.demotedBytes;
+            stats.demotions = demotions;
+            stats.evictions = evictions;
+            stats.promotions = promotions;
+            stats.restreams = restreams;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cfx_device.hpp"
+#include "cfx_geometry_arena.hpp"
+#include "cfx_model_streamer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Keeps the streamed models within each device's memory budget.
+     *
+     * Every frame the manager compares, per device, what the device local and host visible
+     * heaps hold against their budget: the driver's numbers with VK_EXT_memory_budget, else
+     * the allocator's own accounting against the heap size, optionally capped by a limit.
+     * Models are replicated with the same arena layout on every device, so when any device
+     * is over budget the least recently drawn models are moved on all of them: demoted into
+     * host visible arena blocks while the host heap has room, evicted entirely otherwise.
+     * What was moved out of a heap no longer counts against it while the frames in flight still
+     * hold on to it, so the same overrun does not evict again on the next frame.
+     * A model is used when CFXModel::getDrawable() is called on it. Evicted models are
+     * streamed in again on their next use, demoted ones go back to device local memory once
+     * there is headroom. Only models unused for MIN_IDLE_FRAMES frames are demoted or
+     * evicted, so what is on screen does not bounce in and out.
+     *
+     * Main thread only, update() runs once per frame after the streamer's update().
+     */
+    class CFXResidencyManager
+    {
+    public:
+        // eviction brings usage back under this share of the budget, the rest is left to everything else on the heap
+        static constexpr float EVICT_BUDGET_FRACTION = 0.9f;
+        // a model only moves back into device local memory below this share, so it does not bounce
+        static constexpr float PROMOTE_BUDGET_FRACTION = 0.75f;
+        static constexpr uint64_t MIN_IDLE_FRAMES = 60;
+        // bytes moved out of a heap that have not shown up as released by then stay in partly used
+        // arena blocks, eviction counts them as used again
+        static constexpr uint64_t RELEASE_TIMEOUT_FRAMES = 30;
+
+        struct HeapStats
+        {
+            uint32_t heap = UINT32_MAX;
+            VkDeviceSize budget = 0;
+            VkDeviceSize usage = 0;
+            // demoted or evicted out of the heap but still in usage until the frames in flight let go of it
+            VkDeviceSize pending = 0;
+            uint64_t pendingFrame = 0;
+        };
+
+        struct Stats
+        {
+            HeapStats deviceLocal{};
+            // the same heap as deviceLocal on unified memory, models are then evicted instead of demoted
+            HeapStats hostVisible{};
+            // geometry arena blocks living in each heap
+            VkDeviceSize deviceLocalArenaBytes = 0;
+            VkDeviceSize hostVisibleArenaBytes = 0;
+            uint32_t residentCount = 0;
+            uint32_t demotedCount = 0;
+            uint32_t evictedCount = 0;
+            uint32_t streamingCount = 0;
+            VkDeviceSize residentBytes = 0;
+            VkDeviceSize demotedBytes = 0;
+            // totals since creation
+            uint64_t demotions = 0;
+            uint64_t evictions = 0;
+            uint64_t promotions = 0;
+            uint64_t restreams = 0;
+        };
+
+        // budgetLimit caps the device local budget of every device, 0 leaves it to the driver or the heap size
+        CFXResidencyManager(CFXDevice &device, CFXGeometryArena &arena, CFXModelStreamer &streamer, VkDeviceSize budgetLimit = 0);
+        CFXResidencyManager(const CFXResidencyManager &) = delete;
+        CFXResidencyManager &operator=(const CFXResidencyManager &) = delete;
+
+        void update();
+
+        void setBudgetLimit(VkDeviceSize limit) { budgetLimit = limit; }
+        const Stats &getStats(int deviceIndex) const { return deviceStats[deviceIndex]; }
+
+    private:
+        // Reads the heaps of every device into deviceStats
+        void measure();
+        // How far the heap of the most loaded device is above fraction of its budget, 0 if none is.
+        // Pending bytes are already on their way out and do not count.
+        VkDeviceSize excess(HeapStats Stats::*heap, float fraction) const;
+        bool fits(HeapStats Stats::*heap, VkDeviceSize size, float fraction) const;
+        // Counts bytes leaving the heap on every device as pending until measure() sees them released
+        void addPending(HeapStats Stats::*heap, VkDeviceSize bytes);
+        void countModels(const std::vector<std::shared_ptr<CFXModel>> &models);
+
+        CFXDevice &cfxDevice;
+        CFXGeometryArena &geometryArena;
+        CFXModelStreamer &modelStreamer;
+        VkDeviceSize budgetLimit;
+        uint64_t frame = 0;
+        uint64_t demotions = 0;
+        uint64_t evictions = 0;
+        uint64_t promotions = 0;
+        uint64_t restreams = 0;
+        // device local and host visible heaps differ on every device
+        bool separateHostHeap = true;
+        std::vector<Stats> deviceStats;
+    };
+}
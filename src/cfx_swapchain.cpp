@@ -71,7 +71,7 @@ namespace cfx
       {
         vkDestroyImageView(device.device(deviceIndex), depthImageViews[deviceIndex][i], nullptr);
         vkDestroyImage(device.device(deviceIndex), depthImages[deviceIndex][i], nullptr);
-        vkFreeMemory(device.device(deviceIndex), depthImageMemorys[deviceIndex][i], nullptr);
+        device.getMemoryAllocator(deviceIndex).free(depthImageMemorys[deviceIndex][i]);
       }
 
       for (auto frameBufferArray : swapChainFramebuffers[deviceIndex])
@@ -114,7 +114,8 @@ namespace cfx
   }
   void CFXSwapChain::destroySyncObjects(int deviceIndex)
   {
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    // empty when the next swapchain took them over
+    for (size_t i = 0; i < inFlightFences[deviceIndex].size(); i++)
     {
       vkDestroySemaphore(device.device(deviceIndex), renderFinishedSemaphores[deviceIndex][i], nullptr);
       vkDestroySemaphore(device.device(deviceIndex), imageAvailableSemaphores[deviceIndex][i], nullptr);
@@ -131,6 +132,11 @@ namespace cfx
     // std::cout << device.getDeviceName(deviceIndex) << " IMAGES IN FLIGHT " << imagesInFlight[deviceIndex].size() << std::endl;
     // std::cout << device.getDeviceName(deviceIndex) << " IN FLIGHT FENCES " << inFlightFences[deviceIndex].size() << std::endl;
 
+    // with more frames in flight than images, an older frame may still render into this image
+    if (imagesInFlight[deviceIndex][*imageIndex] != VK_NULL_HANDLE)
+    {
+      vkWaitForFences(device.device(deviceIndex), 1, &imagesInFlight[deviceIndex][*imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
     imagesInFlight[deviceIndex][*imageIndex] = inFlightFences[deviceIndex][currentFrame];
 
     VkSubmitInfo submitInfo = {};
@@ -146,11 +152,19 @@ namespace cfx
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = buffers;
 
-    std::vector<VkSemaphore> signalSemaphores = {renderFinishedSemaphores[deviceIndex][currentFrame]};
-    std::vector<uint32_t> signalSemaphoreIndices = {0};
-    submitInfo.signalSemaphoreCount = 1;
+    // the timeline tells the deletion queue when this frame is done with what it used
+    CFXDeletionQueue &deletionQueue = device.getDeletionQueue(deviceIndex);
+    std::vector<VkSemaphore> signalSemaphores = {renderFinishedSemaphores[deviceIndex][currentFrame], deletionQueue.getTimeline()};
+    std::vector<uint64_t> signalValues = {0, deletionQueue.advance()};
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
     submitInfo.pSignalSemaphores = signalSemaphores.data();
 
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+    submitInfo.pNext = &timelineInfo;
+
     VkResult result = vkResetFences(device.device(deviceIndex), 1, &inFlightFences[deviceIndex][currentFrame]);
     if (result == VK_SUCCESS)
     {
@@ -235,7 +249,8 @@ namespace cfx
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // retiring the old swapchain lets its queued presents finish while this one takes over the surface
+    createInfo.oldSwapchain = oldSwapChain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChains[deviceIndex];
 
     if (vkCreateSwapchainKHR(device.device(deviceIndex), &createInfo, nullptr, &swapChains[deviceIndex]) != VK_SUCCESS)
     {
@@ -453,10 +468,20 @@ namespace cfx
   void CFXSwapChain::createSyncObjects(int deviceIndex)
   {
     // std::cout << "CREATE SYNC OBJECTS "   <<std::endl;
+    imagesInFlight[deviceIndex].resize(imageCount(deviceIndex), VK_NULL_HANDLE);
+    if (oldSwapChain != nullptr)
+    {
+      // the in flight fences keep guarding the frames submitted before the recreate, so the
+      // per frame command buffers and buffers are not reused under the GPU's feet
+      imageAvailableSemaphores[deviceIndex] = std::move(oldSwapChain->imageAvailableSemaphores[deviceIndex]);
+      renderFinishedSemaphores[deviceIndex] = std::move(oldSwapChain->renderFinishedSemaphores[deviceIndex]);
+      inFlightFences[deviceIndex] = std::move(oldSwapChain->inFlightFences[deviceIndex]);
+      currentFrame = oldSwapChain->currentFrame;
+      return;
+    }
     imageAvailableSemaphores[deviceIndex].resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores[deviceIndex].resize(MAX_FRAMES_IN_FLIGHT);
     inFlightFences[deviceIndex].resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight[deviceIndex].resize(imageCount(deviceIndex), VK_NULL_HANDLE);
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -40,6 +40,8 @@ namespace cfx
 
         VkResult acquireNextImage(uint32_t *imageIndex, uint32_t deviceIndex);
         VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint32_t deviceIndex);
+        // Fence the current frame's submit will signal, acquireNextImage() has waited on its previous signal
+        VkFence getInFlightFence(int deviceIndex) { return inFlightFences[deviceIndex][currentFrame]; }
         bool compareSwapFormats(const CFXSwapChain &cfxSwapChain) const
         {
             return cfxSwapChain.swapChainDepthFormat == swapChainDepthFormat && cfxSwapChain.swapChainImageFormat == swapChainImageFormat;
@@ -70,7 +72,7 @@ namespace cfx
         std::vector<VkRenderPass> renderPasses;
 
         std::vector<std::vector<VkImage>> depthImages;
-        std::vector<std::vector<VkDeviceMemory>> depthImageMemorys;
+        std::vector<std::vector<CFXMemoryAllocator::Allocation>> depthImageMemorys;
         std::vector<std::vector<VkImageView>> depthImageViews;
         std::vector<std::vector<VkImage>> swapChainImages;
         std::vector<std::vector<VkImageView>> swapChainImageViews;
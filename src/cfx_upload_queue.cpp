@@ -0,0 +1,363 @@
+#include "cfx_upload_queue.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace cfx
+{
+    // every consumer of uploaded data: vertex and index fetch, and the meshlet culling shader
+    static constexpr VkPipelineStageFlags UPLOAD_READ_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    static constexpr VkAccessFlags UPLOAD_READ_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    CFXUploadQueue::CFXUploadQueue(CFXDevice &device, VkDeviceSize ringSize) : cfxDevice{device}, ringSize{ringSize}
+    {
+        deviceStates.resize(cfxDevice.getDevicesinDeviceGroup());
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            createDeviceState(i);
+        }
+    }
+
+    CFXUploadQueue::~CFXUploadQueue()
+    {
+        wait(submit());
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            vkDestroyCommandPool(cfxDevice.device(i), deviceStates[i].commandPool, nullptr);
+            if (deviceStates[i].acquireCommandPool != VK_NULL_HANDLE)
+            {
+                vkDestroyCommandPool(cfxDevice.device(i), deviceStates[i].acquireCommandPool, nullptr);
+            }
+        }
+    }
+
+    void CFXUploadQueue::createDeviceState(int deviceIndex)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        state.queueFamilies = cfxDevice.findPhysicalQueueFamilies(deviceIndex);
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = state.queueFamilies.transferFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        if (vkCreateCommandPool(cfxDevice.device(deviceIndex), &poolInfo, nullptr, &state.commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+        if (state.queueFamilies.hasDedicatedTransfer())
+        {
+            poolInfo.queueFamilyIndex = state.queueFamilies.graphicsFamily;
+            if (vkCreateCommandPool(cfxDevice.device(deviceIndex), &poolInfo, nullptr, &state.acquireCommandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create upload acquire command pool!");
+            }
+        }
+
+        state.ring = std::make_unique<CFXBuffer>(cfxDevice, ringSize, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, deviceIndex);
+        if (state.ring->map() != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to map upload staging ring!");
+        }
+        state.ringData = static_cast<uint8_t *>(state.ring->getMappedMemory());
+    }
+
+    VkCommandBuffer CFXUploadQueue::beginRecording(int deviceIndex)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        if (state.recording != VK_NULL_HANDLE)
+        {
+            return state.recording;
+        }
+        state.recording = beginCommandBuffer(deviceIndex, state.commandPool);
+        return state.recording;
+    }
+
+    VkCommandBuffer CFXUploadQueue::beginCommandBuffer(int deviceIndex, VkCommandPool commandPool)
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(cfxDevice.device(deviceIndex), &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+    bool CFXUploadQueue::reserveRing(int deviceIndex, VkDeviceSize size, VkDeviceSize &offset)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        if (state.ringHead == state.ringTail)
+        {
+            // nothing staged or in flight, start over at the next ring boundary so any upload up to the ring size fits
+            state.ringHead = state.ringTail = (state.ringHead + ringSize - 1) / ringSize * ringSize;
+        }
+        uint64_t start = (state.ringHead + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+        // an upload never wraps around the end of the ring, it starts over at the beginning instead
+        if (start / ringSize != (start + size - 1) / ringSize)
+        {
+            start = (start / ringSize + 1) * ringSize;
+        }
+        if (start + size - state.ringTail > ringSize)
+        {
+            return false;
+        }
+        state.ringHead = start + size;
+        offset = start % ringSize;
+        return true;
+    }
+
+    void CFXUploadQueue::enqueue(int deviceIndex, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+        memcpy(stage(deviceIndex, dstBuffer, dstOffset, size), data, size);
+    }
+
+    void *CFXUploadQueue::stage(int deviceIndex, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+    {
+        if (size == 0)
+        {
+            return nullptr;
+        }
+        DeviceState &state = deviceStates[deviceIndex];
+        VkBuffer srcBuffer;
+        VkDeviceSize srcOffset = 0;
+        void *staged = nullptr;
+        if (size <= ringSize)
+        {
+            retire(deviceIndex, false);
+            bool reserved;
+            while (!(reserved = reserveRing(deviceIndex, size, srcOffset)))
+            {
+                if (state.ringHead == state.ringTail)
+                {
+                    // an empty ring that still has no room, nothing left to wait for
+                    break;
+                }
+                if (state.inFlight.empty())
+                {
+                    // the ring is full of copies nobody submitted yet
+                    submit();
+                }
+                else
+                {
+                    retire(deviceIndex, true);
+                }
+            }
+            if (reserved)
+            {
+                staged = state.ringData + srcOffset;
+                srcBuffer = state.ring->getBuffer();
+            }
+        }
+        if (staged == nullptr)
+        {
+            srcOffset = 0;
+            auto staging = std::make_unique<CFXBuffer>(cfxDevice, size, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, deviceIndex);
+            if (staging->map() != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to map upload staging buffer!");
+            }
+            staged = staging->getMappedMemory();
+            srcBuffer = staging->getBuffer();
+            state.pendingStaging.push_back(std::move(staging));
+        }
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(beginRecording(deviceIndex), srcBuffer, dstBuffer, 1, &copyRegion);
+
+        if (state.queueFamilies.hasDedicatedTransfer())
+        {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = state.queueFamilies.transferFamily;
+            barrier.dstQueueFamilyIndex = state.queueFamilies.graphicsFamily;
+            barrier.buffer = dstBuffer;
+            barrier.offset = dstOffset;
+            barrier.size = size;
+            state.ownershipBarriers.push_back(barrier);
+        }
+        return staged;
+    }
+
+    void CFXUploadQueue::submitDevice(int deviceIndex, Ticket ticket)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        VkDevice device = cfxDevice.device(deviceIndex);
+        Batch batch{ticket, state.recording, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, state.ringHead, std::move(state.pendingStaging)};
+        state.pendingStaging.clear();
+        state.recording = VK_NULL_HANDLE;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+
+        if (!state.queueFamilies.hasDedicatedTransfer())
+        {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+            vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_READ_STAGES, 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+            vkEndCommandBuffer(batch.commandBuffer);
+
+            submitInfo.pCommandBuffers = &batch.commandBuffer;
+            if (vkQueueSubmit(cfxDevice.getGraphicsQueues(deviceIndex), 1, &submitInfo, batch.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+            state.inFlight.push_back(std::move(batch));
+            return;
+        }
+
+        // release every written range on the transfer queue
+        std::vector<VkBufferMemoryBarrier> &barriers = state.ownershipBarriers;
+        for (auto &barrier : barriers)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                             0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+        vkEndCommandBuffer(batch.commandBuffer);
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload semaphore!");
+        }
+        submitInfo.pCommandBuffers = &batch.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.semaphore;
+        if (vkQueueSubmit(cfxDevice.getTransferQueues(deviceIndex), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+
+        // and acquire them on the graphics queue before any vertex input or culling shader reads them
+        batch.acquireCommandBuffer = beginCommandBuffer(deviceIndex, state.acquireCommandPool);
+        for (auto &barrier : barriers)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+        }
+        vkCmdPipelineBarrier(batch.acquireCommandBuffer, UPLOAD_READ_STAGES, UPLOAD_READ_STAGES, 0,
+                             0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+        vkEndCommandBuffer(batch.acquireCommandBuffer);
+        barriers.clear();
+
+        VkPipelineStageFlags waitStage = UPLOAD_READ_STAGES;
+        VkSubmitInfo acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &batch.semaphore;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+        if (vkQueueSubmit(cfxDevice.getGraphicsQueues(deviceIndex), 1, &acquireInfo, batch.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload acquire command buffer!");
+        }
+        state.inFlight.push_back(std::move(batch));
+    }
+
+    CFXUploadQueue::Ticket CFXUploadQueue::submit()
+    {
+        bool hasWork = false;
+        for (auto &state : deviceStates)
+        {
+            hasWork |= state.recording != VK_NULL_HANDLE;
+        }
+        if (!hasWork)
+        {
+            return lastTicket;
+        }
+        lastTicket++;
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            if (deviceStates[i].recording != VK_NULL_HANDLE)
+            {
+                submitDevice(i, lastTicket);
+            }
+        }
+        return lastTicket;
+    }
+
+    void CFXUploadQueue::retire(int deviceIndex, bool wait)
+    {
+        DeviceState &state = deviceStates[deviceIndex];
+        VkDevice device = cfxDevice.device(deviceIndex);
+        while (!state.inFlight.empty())
+        {
+            Batch &batch = state.inFlight.front();
+            if (wait)
+            {
+                vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+                wait = false;
+            }
+            else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS)
+            {
+                break;
+            }
+            // a batch that staged nothing in the ring may end before a later rebase of it
+            state.ringTail = std::max(state.ringTail, batch.ringEnd);
+            vkDestroyFence(device, batch.fence, nullptr);
+            vkFreeCommandBuffers(device, state.commandPool, 1, &batch.commandBuffer);
+            if (batch.acquireCommandBuffer != VK_NULL_HANDLE)
+            {
+                vkFreeCommandBuffers(device, state.acquireCommandPool, 1, &batch.acquireCommandBuffer);
+                vkDestroySemaphore(device, batch.semaphore, nullptr);
+            }
+            state.inFlight.pop_front();
+        }
+    }
+
+    bool CFXUploadQueue::isComplete(Ticket ticket)
+    {
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            retire(i, false);
+            if (!deviceStates[i].inFlight.empty() && deviceStates[i].inFlight.front().ticket <= ticket)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CFXUploadQueue::wait(Ticket ticket)
+    {
+        for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
+        {
+            while (!deviceStates[i].inFlight.empty() && deviceStates[i].inFlight.front().ticket <= ticket)
+            {
+                retire(i, true);
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "cfx_buffer.hpp"
+#include "cfx_device.hpp"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Batches host to device buffer uploads.
+     *
+     * enqueue() copies the data into a persistently mapped staging ring and records the copy
+     * into an open command buffer for that device, stage() hands out the ring space instead. submit() closes every open command buffer,
+     * submits it once per device with a fence and returns a ticket that can be polled with
+     * isComplete() or waited on with wait(). Ring space is reclaimed as fences signal. An
+     * upload larger than the ring gets a staging buffer of its own for that batch.
+     *
+     * Copies run on the device's transfer queue. Where that is a separate family, each batch
+     * releases the written ranges to the graphics family and a small acquire submit on the
+     * graphics queue waits for it on a semaphore; the fence sits on that acquire submit. Either
+     * way draws submitted to the graphics queue afterwards see the uploaded data without
+     * waiting on the ticket.
+     */
+    class CFXUploadQueue
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_RING_SIZE = 16 * 1024 * 1024;
+        static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+        using Ticket = uint64_t;
+
+        CFXUploadQueue(CFXDevice &device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+        ~CFXUploadQueue();
+        CFXUploadQueue(const CFXUploadQueue &) = delete;
+        CFXUploadQueue &operator=(const CFXUploadQueue &) = delete;
+
+        // Records a copy of size bytes from data into dstBuffer at dstOffset, data may be freed on return
+        void enqueue(int deviceIndex, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+        // Records the same copy and returns the staging memory it reads, for callers that produce the
+        // bytes in place. Fill it before the next call into the queue, which may submit it.
+        void *stage(int deviceIndex, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+        // Submits everything enqueued so far, returns the ticket of the last submitted batch
+        Ticket submit();
+        bool isComplete(Ticket ticket);
+        void wait(Ticket ticket);
+
+    private:
+        struct Batch
+        {
+            Ticket ticket;
+            VkCommandBuffer commandBuffer;
+            // only set when the transfer queue is a separate family
+            VkCommandBuffer acquireCommandBuffer;
+            VkSemaphore semaphore;
+            VkFence fence;
+            uint64_t ringEnd;
+            std::vector<std::unique_ptr<CFXBuffer>> dedicatedStaging;
+        };
+
+        struct DeviceState
+        {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+            QueueFamilyIndices queueFamilies;
+            std::unique_ptr<CFXBuffer> ring;
+            uint8_t *ringData = nullptr;
+            // monotonic byte positions, the live part of the ring is [ringTail, ringHead)
+            uint64_t ringHead = 0;
+            uint64_t ringTail = 0;
+            VkCommandBuffer recording = VK_NULL_HANDLE;
+            std::vector<std::unique_ptr<CFXBuffer>> pendingStaging;
+            // ranges written by the open command buffer that change queue family on submit
+            std::vector<VkBufferMemoryBarrier> ownershipBarriers;
+            std::deque<Batch> inFlight;
+        };
+
+        void createDeviceState(int deviceIndex);
+        VkCommandBuffer beginRecording(int deviceIndex);
+        VkCommandBuffer beginCommandBuffer(int deviceIndex, VkCommandPool commandPool);
+        void submitDevice(int deviceIndex, Ticket ticket);
+        // Frees the resources of finished batches, waits for the oldest one first if wait is set
+        void retire(int deviceIndex, bool wait);
+        bool reserveRing(int deviceIndex, VkDeviceSize size, VkDeviceSize &offset);
+
+        CFXDevice &cfxDevice;
+        VkDeviceSize ringSize;
+        std::vector<DeviceState> deviceStates;
+        Ticket lastTicket = 0;
+    };
+}
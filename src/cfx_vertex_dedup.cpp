@@ -0,0 +1,81 @@
+#include "cfx_vertex_dedup.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace cfx
+{
+    CFXVertexDedup::CFXVertexDedup(std::vector<CFXModel::Vertex> &vertices, size_t indexCount) : vertices{vertices}
+    {
+        assert(vertices.empty() && "CFXVertexDedup must start from an empty vertex list");
+        size_t expectedVertices = indexCount / INDICES_PER_UNIQUE_VERTEX;
+        vertices.reserve(expectedVertices);
+        size_t slotCount = 16;
+        while (slotCount < expectedVertices * 2)
+        {
+            slotCount *= 2;
+        }
+        resize(slotCount);
+    }
+
+    uint32_t CFXVertexDedup::hashVertex(const CFXModel::Vertex &vertex)
+    {
+        const float fields[] = {vertex.position.x, vertex.position.y, vertex.position.z,
+                                vertex.color.x, vertex.color.y, vertex.color.z,
+                                vertex.normal.x, vertex.normal.y, vertex.normal.z,
+                                vertex.uv.x, vertex.uv.y};
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (float field : fields)
+        {
+            // -0.0f and 0.0f compare equal so they have to hash equal too
+            field += 0.0f;
+            uint32_t bits;
+            memcpy(&bits, &field, sizeof(bits));
+            hash = (hash ^ bits) * 0x100000001b3ull;
+        }
+        // the table indexes by the low bits, so mix the high ones down
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return static_cast<uint32_t>(hash);
+    }
+
+    uint32_t CFXVertexDedup::insert(CFXModel::Vertex vertex)
+    {
+        if ((vertices.size() + 1) * 2 > slots.size())
+        {
+            resize(slots.size() * 2);
+        }
+        vertex.hash = hashVertex(vertex);
+        for (size_t slot = vertex.hash & mask;; slot = (slot + 1) & mask)
+        {
+            Slot &entry = slots[slot];
+            if (entry.index == EMPTY_SLOT)
+            {
+                entry.hash = vertex.hash;
+                entry.index = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+                return entry.index;
+            }
+            if (entry.hash == vertex.hash && vertices[entry.index] == vertex)
+            {
+                return entry.index;
+            }
+        }
+    }
+
+    void CFXVertexDedup::resize(size_t slotCount)
+    {
+        slots.assign(slotCount, Slot{0, EMPTY_SLOT});
+        mask = slotCount - 1;
+        for (uint32_t i = 0; i < vertices.size(); i++)
+        {
+            size_t slot = vertices[i].hash & mask;
+            while (slots[slot].index != EMPTY_SLOT)
+            {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = Slot{vertices[i].hash, i};
+        }
+    }
+}
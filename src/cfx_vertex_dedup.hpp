@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cfx_model.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace cfx
+{
+    /*
+     * Flat open-addressing table that deduplicates vertices while a mesh is built.
+     *
+     * Every vertex is hashed once, the hash is kept in Vertex::hash and next to the index in
+     * the slot, so a probe only touches the vertex array when the full hashes match. The
+     * table starts out sized for a typical share of unique vertices and grows to stay at
+     * most half full.
+     */
+    class CFXVertexDedup
+    {
+    public:
+        // vertices receives every unique vertex in first-seen order and must start empty,
+        // indexCount is the number of vertices about to be inserted
+        CFXVertexDedup(std::vector<CFXModel::Vertex> &vertices, size_t indexCount);
+
+        // Returns the index of vertex in vertices, appending it if it has not been seen yet
+        uint32_t insert(CFXModel::Vertex vertex);
+
+        static uint32_t hashVertex(const CFXModel::Vertex &vertex);
+
+    private:
+        static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+        // closed meshes share a vertex between about 6 corners, seams and flat shading lower that
+        static constexpr size_t INDICES_PER_UNIQUE_VERTEX = 4;
+
+        struct Slot
+        {
+            uint32_t hash;
+            uint32_t index;
+        };
+
+        void resize(size_t slotCount);
+
+        std::vector<CFXModel::Vertex> &vertices;
+        std::vector<Slot> slots{};
+        size_t mask = 0;
+    };
+}
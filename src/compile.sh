@@ -1,4 +1,5 @@
 glslc ./shaders/simple_shader.vert -o ./shaders/simple_shader.vert.spv
 glslc ./shaders/simple_shader.frag -o ./shaders/simple_shader.frag.spv
 glslc ./shaders/point_light.vert -o ./shaders/point_light.vert.spv
-glslc ./shaders/point_light.frag -o ./shaders/point_light.frag.spv
\ No newline at end of file
+glslc ./shaders/point_light.frag -o ./shaders/point_light.frag.spv
+glslc ./shaders/meshlet_cull.comp -o ./shaders/meshlet_cull.comp.spv
\ No newline at end of file
@@ -1,9 +1,29 @@
 #include "cfx_app.hpp"
+#include "cfx_asset_archive.hpp"
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
-int main()
+#include <string>
+int main(int argc, char **argv)
 {
+  // --archive <file.cfxa> loads assets from a packed archive, anything it lacks still comes from disk
+  for (int i = 1; i + 1 < argc; i++)
+  {
+    if (std::string{argv[i]} != "--archive")
+    {
+      continue;
+    }
+    try
+    {
+      cfx::CFXAssetArchive::mount(cfx::CFXAssetArchive::open(argv[i + 1]));
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
   cfx::App app{};
   try
   {
@@ -16,4 +36,4 @@ int main()
   }
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #version 450
 
+// CFXModel::VertexFormat::Packed: position is snorm16 and rescaled by push.modelMatrix,
+// normal.xy holds an octahedral encoded unit vector
+layout(constant_id = 0) const bool packedVertices = false;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 normal;
@@ -27,11 +31,19 @@ layout(push_constant) uniform Push {
   mat4 normalMatrix;
 } push;
 
+vec3 decodeOctahedral(vec2 encoded) {
+  vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
 void main() {
   vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
   gl_Position = ubo.projection * ubo.view * positionWorld;
 
-  fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+  vec3 objectNormal = packedVertices ? decodeOctahedral(normal.xy) : normal;
+  fragNormalWorld = normalize(mat3(push.normalMatrix) * objectNormal);
   fragPositionWorld = positionWorld.xyz;
   fragColor = color;
 }
\ No newline at end of file
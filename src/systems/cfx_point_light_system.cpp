@@ -62,7 +62,7 @@ namespace cfx
         // std::cout << "RENDER POINT LIGHT ON " << cfxDevice.getDeviceName(frameInfo.deviceIndex) << std::endl;
 
         cfxPipeLines[frameInfo.deviceIndex]->bind(frameInfo.commandBuffer);
-        vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout[frameInfo.deviceIndex], 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+        vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout[frameInfo.deviceIndex], 0, 1, &frameInfo.globalDescriptorSet, 1, &frameInfo.globalUboOffset);
         for (auto &kv : frameInfo.gameObjects)
         {
             auto &obj = kv.second;
@@ -1,8 +1,11 @@
 #include "cfx_render_system.hpp"
+#include "../cfx_swapchain.hpp"
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <memory>
+#include <cstring>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -17,14 +20,42 @@ namespace cfx
     glm::mat4 normlaMatrix{1.f};
     // alignas(16) glm::vec3 color;
   };
-  CFXRenderSystem::CFXRenderSystem(CFXDevice &device, std::vector<VkRenderPass> renderPasses, std::vector<std::unique_ptr<CFXDescriptorSetLayout>> &cfxSetLayouts) : cfxDevice{device}
+  // meshlet_cull.comp push constants
+  struct MeshletCullPushConstantData
+  {
+    glm::mat4 modelMatrix{1.f};
+    glm::vec4 cameraPosition{0.f};
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+    uint32_t drawOffset;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t backfaceCulling;
+  };
+  // largest simplification error allowed on screen, in pixels
+  static constexpr float LOD_PIXEL_ERROR = 1.f;
+  // local_size_x of meshlet_cull.comp
+  static constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+  CFXRenderSystem::CFXRenderSystem(CFXDevice &device, CFXGeometryArena &arena, std::vector<VkRenderPass> renderPasses,
+                                   std::vector<std::unique_ptr<CFXDescriptorSetLayout>> &cfxSetLayouts)
+      : cfxDevice{device}, geometryArena{arena}
   {
     pipelineLayout.resize(cfxDevice.getDevicesinDeviceGroup());
     cfxPipeLines.resize(cfxDevice.getDevicesinDeviceGroup());
+    cullPipelineLayout.resize(cfxDevice.getDevicesinDeviceGroup());
+    cullPipeLines.resize(cfxDevice.getDevicesinDeviceGroup());
+    storageSetLayouts.resize(cfxDevice.getDevicesinDeviceGroup());
+    cullDescriptorPools.resize(cfxDevice.getDevicesinDeviceGroup());
+    meshletDescriptorSets.resize(cfxDevice.getDevicesinDeviceGroup());
+    drawBuffers.resize(cfxDevice.getDevicesinDeviceGroup());
+    drawDescriptorSets.resize(cfxDevice.getDevicesinDeviceGroup());
     for (int deviceIndex = 0; deviceIndex < cfxDevice.getDevicesinDeviceGroup(); deviceIndex++)
     {
       createPipelineLayout(cfxSetLayouts[deviceIndex]->getDescriptorSetLayout(), deviceIndex);
-      createPipeline(renderPasses[deviceIndex], deviceIndex);
+      createPipeline(renderPasses[deviceIndex], deviceIndex, CFXModel::VertexFormat::Full);
+      createPipeline(renderPasses[deviceIndex], deviceIndex, CFXModel::VertexFormat::Packed);
+      createCullResources(cfxSetLayouts[deviceIndex]->getDescriptorSetLayout(), deviceIndex);
     }
   }
   CFXRenderSystem::~CFXRenderSystem()
@@ -32,23 +63,163 @@ namespace cfx
     for (int i = 0; i < cfxDevice.getDevicesinDeviceGroup(); i++)
     {
       vkDestroyPipelineLayout(cfxDevice.device(i), pipelineLayout[i], nullptr);
+      vkDestroyPipelineLayout(cfxDevice.device(i), cullPipelineLayout[i], nullptr);
     }
   }
+  void CFXRenderSystem::createCullResources(VkDescriptorSetLayout globalSetLayout, int deviceIndex)
+  {
+    storageSetLayouts[deviceIndex] = CFXDescriptorSetLayout::Builder(cfxDevice).addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT).build(deviceIndex);
+    cullDescriptorPools[deviceIndex] = CFXDescriptorPool::Builder(cfxDevice)
+                                           .setMaxSets(CFXSwapChain::MAX_FRAMES_IN_FLIGHT + MAX_MESHLET_BLOCKS)
+                                           .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, CFXSwapChain::MAX_FRAMES_IN_FLIGHT + MAX_MESHLET_BLOCKS)
+                                           .build(deviceIndex);
 
-  void CFXRenderSystem::renderGameObjects(FrameInfo &frameInfo)
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(MeshletCullPushConstantData);
+    VkDescriptorSetLayout storageSetLayout = storageSetLayouts[deviceIndex]->getDescriptorSetLayout();
+    std::vector<VkDescriptorSetLayout> layouts{globalSetLayout, storageSetLayout, storageSetLayout};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = layouts.size();
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    if (vkCreatePipelineLayout(cfxDevice.device(deviceIndex), &pipelineLayoutInfo, nullptr, &cullPipelineLayout[deviceIndex]) != VK_SUCCESS)
+    {
+      throw std::runtime_error("failed to create meshlet cull pipeline layout");
+    }
+    cullPipeLines[deviceIndex] = std::make_unique<CFXComputePipeLine>(cfxDevice, cullPipelineLayout[deviceIndex], "shaders/meshlet_cull.comp.spv", deviceIndex);
+
+    drawBuffers[deviceIndex].resize(CFXSwapChain::MAX_FRAMES_IN_FLIGHT);
+    drawDescriptorSets[deviceIndex].resize(CFXSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < CFXSwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+    {
+      drawBuffers[deviceIndex][i] = std::make_unique<CFXBuffer>(cfxDevice, sizeof(VkDrawIndexedIndirectCommand), MAX_MESHLET_DRAWS,
+                                                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceIndex);
+      auto bufferInfo = drawBuffers[deviceIndex][i]->descriptorInfo();
+      if (!CFXDescriptorWriter(*storageSetLayouts[deviceIndex], *cullDescriptorPools[deviceIndex]).writeBuffer(0, &bufferInfo).build(drawDescriptorSets[deviceIndex][i], deviceIndex))
+      {
+        throw std::runtime_error("failed to allocate meshlet draw descriptor set");
+      }
+    }
+  }
+  VkDescriptorSet CFXRenderSystem::getMeshletDescriptorSet(int deviceIndex, uint32_t block)
   {
-    // std::cout << "RENDER GAME OBJECTS ON " << cfxDevice.getDeviceName(deviceIndex) << std::endl;
-    cfxPipeLines[frameInfo.deviceIndex]->bind(frameInfo.commandBuffer);
-    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout[frameInfo.deviceIndex], 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+    // meshlet blocks are never released, unlike vertex and index blocks, so a set written once stays valid
+    std::vector<VkDescriptorSet> &sets = meshletDescriptorSets[deviceIndex];
+    while (sets.size() <= block)
+    {
+      uint32_t newBlock = static_cast<uint32_t>(sets.size());
+      VkDescriptorBufferInfo bufferInfo{};
+      bufferInfo.buffer = geometryArena.getBuffer(CFXGeometryArena::Pool::Meshlet, newBlock, deviceIndex);
+      bufferInfo.offset = 0;
+      bufferInfo.range = geometryArena.getBlockSize(CFXGeometryArena::Pool::Meshlet, newBlock);
+      VkDescriptorSet set;
+      if (!CFXDescriptorWriter(*storageSetLayouts[deviceIndex], *cullDescriptorPools[deviceIndex]).writeBuffer(0, &bufferInfo).build(set, deviceIndex))
+      {
+        throw std::runtime_error("failed to allocate meshlet descriptor set, more than MAX_MESHLET_BLOCKS meshlet blocks");
+      }
+      sets.push_back(set);
+    }
+    return sets[block];
+  }
 
+  void CFXRenderSystem::cullGameObjects(FrameInfo &frameInfo)
+  {
+    int deviceIndex = frameInfo.deviceIndex;
+    CFXBuffer &drawBuffer = *drawBuffers[deviceIndex][frameInfo.frameIndex];
+    drawItems.clear();
+    uint32_t drawCount = 0;
+    uint32_t boundBlock = UINT32_MAX;
     for (auto &kv : frameInfo.gameObjects)
     {
       auto &obj = kv.second;
       if (obj.model == nullptr)
         continue;
+      // still streaming in, draw its placeholder if it has one
+      CFXModel *model = obj.model->getDrawable();
+      if (model == nullptr)
+        continue;
+      DrawItem item{&obj, model, obj.transformComponent.mat4(), 0, NO_MESHLET_DRAWS};
+      const glm::vec3 &scale = obj.transformComponent.scale;
+      float maxScale = std::max({std::abs(scale.x), std::abs(scale.y), std::abs(scale.z)});
+      item.lod = selectLod(*model, item.modelMatrix, maxScale, frameInfo);
+
+      // coarser levels are small enough to draw whole
+      uint32_t meshletCount = model->getMeshletCount();
+      if (item.lod == 0 && meshletCount > 0 && drawCount + meshletCount <= MAX_MESHLET_DRAWS)
+      {
+        if (boundBlock == UINT32_MAX)
+        {
+          cullPipeLines[deviceIndex]->bind(frameInfo.commandBuffer);
+          VkDescriptorSet sets[] = {frameInfo.globalDescriptorSet, drawDescriptorSets[deviceIndex][frameInfo.frameIndex]};
+          vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout[deviceIndex], 0, 2, sets, 1, &frameInfo.globalUboOffset);
+        }
+        if (model->getMeshletBlock() != boundBlock)
+        {
+          boundBlock = model->getMeshletBlock();
+          VkDescriptorSet meshletSet = getMeshletDescriptorSet(deviceIndex, boundBlock);
+          vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout[deviceIndex], 2, 1, &meshletSet, 0, nullptr);
+        }
+
+        MeshletCullPushConstantData push{};
+        push.modelMatrix = item.modelMatrix;
+        push.cameraPosition = glm::vec4{glm::vec3{glm::inverse(item.modelMatrix) * glm::vec4{frameInfo.camera.getPosition(), 1.f}}, maxScale};
+        push.meshletOffset = model->getMeshletOffset();
+        push.meshletCount = meshletCount;
+        push.drawOffset = drawCount;
+        push.firstIndex = model->getFirstIndex();
+        push.vertexOffset = model->getVertexOffset();
+        push.backfaceCulling = backfaceCulling ? 1u : 0u;
+        vkCmdPushConstants(frameInfo.commandBuffer, cullPipelineLayout[deviceIndex], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullPushConstantData), &push);
+        vkCmdDispatch(frameInfo.commandBuffer, (meshletCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        item.meshletDrawOffset = static_cast<VkDeviceSize>(drawCount) * drawBuffer.getInstanceSize();
+        drawCount += meshletCount;
+      }
+      drawItems.push_back(item);
+    }
+
+    if (drawCount > 0)
+    {
+      VkBufferMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.buffer = drawBuffer.getBuffer();
+      barrier.offset = 0;
+      barrier.size = VK_WHOLE_SIZE;
+      vkCmdPipelineBarrier(frameInfo.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+                           0, nullptr, 1, &barrier, 0, nullptr);
+    }
+  }
+  void CFXRenderSystem::renderGameObjects(FrameInfo &frameInfo)
+  {
+    // std::cout << "RENDER GAME OBJECTS ON " << cfxDevice.getDeviceName(deviceIndex) << std::endl;
+    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout[frameInfo.deviceIndex], 0, 1, &frameInfo.globalDescriptorSet, 1, &frameInfo.globalUboOffset);
+
+    VkBuffer drawBuffer = drawBuffers[frameInfo.deviceIndex][frameInfo.frameIndex]->getBuffer();
+    bool multiDrawIndirect = cfxDevice.getEnabledFeatures(frameInfo.deviceIndex).multiDrawIndirect == VK_TRUE;
+    size_t boundFormat = CFXModel::VERTEX_FORMAT_COUNT;
+    CFXGeometryArena::BindState bindState{};
+    for (const DrawItem &item : drawItems)
+    {
+      CFXModel *model = item.model;
+      size_t formatIndex = static_cast<size_t>(model->getVertexFormat());
+      if (formatIndex != boundFormat)
+      {
+        cfxPipeLines[frameInfo.deviceIndex][formatIndex]->bind(frameInfo.commandBuffer);
+        boundFormat = formatIndex;
+      }
+
       SimplePushConstantData push{};
-      push.modelMatrix = obj.transformComponent.mat4();
-      push.normlaMatrix = obj.transformComponent.normalMatrix();
+      push.modelMatrix = item.modelMatrix * model->getPositionTransform();
+      push.normlaMatrix = item.object->transformComponent.normalMatrix();
 
       vkCmdPushConstants(
           frameInfo.commandBuffer,
@@ -57,11 +228,36 @@ namespace cfx
           0,
           sizeof(SimplePushConstantData),
           &push);
-      obj.model->bind(frameInfo.commandBuffer, frameInfo.deviceIndex);
-      obj.model->draw(frameInfo.commandBuffer);
+      model->bind(frameInfo.commandBuffer, frameInfo.deviceIndex, bindState);
+      if (item.meshletDrawOffset != NO_MESHLET_DRAWS)
+        model->drawMeshlets(frameInfo.commandBuffer, drawBuffer, item.meshletDrawOffset, multiDrawIndirect);
+      else
+        model->draw(frameInfo.commandBuffer, item.lod);
       // std::cout << "RENDER GAME OBJECTS END ON " << std::endl;
     }
   }
+  uint32_t CFXRenderSystem::selectLod(const CFXModel &model, const glm::mat4 &modelMatrix, float maxScale, const FrameInfo &frameInfo) const
+  {
+    const std::vector<CFXModel::Lod> &lods = model.getLods();
+    if (lods.size() <= 1)
+      return 0;
+    // distance from the camera to the nearest point of the bounding sphere
+    const CFXBounds &bounds = model.getBounds();
+    glm::vec3 center{modelMatrix * glm::vec4{bounds.center, 1.f}};
+    float distance = glm::length(center - frameInfo.camera.getPosition()) - bounds.radius * maxScale;
+    if (distance <= 0.f)
+      return 0;
+    // world units to pixels at that distance, projection[1][1] is 1 / tan(fovy / 2)
+    float pixelsPerUnit = frameInfo.camera.getProjection()[1][1] * frameInfo.viewportHeight * 0.5f / distance;
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < lods.size(); i++)
+    {
+      if (lods[i].error * maxScale * pixelsPerUnit > LOD_PIXEL_ERROR)
+        break;
+      lod = i;
+    }
+    return lod;
+  }
   void CFXRenderSystem::createPipelineLayout(VkDescriptorSetLayout descriptorSetLayout, int deviceIndex)
   {
     VkPushConstantRange pushConstantRange{};
@@ -82,7 +278,7 @@ namespace cfx
       throw std::runtime_error("failed to create pipeline layout");
     }
   }
-  void CFXRenderSystem::createPipeline(VkRenderPass renderpass, int deviceIndex)
+  void CFXRenderSystem::createPipeline(VkRenderPass renderpass, int deviceIndex, CFXModel::VertexFormat vertexFormat)
   {
 
     // std::cout << "CREATE PIPELINE " << std::endl;
@@ -90,9 +286,19 @@ namespace cfx
     CFXPipeLine::defaultPipelineConfigInfo(pipelineConfig);
     pipelineConfig.renderPass = renderpass;
     pipelineConfig.pipelineLayout = pipelineLayout[deviceIndex];
-    cfxPipeLines[deviceIndex] = std::make_unique<CFXPipeLine>(cfxDevice, pipelineConfig,
-                                                              "shaders/simple_shader.vert.spv",
-                                                              "shaders/simple_shader.frag.spv", deviceIndex);
+    pipelineConfig.bindingDescriptions = CFXModel::getBindingDescriptions(vertexFormat);
+    pipelineConfig.attributeDescriptions = CFXModel::getAttributeDescriptions(vertexFormat);
+    backfaceCulling = (pipelineConfig.rasterizationInfo.cullMode & VK_CULL_MODE_BACK_BIT) != 0;
+
+    // constant_id 0 in simple_shader.vert, packedVertices
+    VkBool32 packedVertices = vertexFormat == CFXModel::VertexFormat::Packed ? VK_TRUE : VK_FALSE;
+    pipelineConfig.specializationMapEntries = {{0, 0, sizeof(VkBool32)}};
+    pipelineConfig.specializationData.resize(sizeof(VkBool32));
+    memcpy(pipelineConfig.specializationData.data(), &packedVertices, sizeof(VkBool32));
+
+    cfxPipeLines[deviceIndex][static_cast<size_t>(vertexFormat)] = std::make_unique<CFXPipeLine>(cfxDevice, pipelineConfig,
+                                                                                                 "shaders/simple_shader.vert.spv",
+                                                                                                 "shaders/simple_shader.frag.spv", deviceIndex);
     // std::cout << "CREATE PIPELINE END " << std::endl;
   }
 
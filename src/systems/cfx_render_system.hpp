@@ -8,6 +8,9 @@
 #include "../cfx_game_object.hpp"
 #include "../cfx_frame_info.hpp"
 #include "../cfx_descriptors.hpp"
+#include "../cfx_buffer.hpp"
+#include "../cfx_geometry_arena.hpp"
+#include <array>
 #include <memory>
 #include <vector>
 #include <glm/glm.hpp>
@@ -16,20 +19,58 @@ namespace cfx
     class CFXRenderSystem
     {
     public:
-        CFXRenderSystem(CFXDevice &device, std::vector<VkRenderPass> renderPasses, std::vector<std::unique_ptr<CFXDescriptorSetLayout>> &cfxSetLayouts);
+        // Most meshlet draw commands one frame can hold, objects past it are drawn without culling
+        static constexpr uint32_t MAX_MESHLET_DRAWS = 64 * 1024;
+        // Meshlet pool blocks the culling descriptor pool has room for
+        static constexpr uint32_t MAX_MESHLET_BLOCKS = 16;
+
+        CFXRenderSystem(CFXDevice &device, CFXGeometryArena &arena, std::vector<VkRenderPass> renderPasses,
+                        std::vector<std::unique_ptr<CFXDescriptorSetLayout>> &cfxSetLayouts);
         ~CFXRenderSystem();
         CFXRenderSystem(const CFXRenderSystem &) = delete;
         CFXRenderSystem &operator=(const CFXRenderSystem &) = delete;
+        // Outside the render pass: picks each object's level and culls the meshlets of the ones
+        // drawn at full detail on the GPU. renderGameObjects draws what this selected.
+        void cullGameObjects(FrameInfo &frameInfo);
         void renderGameObjects(FrameInfo &frameInfo);
 
     private:
+        struct DrawItem
+        {
+            CFXGameObject *object;
+            CFXModel *model;
+            glm::mat4 modelMatrix;
+            uint32_t lod;
+            // into the frame's draw buffer, NO_MESHLET_DRAWS when drawn without meshlets
+            VkDeviceSize meshletDrawOffset;
+        };
+        static constexpr VkDeviceSize NO_MESHLET_DRAWS = ~VkDeviceSize{0};
+
         void createPipelineLayout(VkDescriptorSetLayout descriptorSetLayout, int deviceIndex);
-        void createPipeline(VkRenderPass renderpass, int deviceIndex);
+        void createPipeline(VkRenderPass renderpass, int deviceIndex, CFXModel::VertexFormat vertexFormat);
+        void createCullResources(VkDescriptorSetLayout globalSetLayout, int deviceIndex);
+        VkDescriptorSet getMeshletDescriptorSet(int deviceIndex, uint32_t block);
+        uint32_t selectLod(const CFXModel &model, const glm::mat4 &modelMatrix, float maxScale, const FrameInfo &frameInfo) const;
 
         CFXDevice &cfxDevice;
         // CFXSwapChain cfxSwapChain{cfxDevice,window.getExtent()};
 
-        std::vector<std::unique_ptr<CFXPipeLine>> cfxPipeLines;
+        // one pipeline per device and CFXModel::VertexFormat
+        std::vector<std::array<std::unique_ptr<CFXPipeLine>, CFXModel::VERTEX_FORMAT_COUNT>> cfxPipeLines;
         std::vector<VkPipelineLayout> pipelineLayout;
+        // cone culling is only valid when the pipeline drops back faces anyway
+        bool backfaceCulling = false;
+
+        CFXGeometryArena &geometryArena;
+        std::vector<DrawItem> drawItems;
+        // meshlet culling, per device: set 0 is the global set, 1 the frame's draw buffer, 2 a meshlet pool block
+        std::vector<VkPipelineLayout> cullPipelineLayout;
+        std::vector<std::unique_ptr<CFXComputePipeLine>> cullPipeLines;
+        std::vector<std::unique_ptr<CFXDescriptorSetLayout>> storageSetLayouts;
+        std::vector<std::unique_ptr<CFXDescriptorPool>> cullDescriptorPools;
+        std::vector<std::vector<VkDescriptorSet>> meshletDescriptorSets;
+        // per device and frame in flight
+        std::vector<std::vector<std::unique_ptr<CFXBuffer>>> drawBuffers;
+        std::vector<std::vector<VkDescriptorSet>> drawDescriptorSets;
     };
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "cfx_asset_archive.hpp"
+#include "cfx_mapped_file.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Packs files into a .cfxa asset archive: cfx_pack <archive> <name>=<file>...
+// name is the path the app opens the file by, relative to its working directory.
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: cfx_pack <archive> <name>=<file>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::shared_ptr<cfx::CFXMappedFile>> files{};
+    std::vector<cfx::CFXAssetArchive::EntryData> entries{};
+    uint64_t totalSize = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string argument{argv[i]};
+        size_t separator = argument.find('=');
+        if (separator == std::string::npos)
+        {
+            std::cerr << "expected <name>=<file>: " << argument << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::string name = argument.substr(0, separator);
+        std::string filepath = argument.substr(separator + 1);
+        std::shared_ptr<cfx::CFXMappedFile> file = cfx::CFXMappedFile::map(filepath);
+        uint64_t size = 0;
+        int64_t time = 0;
+        if (file == nullptr || !cfx::CFXMappedFile::query(filepath, size, time))
+        {
+            std::cerr << "failed to open file: " << filepath << std::endl;
+            return EXIT_FAILURE;
+        }
+        entries.push_back({name, file->data(), file->size(), time});
+        files.push_back(file);
+        totalSize += file->size();
+    }
+
+    try
+    {
+        if (!cfx::CFXAssetArchive::write(argv[1], entries))
+        {
+            std::cerr << "failed to write asset archive: " << argv[1] << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::shared_ptr<cfx::CFXMappedFile> archive = cfx::CFXMappedFile::map(argv[1]);
+        std::cout << "Packed " << entries.size() << " files, " << totalSize << " -> " << (archive ? archive->size() : 0)
+                  << " bytes into " << argv[1] << std::endl;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}